@@ -0,0 +1,594 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define BIT_TRANSFORM_X86
+#define BIT_TRANSFORM_TARGET(isa)   __attribute__((target(isa)))
+#else
+#define BIT_TRANSFORM_TARGET(isa)
+#endif
+
+#include "bit_transform.h"
+
+#ifndef BIT_TRANSFORM_NO_MAIN
+int main(int argc, char *argv[]) {
+    // Usage: bit_transform [x]
+    uint64_t x = argc > 1 ? strtoull(argv[1], NULL, 0) : 0x0123456789ABCDEFULL;
+
+    printf("x:              0x%016llx\n", (unsigned long long)x);
+    printf("bit_reverse64:  0x%016llx\n",
+            (unsigned long long)bit_reverse64(x));
+    printf("gray_encode64:  0x%016llx -> 0x%016llx\n",
+            (unsigned long long)gray_encode64(x),
+            (unsigned long long)gray_decode64(gray_encode64(x)));
+    printf("bit_parity64:   %u (kernel: %s)\n", bit_parity64(x),
+            bit_transform_kernel());
+
+    return 0;
+}
+#endif
+
+// `dst[idx] = func(src[idx])` from `first` on, for the tails of the vector
+// kernels.
+#define MAP_WORDS(src, first, count, dst, func) \
+    for (size_t pos = (first); pos < (count); ++pos) \
+        (dst)[pos] = func((src)[pos])
+
+// The parity words of the elements from `first`, a multiple of 64, on.
+#define PARITY_WORDS(src, first, count, bits, func) \
+    for (size_t pos = (first); pos < (count); pos += 64) { \
+        uint64_t word = 0; \
+        size_t last = (count) - pos < 64 ? (count) - pos : 64; \
+        for (size_t bit = 0; bit < last; ++bit) \
+            word |= (uint64_t)func((src)[pos + bit]) << bit; \
+        (bits)[pos / 64] = word; \
+    }
+
+static void scalar_reverse32(const uint32_t *src, size_t count,
+        uint32_t *dst) {
+    MAP_WORDS(src, 0, count, dst, bit_reverse32);
+}
+
+static void scalar_reverse64(const uint64_t *src, size_t count,
+        uint64_t *dst) {
+    MAP_WORDS(src, 0, count, dst, bit_reverse64);
+}
+
+static void scalar_gray_encode32(const uint32_t *src, size_t count,
+        uint32_t *dst) {
+    MAP_WORDS(src, 0, count, dst, gray_encode32);
+}
+
+static void scalar_gray_encode64(const uint64_t *src, size_t count,
+        uint64_t *dst) {
+    MAP_WORDS(src, 0, count, dst, gray_encode64);
+}
+
+static void scalar_gray_decode32(const uint32_t *src, size_t count,
+        uint32_t *dst) {
+    MAP_WORDS(src, 0, count, dst, gray_decode32);
+}
+
+static void scalar_gray_decode64(const uint64_t *src, size_t count,
+        uint64_t *dst) {
+    MAP_WORDS(src, 0, count, dst, gray_decode64);
+}
+
+static void scalar_parity32(const uint32_t *src, size_t count,
+        uint64_t *bits) {
+    PARITY_WORDS(src, 0, count, bits, bit_parity32);
+}
+
+static void scalar_parity64(const uint64_t *src, size_t count,
+        uint64_t *bits) {
+    PARITY_WORDS(src, 0, count, bits, bit_parity64);
+}
+
+#ifdef BIT_TRANSFORM_X86
+/*
+ * AVX2: the bits of every byte are reversed by two `vpshufb` lookups, the
+ * reversed low nibble becomes the high one and the other way round. A third
+ * `vpshufb` reverses the bytes of every element. Parity folds every element
+ * to a nibble and looks it up the same way.
+ */
+
+BIT_TRANSFORM_TARGET("avx2")
+static inline __m256i reverse_bytes_256(__m256i v) {
+    const __m256i highTable = _mm256_setr_epi8(
+            0x0, 0x8, 0x4, 0xC, 0x2, 0xA, 0x6, 0xE,
+            0x1, 0x9, 0x5, 0xD, 0x3, 0xB, 0x7, 0xF,
+            0x0, 0x8, 0x4, 0xC, 0x2, 0xA, 0x6, 0xE,
+            0x1, 0x9, 0x5, 0xD, 0x3, 0xB, 0x7, 0xF);
+    // The same nibbles one nibble up, no bits cross into the next byte.
+    const __m256i lowTable = _mm256_slli_epi16(highTable, 4);
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+
+    __m256i low = _mm256_and_si256(v, nibble);
+    __m256i high = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+    return _mm256_or_si256(_mm256_shuffle_epi8(lowTable, low),
+            _mm256_shuffle_epi8(highTable, high));
+}
+
+// The parity of the low nibble of every byte, the bits of `0x6996`.
+BIT_TRANSFORM_TARGET("avx2")
+static inline __m256i parity_table_256(void) {
+    return _mm256_setr_epi8(0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
+            0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0);
+}
+
+BIT_TRANSFORM_TARGET("avx2")
+static void avx2_reverse32(const uint32_t *src, size_t count, uint32_t *dst) {
+    const __m256i swap = _mm256_setr_epi8(
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    size_t idx = 0;
+    for (; idx + 8 <= count; idx += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + idx));
+        v = _mm256_shuffle_epi8(reverse_bytes_256(v), swap);
+        _mm256_storeu_si256((__m256i *)(dst + idx), v);
+    }
+    MAP_WORDS(src, idx, count, dst, bit_reverse32);
+}
+
+BIT_TRANSFORM_TARGET("avx2")
+static void avx2_reverse64(const uint64_t *src, size_t count, uint64_t *dst) {
+    const __m256i swap = _mm256_setr_epi8(
+            7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+            7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    size_t idx = 0;
+    for (; idx + 4 <= count; idx += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + idx));
+        v = _mm256_shuffle_epi8(reverse_bytes_256(v), swap);
+        _mm256_storeu_si256((__m256i *)(dst + idx), v);
+    }
+    MAP_WORDS(src, idx, count, dst, bit_reverse64);
+}
+
+BIT_TRANSFORM_TARGET("avx2")
+static void avx2_gray_encode32(const uint32_t *src, size_t count,
+        uint32_t *dst) {
+    size_t idx = 0;
+    for (; idx + 8 <= count; idx += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + idx));
+        v = _mm256_xor_si256(v, _mm256_srli_epi32(v, 1));
+        _mm256_storeu_si256((__m256i *)(dst + idx), v);
+    }
+    MAP_WORDS(src, idx, count, dst, gray_encode32);
+}
+
+BIT_TRANSFORM_TARGET("avx2")
+static void avx2_gray_encode64(const uint64_t *src, size_t count,
+        uint64_t *dst) {
+    size_t idx = 0;
+    for (; idx + 4 <= count; idx += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + idx));
+        v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 1));
+        _mm256_storeu_si256((__m256i *)(dst + idx), v);
+    }
+    MAP_WORDS(src, idx, count, dst, gray_encode64);
+}
+
+BIT_TRANSFORM_TARGET("avx2")
+static void avx2_gray_decode32(const uint32_t *src, size_t count,
+        uint32_t *dst) {
+    size_t idx = 0;
+    for (; idx + 8 <= count; idx += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + idx));
+        v = _mm256_xor_si256(v, _mm256_srli_epi32(v, 1));
+        v = _mm256_xor_si256(v, _mm256_srli_epi32(v, 2));
+        v = _mm256_xor_si256(v, _mm256_srli_epi32(v, 4));
+        v = _mm256_xor_si256(v, _mm256_srli_epi32(v, 8));
+        v = _mm256_xor_si256(v, _mm256_srli_epi32(v, 16));
+        _mm256_storeu_si256((__m256i *)(dst + idx), v);
+    }
+    MAP_WORDS(src, idx, count, dst, gray_decode32);
+}
+
+BIT_TRANSFORM_TARGET("avx2")
+static void avx2_gray_decode64(const uint64_t *src, size_t count,
+        uint64_t *dst) {
+    size_t idx = 0;
+    for (; idx + 4 <= count; idx += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + idx));
+        v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 1));
+        v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 2));
+        v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 4));
+        v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 8));
+        v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 16));
+        v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 32));
+        _mm256_storeu_si256((__m256i *)(dst + idx), v);
+    }
+    MAP_WORDS(src, idx, count, dst, gray_decode64);
+}
+
+// 64 elements per parity word, eight per vector, the parity moved to the
+// sign bit of every element for `vmovmskps`.
+BIT_TRANSFORM_TARGET("avx2")
+static void avx2_parity32(const uint32_t *src, size_t count, uint64_t *bits) {
+    const __m256i table = parity_table_256();
+    const __m256i nibble = _mm256_set1_epi32(0xF);
+    size_t idx = 0;
+    for (; idx + 64 <= count; idx += 64) {
+        uint64_t word = 0;
+        for (int part = 0; part < 8; ++part) {
+            __m256i v = _mm256_loadu_si256(
+                    (const __m256i *)(src + idx + 8 * part));
+            v = _mm256_xor_si256(v, _mm256_srli_epi32(v, 16));
+            v = _mm256_xor_si256(v, _mm256_srli_epi32(v, 8));
+            v = _mm256_xor_si256(v, _mm256_srli_epi32(v, 4));
+            v = _mm256_shuffle_epi8(table, _mm256_and_si256(v, nibble));
+            word |= (uint64_t)_mm256_movemask_ps(_mm256_castsi256_ps(
+                        _mm256_slli_epi32(v, 31))) << (8 * part);
+        }
+        bits[idx / 64] = word;
+    }
+    PARITY_WORDS(src, idx, count, bits, bit_parity32);
+}
+
+BIT_TRANSFORM_TARGET("avx2")
+static void avx2_parity64(const uint64_t *src, size_t count, uint64_t *bits) {
+    const __m256i table = parity_table_256();
+    const __m256i nibble = _mm256_set1_epi64x(0xF);
+    size_t idx = 0;
+    for (; idx + 64 <= count; idx += 64) {
+        uint64_t word = 0;
+        for (int part = 0; part < 16; ++part) {
+            __m256i v = _mm256_loadu_si256(
+                    (const __m256i *)(src + idx + 4 * part));
+            v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 32));
+            v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 16));
+            v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 8));
+            v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 4));
+            v = _mm256_shuffle_epi8(table, _mm256_and_si256(v, nibble));
+            word |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(
+                        _mm256_slli_epi64(v, 63))) << (4 * part);
+        }
+        bits[idx / 64] = word;
+    }
+    PARITY_WORDS(src, idx, count, bits, bit_parity64);
+}
+
+/*
+ * AVX-512 with GFNI: `vgf2p8affineqb` multiplies every byte by an 8x8 bit
+ * matrix, bit `i` of the result is the parity of the byte AND row `7 - i`.
+ * Rows `1 << i` reverse the bits of the byte, a row of 0xFF for bit 0 gives
+ * its parity. The tails are done by masked loads and stores.
+ */
+
+#define GFNI_TARGET     "avx512f,avx512bw,gfni"
+
+// Row `7 - i` selects bit `7 - i`.
+#define GFNI_REVERSE    0x8040201008040201LL
+// Only row 7, all bits: the parity of the byte in bit 0.
+#define GFNI_PARITY     ((long long)0xFF00000000000000ULL)
+
+BIT_TRANSFORM_TARGET(GFNI_TARGET)
+static void avx512_reverse32(const uint32_t *src, size_t count,
+        uint32_t *dst) {
+    const __m512i matrix = _mm512_set1_epi64(GFNI_REVERSE);
+    const __m512i swap = _mm512_broadcast_i32x4(_mm_setr_epi8(
+                3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12));
+    for (size_t idx = 0; idx < count; idx += 16) {
+        __mmask16 mask = count - idx >= 16 ? 0xFFFF
+            : (__mmask16)((1u << (count - idx)) - 1);
+        __m512i v = _mm512_maskz_loadu_epi32(mask, src + idx);
+        v = _mm512_gf2p8affine_epi64_epi8(v, matrix, 0);
+        _mm512_mask_storeu_epi32(dst + idx, mask,
+                _mm512_shuffle_epi8(v, swap));
+    }
+}
+
+BIT_TRANSFORM_TARGET(GFNI_TARGET)
+static void avx512_reverse64(const uint64_t *src, size_t count,
+        uint64_t *dst) {
+    const __m512i matrix = _mm512_set1_epi64(GFNI_REVERSE);
+    const __m512i swap = _mm512_broadcast_i32x4(_mm_setr_epi8(
+                7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8));
+    for (size_t idx = 0; idx < count; idx += 8) {
+        __mmask8 mask = count - idx >= 8 ? 0xFF
+            : (__mmask8)((1u << (count - idx)) - 1);
+        __m512i v = _mm512_maskz_loadu_epi64(mask, src + idx);
+        v = _mm512_gf2p8affine_epi64_epi8(v, matrix, 0);
+        _mm512_mask_storeu_epi64(dst + idx, mask,
+                _mm512_shuffle_epi8(v, swap));
+    }
+}
+
+BIT_TRANSFORM_TARGET(GFNI_TARGET)
+static void avx512_gray_encode32(const uint32_t *src, size_t count,
+        uint32_t *dst) {
+    for (size_t idx = 0; idx < count; idx += 16) {
+        __mmask16 mask = count - idx >= 16 ? 0xFFFF
+            : (__mmask16)((1u << (count - idx)) - 1);
+        __m512i v = _mm512_maskz_loadu_epi32(mask, src + idx);
+        _mm512_mask_storeu_epi32(dst + idx, mask,
+                _mm512_xor_si512(v, _mm512_srli_epi32(v, 1)));
+    }
+}
+
+BIT_TRANSFORM_TARGET(GFNI_TARGET)
+static void avx512_gray_encode64(const uint64_t *src, size_t count,
+        uint64_t *dst) {
+    for (size_t idx = 0; idx < count; idx += 8) {
+        __mmask8 mask = count - idx >= 8 ? 0xFF
+            : (__mmask8)((1u << (count - idx)) - 1);
+        __m512i v = _mm512_maskz_loadu_epi64(mask, src + idx);
+        _mm512_mask_storeu_epi64(dst + idx, mask,
+                _mm512_xor_si512(v, _mm512_srli_epi64(v, 1)));
+    }
+}
+
+// `a ^ b ^ c` in one `vpternlogq`: the prefix XOR triples its window per
+// step, 3, 9, 27, then 54 (32-bit) or 81 (64-bit) bits.
+#define XOR3(a, b, c)   _mm512_ternarylogic_epi64(a, b, c, 0x96)
+
+BIT_TRANSFORM_TARGET(GFNI_TARGET)
+static void avx512_gray_decode32(const uint32_t *src, size_t count,
+        uint32_t *dst) {
+    for (size_t idx = 0; idx < count; idx += 16) {
+        __mmask16 mask = count - idx >= 16 ? 0xFFFF
+            : (__mmask16)((1u << (count - idx)) - 1);
+        __m512i v = _mm512_maskz_loadu_epi32(mask, src + idx);
+        v = XOR3(v, _mm512_srli_epi32(v, 1), _mm512_srli_epi32(v, 2));
+        v = XOR3(v, _mm512_srli_epi32(v, 3), _mm512_srli_epi32(v, 6));
+        v = XOR3(v, _mm512_srli_epi32(v, 9), _mm512_srli_epi32(v, 18));
+        v = _mm512_xor_si512(v, _mm512_srli_epi32(v, 27));
+        _mm512_mask_storeu_epi32(dst + idx, mask, v);
+    }
+}
+
+BIT_TRANSFORM_TARGET(GFNI_TARGET)
+static void avx512_gray_decode64(const uint64_t *src, size_t count,
+        uint64_t *dst) {
+    for (size_t idx = 0; idx < count; idx += 8) {
+        __mmask8 mask = count - idx >= 8 ? 0xFF
+            : (__mmask8)((1u << (count - idx)) - 1);
+        __m512i v = _mm512_maskz_loadu_epi64(mask, src + idx);
+        v = XOR3(v, _mm512_srli_epi64(v, 1), _mm512_srli_epi64(v, 2));
+        v = XOR3(v, _mm512_srli_epi64(v, 3), _mm512_srli_epi64(v, 6));
+        v = XOR3(v, _mm512_srli_epi64(v, 9), _mm512_srli_epi64(v, 18));
+        v = XOR3(v, _mm512_srli_epi64(v, 27), _mm512_srli_epi64(v, 54));
+        _mm512_mask_storeu_epi64(dst + idx, mask, v);
+    }
+}
+
+// Folded to the low byte, the parity of the byte by GFNI, then one mask bit
+// per element by `vptestmd`.
+BIT_TRANSFORM_TARGET(GFNI_TARGET)
+static void avx512_parity32(const uint32_t *src, size_t count,
+        uint64_t *bits) {
+    const __m512i matrix = _mm512_set1_epi64(GFNI_PARITY);
+    const __m512i one = _mm512_set1_epi32(1);
+    size_t idx = 0;
+    for (; idx + 64 <= count; idx += 64) {
+        uint64_t word = 0;
+        for (int part = 0; part < 4; ++part) {
+            __m512i v = _mm512_loadu_si512(src + idx + 16 * part);
+            v = _mm512_xor_si512(v, _mm512_srli_epi32(v, 16));
+            v = _mm512_xor_si512(v, _mm512_srli_epi32(v, 8));
+            v = _mm512_gf2p8affine_epi64_epi8(v, matrix, 0);
+            word |= (uint64_t)_mm512_test_epi32_mask(v, one) << (16 * part);
+        }
+        bits[idx / 64] = word;
+    }
+    PARITY_WORDS(src, idx, count, bits, bit_parity32);
+}
+
+BIT_TRANSFORM_TARGET(GFNI_TARGET)
+static void avx512_parity64(const uint64_t *src, size_t count,
+        uint64_t *bits) {
+    const __m512i matrix = _mm512_set1_epi64(GFNI_PARITY);
+    const __m512i one = _mm512_set1_epi64(1);
+    size_t idx = 0;
+    for (; idx + 64 <= count; idx += 64) {
+        uint64_t word = 0;
+        for (int part = 0; part < 8; ++part) {
+            __m512i v = _mm512_loadu_si512(src + idx + 8 * part);
+            v = _mm512_xor_si512(v, _mm512_srli_epi64(v, 32));
+            v = _mm512_xor_si512(v, _mm512_srli_epi64(v, 16));
+            v = _mm512_xor_si512(v, _mm512_srli_epi64(v, 8));
+            v = _mm512_gf2p8affine_epi64_epi8(v, matrix, 0);
+            word |= (uint64_t)_mm512_test_epi64_mask(v, one) << (8 * part);
+        }
+        bits[idx / 64] = word;
+    }
+    PARITY_WORDS(src, idx, count, bits, bit_parity64);
+}
+
+/*
+ * AVX2 with GFNI (Alder Lake, Zen 4 without AVX-512 use): the affine
+ * transforms of the `avx512` kernel on 256-bit vectors. Gray codes have no
+ * use for GFNI, they are those of `avx2`.
+ */
+
+#define GFNI_AVX2_TARGET    "avx2,gfni"
+
+BIT_TRANSFORM_TARGET(GFNI_AVX2_TARGET)
+static void gfni_reverse32(const uint32_t *src, size_t count, uint32_t *dst) {
+    const __m256i matrix = _mm256_set1_epi64x(GFNI_REVERSE);
+    const __m256i swap = _mm256_setr_epi8(
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    size_t idx = 0;
+    for (; idx + 8 <= count; idx += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + idx));
+        v = _mm256_gf2p8affine_epi64_epi8(v, matrix, 0);
+        _mm256_storeu_si256((__m256i *)(dst + idx),
+                _mm256_shuffle_epi8(v, swap));
+    }
+    MAP_WORDS(src, idx, count, dst, bit_reverse32);
+}
+
+BIT_TRANSFORM_TARGET(GFNI_AVX2_TARGET)
+static void gfni_reverse64(const uint64_t *src, size_t count, uint64_t *dst) {
+    const __m256i matrix = _mm256_set1_epi64x(GFNI_REVERSE);
+    const __m256i swap = _mm256_setr_epi8(
+            7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+            7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    size_t idx = 0;
+    for (; idx + 4 <= count; idx += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + idx));
+        v = _mm256_gf2p8affine_epi64_epi8(v, matrix, 0);
+        _mm256_storeu_si256((__m256i *)(dst + idx),
+                _mm256_shuffle_epi8(v, swap));
+    }
+    MAP_WORDS(src, idx, count, dst, bit_reverse64);
+}
+
+// Folded to the low byte, the parity of the byte by GFNI in bit 0, moved to
+// the sign bit for `vmovmskps`/`vmovmskpd`.
+BIT_TRANSFORM_TARGET(GFNI_AVX2_TARGET)
+static void gfni_parity32(const uint32_t *src, size_t count, uint64_t *bits) {
+    const __m256i matrix = _mm256_set1_epi64x(GFNI_PARITY);
+    size_t idx = 0;
+    for (; idx + 64 <= count; idx += 64) {
+        uint64_t word = 0;
+        for (int part = 0; part < 8; ++part) {
+            __m256i v = _mm256_loadu_si256(
+                    (const __m256i *)(src + idx + 8 * part));
+            v = _mm256_xor_si256(v, _mm256_srli_epi32(v, 16));
+            v = _mm256_xor_si256(v, _mm256_srli_epi32(v, 8));
+            v = _mm256_gf2p8affine_epi64_epi8(v, matrix, 0);
+            word |= (uint64_t)_mm256_movemask_ps(_mm256_castsi256_ps(
+                        _mm256_slli_epi32(v, 31))) << (8 * part);
+        }
+        bits[idx / 64] = word;
+    }
+    PARITY_WORDS(src, idx, count, bits, bit_parity32);
+}
+
+BIT_TRANSFORM_TARGET(GFNI_AVX2_TARGET)
+static void gfni_parity64(const uint64_t *src, size_t count, uint64_t *bits) {
+    const __m256i matrix = _mm256_set1_epi64x(GFNI_PARITY);
+    size_t idx = 0;
+    for (; idx + 64 <= count; idx += 64) {
+        uint64_t word = 0;
+        for (int part = 0; part < 16; ++part) {
+            __m256i v = _mm256_loadu_si256(
+                    (const __m256i *)(src + idx + 4 * part));
+            v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 32));
+            v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 16));
+            v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 8));
+            v = _mm256_gf2p8affine_epi64_epi8(v, matrix, 0);
+            word |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(
+                        _mm256_slli_epi64(v, 63))) << (4 * part);
+        }
+        bits[idx / 64] = word;
+    }
+    PARITY_WORDS(src, idx, count, bits, bit_parity64);
+}
+#endif
+
+typedef struct {
+    const char      *name;
+    const char      *isa;           ///< CPU feature, NULL for portable code.
+    void            (*reverse32)(const uint32_t *, size_t, uint32_t *);
+    void            (*reverse64)(const uint64_t *, size_t, uint64_t *);
+    void            (*gray_encode32)(const uint32_t *, size_t, uint32_t *);
+    void            (*gray_encode64)(const uint64_t *, size_t, uint64_t *);
+    void            (*gray_decode32)(const uint32_t *, size_t, uint32_t *);
+    void            (*gray_decode64)(const uint64_t *, size_t, uint64_t *);
+    void            (*parity32)(const uint32_t *, size_t, uint64_t *);
+    void            (*parity64)(const uint64_t *, size_t, uint64_t *);
+} bit_transform_kernel_t;
+
+#define BIT_TRANSFORM_KERNEL_ENTRY(name, isa, level) \
+    { name, isa, level##_reverse32, level##_reverse64, \
+        level##_gray_encode32, level##_gray_encode64, \
+        level##_gray_decode32, level##_gray_decode64, \
+        level##_parity32, level##_parity64 }
+
+// All kernels, from the slowest to the fastest.
+static const bit_transform_kernel_t kernelTable[] = {
+    BIT_TRANSFORM_KERNEL_ENTRY("scalar", NULL, scalar),
+#ifdef BIT_TRANSFORM_X86
+    BIT_TRANSFORM_KERNEL_ENTRY("avx2", "avx2", avx2),
+    { "avx2-gfni", GFNI_AVX2_TARGET, gfni_reverse32, gfni_reverse64,
+        avx2_gray_encode32, avx2_gray_encode64, avx2_gray_decode32,
+        avx2_gray_decode64, gfni_parity32, gfni_parity64 },
+    BIT_TRANSFORM_KERNEL_ENTRY("avx512", GFNI_TARGET, avx512),
+#endif
+};
+
+#define KERNEL_NUM  (sizeof(kernelTable) / sizeof(kernelTable[0]))
+
+static int kernel_supported(const bit_transform_kernel_t *kernel) {
+#ifdef BIT_TRANSFORM_X86
+    if (NULL != kernel->isa && 0 == strcmp("avx2", kernel->isa))
+        return __builtin_cpu_supports("avx2");
+    if (NULL != kernel->isa && 0 == strcmp(GFNI_AVX2_TARGET, kernel->isa))
+        return __builtin_cpu_supports("avx2")
+            && __builtin_cpu_supports("gfni");
+    if (NULL != kernel->isa && 0 == strcmp(GFNI_TARGET, kernel->isa))
+        return __builtin_cpu_supports("avx512f")
+            && __builtin_cpu_supports("avx512bw")
+            && __builtin_cpu_supports("gfni");
+#endif
+    return NULL == kernel->isa;
+}
+
+static const bit_transform_kernel_t *selectedKernel = &kernelTable[0];
+
+/**
+ * @brief Pick the last supported kernel of the table.
+ */
+__attribute__((constructor))
+static void select_kernel(void) {
+#ifdef BIT_TRANSFORM_X86
+    __builtin_cpu_init();
+#endif
+    for (size_t idx = 0; idx < KERNEL_NUM; ++idx)
+        if (kernel_supported(&kernelTable[idx]))
+            selectedKernel = &kernelTable[idx];
+}
+
+const char *bit_transform_kernel(void) {
+    return selectedKernel->name;
+}
+
+int bit_transform_set_kernel(const char *name) {
+    for (size_t idx = 0; idx < KERNEL_NUM; ++idx) {
+        if (0 == strcmp(name, kernelTable[idx].name)
+                && kernel_supported(&kernelTable[idx])) {
+            selectedKernel = &kernelTable[idx];
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+void bit_reverse32_batch(const uint32_t *src, size_t count, uint32_t *dst) {
+    selectedKernel->reverse32(src, count, dst);
+}
+
+void bit_reverse64_batch(const uint64_t *src, size_t count, uint64_t *dst) {
+    selectedKernel->reverse64(src, count, dst);
+}
+
+void gray_encode32_batch(const uint32_t *src, size_t count, uint32_t *dst) {
+    selectedKernel->gray_encode32(src, count, dst);
+}
+
+void gray_encode64_batch(const uint64_t *src, size_t count, uint64_t *dst) {
+    selectedKernel->gray_encode64(src, count, dst);
+}
+
+void gray_decode32_batch(const uint32_t *src, size_t count, uint32_t *dst) {
+    selectedKernel->gray_decode32(src, count, dst);
+}
+
+void gray_decode64_batch(const uint64_t *src, size_t count, uint64_t *dst) {
+    selectedKernel->gray_decode64(src, count, dst);
+}
+
+void bit_parity32_batch(const uint32_t *src, size_t count, uint64_t *bits) {
+    selectedKernel->parity32(src, count, bits);
+}
+
+void bit_parity64_batch(const uint64_t *src, size_t count, uint64_t *bits) {
+    selectedKernel->parity64(src, count, bits);
+}
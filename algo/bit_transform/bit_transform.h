@@ -0,0 +1,130 @@
+#ifndef BIT_TRANSFORM_H
+#define BIT_TRANSFORM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Word-wise bit transforms: bit reversal (bit `i` to bit `width - 1 - i`),
+ * parity (1 if the number of set bits is odd) and the binary reflected Gray
+ * code (`x ^ x >> 1`, consecutive integers differ in one bit).
+ */
+
+/**
+ * @brief The bits of `x` in reverse order.
+ *
+ * @details Swaps adjacent bits, then pairs, then nibbles, then the bytes by
+ * `bswap`.
+ */
+static inline uint32_t bit_reverse32(uint32_t x) {
+    x = (x >> 1 & 0x55555555) | (x & 0x55555555) << 1;
+    x = (x >> 2 & 0x33333333) | (x & 0x33333333) << 2;
+    x = (x >> 4 & 0x0F0F0F0F) | (x & 0x0F0F0F0F) << 4;
+    return __builtin_bswap32(x);
+}
+
+static inline uint64_t bit_reverse64(uint64_t x) {
+    x = (x >> 1 & 0x5555555555555555ULL) | (x & 0x5555555555555555ULL) << 1;
+    x = (x >> 2 & 0x3333333333333333ULL) | (x & 0x3333333333333333ULL) << 2;
+    x = (x >> 4 & 0x0F0F0F0F0F0F0F0FULL) | (x & 0x0F0F0F0F0F0F0F0FULL) << 4;
+    return __builtin_bswap64(x);
+}
+
+/**
+ * @brief 1 if `x` has an odd number of set bits.
+ *
+ * @details Folds the word to a nibble by XOR, then looks the nibble up in
+ * the 16-bit table `0x6996`.
+ */
+static inline uint32_t bit_parity32(uint32_t x) {
+    x ^= x >> 16;
+    x ^= x >> 8;
+    x ^= x >> 4;
+    return 0x6996 >> (x & 0xF) & 1;
+}
+
+static inline uint32_t bit_parity64(uint64_t x) {
+    return bit_parity32((uint32_t)(x ^ x >> 32));
+}
+
+/**
+ * @brief The Gray code of `x`.
+ */
+static inline uint32_t gray_encode32(uint32_t x) {
+    return x ^ x >> 1;
+}
+
+static inline uint64_t gray_encode64(uint64_t x) {
+    return x ^ x >> 1;
+}
+
+/**
+ * @brief The integer whose Gray code is `x`: bit `i` is the XOR of the bits
+ * `i` and up, a prefix XOR in doubling steps.
+ */
+static inline uint32_t gray_decode32(uint32_t x) {
+    x ^= x >> 1;
+    x ^= x >> 2;
+    x ^= x >> 4;
+    x ^= x >> 8;
+    return x ^ x >> 16;
+}
+
+static inline uint64_t gray_decode64(uint64_t x) {
+    x ^= x >> 1;
+    x ^= x >> 2;
+    x ^= x >> 4;
+    x ^= x >> 8;
+    x ^= x >> 16;
+    return x ^ x >> 32;
+}
+
+/**
+ * @brief Transform `count` words of `src` into `dst` with the kernel selected
+ * at program start. `dst` may be `src`.
+ *
+ * @details `avx512` reverses the bits of every byte by one GFNI affine
+ * transform (`vgf2p8affineqb`) and the bytes by `vpshufb`, `avx2-gfni` does
+ * the same on 256-bit vectors, `avx2` looks the reversed nibbles up by
+ * `vpshufb`, `scalar` is the portable SWAR code above.
+ */
+void bit_reverse32_batch(const uint32_t *src, size_t count, uint32_t *dst);
+void bit_reverse64_batch(const uint64_t *src, size_t count, uint64_t *dst);
+
+void gray_encode32_batch(const uint32_t *src, size_t count, uint32_t *dst);
+void gray_encode64_batch(const uint64_t *src, size_t count, uint64_t *dst);
+void gray_decode32_batch(const uint32_t *src, size_t count, uint32_t *dst);
+void gray_decode64_batch(const uint64_t *src, size_t count, uint64_t *dst);
+
+/**
+ * @brief The parity of `count` words as a bitmap: bit `i % 64` of
+ * `bits[i / 64]` is the parity of `src[i]`.
+ *
+ * @details `bits` has room for `(count + 63) / 64` words, the bits past
+ * `count` in the last one are set to 0.
+ */
+void bit_parity32_batch(const uint32_t *src, size_t count, uint64_t *bits);
+void bit_parity64_batch(const uint64_t *src, size_t count, uint64_t *bits);
+
+/**
+ * @brief The name of the batch kernel: `scalar`, `avx2`, `avx2-gfni` or
+ * `avx512`.
+ */
+const char *bit_transform_kernel(void);
+
+/**
+ * @brief Switch the batch routines to the kernel called `name`.
+ *
+ * @return 0 on success, -1 if the kernel is unknown or not supported.
+ */
+int bit_transform_set_kernel(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BIT_TRANSFORM_H
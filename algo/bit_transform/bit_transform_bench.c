@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bit_transform.h"
+
+#define BENCH_REPEAT    5
+
+static const char *kernels[] = { "scalar", "avx2", "avx2-gfni", "avx512" };
+
+#define KERNEL_NUM      (sizeof(kernels) / sizeof(kernels[0]))
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t xorshift64(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+typedef struct {
+    uint32_t        *src32, *dst32;
+    uint64_t        *src64, *dst64;
+    uint64_t        *bits;
+    size_t          count;          ///< Elements of either width.
+} arrays_t;
+
+enum {
+    ROUTINE_REVERSE32, ROUTINE_REVERSE64, ROUTINE_GRAY_ENCODE32,
+    ROUTINE_GRAY_ENCODE64, ROUTINE_GRAY_DECODE32, ROUTINE_GRAY_DECODE64,
+    ROUTINE_PARITY32, ROUTINE_PARITY64, ROUTINE_NUM
+};
+
+static const char *routineNames[ROUTINE_NUM] = {
+    "reverse32", "reverse64", "gray_encode32", "gray_encode64",
+    "gray_decode32", "gray_decode64", "parity32", "parity64"
+};
+
+static void run(const arrays_t *a, int routine) {
+    switch (routine) {
+    case ROUTINE_REVERSE32:
+        bit_reverse32_batch(a->src32, a->count, a->dst32);
+        break;
+    case ROUTINE_REVERSE64:
+        bit_reverse64_batch(a->src64, a->count, a->dst64);
+        break;
+    case ROUTINE_GRAY_ENCODE32:
+        gray_encode32_batch(a->src32, a->count, a->dst32);
+        break;
+    case ROUTINE_GRAY_ENCODE64:
+        gray_encode64_batch(a->src64, a->count, a->dst64);
+        break;
+    case ROUTINE_GRAY_DECODE32:
+        gray_decode32_batch(a->src32, a->count, a->dst32);
+        break;
+    case ROUTINE_GRAY_DECODE64:
+        gray_decode64_batch(a->src64, a->count, a->dst64);
+        break;
+    case ROUTINE_PARITY32:
+        bit_parity32_batch(a->src32, a->count, a->bits);
+        break;
+    default:
+        bit_parity64_batch(a->src64, a->count, a->bits);
+        break;
+    }
+}
+
+// The output of the last run against the inline functions.
+static int verify(const arrays_t *a, int routine) {
+    for (size_t idx = 0; idx < a->count; ++idx) {
+        uint32_t x = a->src32[idx];
+        uint64_t y = a->src64[idx];
+        uint32_t bit = a->bits[idx / 64] >> (idx % 64) & 1;
+        int ok;
+        switch (routine) {
+        case ROUTINE_REVERSE32:
+            ok = a->dst32[idx] == bit_reverse32(x)
+                && bit_reverse32(a->dst32[idx]) == x;
+            break;
+        case ROUTINE_REVERSE64:
+            ok = a->dst64[idx] == bit_reverse64(y)
+                && bit_reverse64(a->dst64[idx]) == y;
+            break;
+        case ROUTINE_GRAY_ENCODE32:
+            ok = a->dst32[idx] == gray_encode32(x);
+            break;
+        case ROUTINE_GRAY_ENCODE64:
+            ok = a->dst64[idx] == gray_encode64(y);
+            break;
+        case ROUTINE_GRAY_DECODE32:
+            ok = gray_encode32(a->dst32[idx]) == x;
+            break;
+        case ROUTINE_GRAY_DECODE64:
+            ok = gray_encode64(a->dst64[idx]) == y;
+            break;
+        case ROUTINE_PARITY32:
+            ok = bit == (uint32_t)(__builtin_popcount(x) & 1);
+            break;
+        default:
+            ok = bit == (uint32_t)(__builtin_popcountll(y) & 1);
+            break;
+        }
+        if (!ok)
+            return -1;
+    }
+
+    // The bits past the last element are 0.
+    if (0 != a->count % 64 && 0 != a->bits[a->count / 64] >> (a->count % 64)
+            && (ROUTINE_PARITY32 == routine || ROUTINE_PARITY64 == routine))
+        return -1;
+
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    // Usage: bit_transform_bench [elements]
+    size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 1 << 22;
+    size_t bitWords = (count + 63) / 64;
+
+    arrays_t a = { .count = count };
+    a.src32 = malloc(count * sizeof(uint32_t));
+    a.dst32 = malloc(count * sizeof(uint32_t));
+    a.src64 = malloc(count * sizeof(uint64_t));
+    a.dst64 = malloc(count * sizeof(uint64_t));
+    a.bits = malloc((bitWords + 1) * sizeof(uint64_t));
+    if (NULL == a.src32 || NULL == a.dst32 || NULL == a.src64
+            || NULL == a.dst64 || NULL == a.bits) {
+        fprintf(stderr, "Cannot allocate %zu elements\n", count);
+        return 1;
+    }
+
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    for (size_t idx = 0; idx < count; ++idx) {
+        a.src64[idx] = xorshift64(&state);
+        a.src32[idx] = (uint32_t)(a.src64[idx] >> 16);
+    }
+    // Touch the outputs once, page faults are not part of the measurement.
+    memset(a.dst32, 0, count * sizeof(uint32_t));
+    memset(a.dst64, 0, count * sizeof(uint64_t));
+    memset(a.bits, 0xFF, (bitWords + 1) * sizeof(uint64_t));
+
+    const char *defaultKernel = bit_transform_kernel();
+    printf("%zu elements, default kernel: %s, GB/s of input\n", count,
+            defaultKernel);
+    printf("%-14s", "routine");
+    for (size_t k = 0; k < KERNEL_NUM; ++k)
+        printf(" %10s", kernels[k]);
+    printf("\n");
+
+    for (int routine = 0; routine < ROUTINE_NUM; ++routine) {
+        size_t bytes = count * (routine % 2 ? sizeof(uint64_t)
+                : sizeof(uint32_t));
+        printf("%-14s", routineNames[routine]);
+        for (size_t k = 0; k < KERNEL_NUM; ++k) {
+            // Kernels this CPU does not support are left out.
+            if (0 != bit_transform_set_kernel(kernels[k])) {
+                printf(" %10s", "-");
+                continue;
+            }
+
+            double best = 1e30;
+            for (int rep = 0; rep < BENCH_REPEAT; ++rep) {
+                double start = now_seconds();
+                run(&a, routine);
+                double elapsed = now_seconds() - start;
+                if (elapsed < best)
+                    best = elapsed;
+            }
+            if (0 != verify(&a, routine)) {
+                fprintf(stderr, "\nMismatch: %s %s\n", kernels[k],
+                        routineNames[routine]);
+                return 1;
+            }
+            printf(" %10.2f", bytes / best * 1e-9);
+        }
+        printf("\n");
+    }
+    bit_transform_set_kernel(defaultKernel);
+
+    free(a.bits);
+    free(a.dst64);
+    free(a.src64);
+    free(a.dst32);
+    free(a.src32);
+
+    return 0;
+}
@@ -0,0 +1,311 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../count_bits/count_bits.h"
+#include "bitslice.h"
+
+// Segments scanned before their matches are counted, 2 KiB of matches.
+#define CHUNK_SEGMENTS  64
+
+#define SEGMENT_WORDS   BITSLICE_SEGMENT_WORDS
+
+#define ALWAYS_INLINE   inline __attribute__((always_inline))
+
+#ifndef BITSLICE_NO_MAIN
+#define BENCH_REPEAT    5
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t xorshift64(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// Row-at-a-time baseline of `bitslice_between`.
+static uint64_t scan_rows(const uint32_t *values, size_t rowCount,
+        uint32_t lo, uint32_t hi) {
+    uint64_t count = 0;
+    for (size_t idx = 0; idx < rowCount; ++idx)
+        count += lo <= values[idx] && values[idx] <= hi;
+
+    return count;
+}
+
+int main(int argc, char *argv[]) {
+    // Usage: bitslice [rows in Mi] [bits]
+    size_t rowCount = (argc > 1 ? strtoul(argv[1], NULL, 10) : 16) << 20;
+    unsigned bitWidth = argc > 2 ? strtoul(argv[2], NULL, 10) : 8;
+
+    uint32_t *values = malloc(rowCount * sizeof(uint32_t));
+    if (NULL == values || 0 == bitWidth || bitWidth > 32) {
+        fprintf(stderr, "Cannot allocate %zu rows of %u bits\n", rowCount,
+                bitWidth);
+        return 1;
+    }
+
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    uint32_t mask = 32 == bitWidth ? UINT32_MAX : (1U << bitWidth) - 1;
+    for (size_t idx = 0; idx < rowCount; ++idx)
+        values[idx] = (uint32_t)xorshift64(&state) & mask;
+
+    bitslice_t bs;
+    double start = now_seconds();
+    if (0 != bitslice_build(&bs, values, rowCount, bitWidth)) {
+        fprintf(stderr, "Cannot build the column\n");
+        free(values);
+        return 1;
+    }
+    printf("Build: %zu rows of %u bits, %.3f s, %.2f%% of the row size\n",
+            rowCount, bitWidth, now_seconds() - start,
+            100.0 * bitslice_size(&bs) / (rowCount * sizeof(uint32_t)));
+
+    // A quarter of the value range, starting at a third.
+    uint32_t lo = mask / 3, hi = lo + mask / 4;
+    double bestRows = 1e30, bestSliced = 1e30, bestEqual = 1e30;
+    uint64_t rowMatches = 0, slicedMatches = 0, equalMatches = 0;
+    for (int rep = 0; rep < BENCH_REPEAT; ++rep) {
+        start = now_seconds();
+        rowMatches = scan_rows(values, rowCount, lo, hi);
+        double mid = now_seconds();
+        slicedMatches = bitslice_between(&bs, lo, hi, NULL);
+        double mid2 = now_seconds();
+        equalMatches = bitslice_equal(&bs, lo, NULL);
+        double end = now_seconds();
+
+        if (mid - start < bestRows)
+            bestRows = mid - start;
+        if (mid2 - mid < bestSliced)
+            bestSliced = mid2 - mid;
+        if (end - mid2 < bestEqual)
+            bestEqual = end - mid2;
+    }
+
+    if (rowMatches != slicedMatches) {
+        fprintf(stderr, "Mismatch: rows %llu, bit-sliced %llu\n",
+                (unsigned long long)rowMatches,
+                (unsigned long long)slicedMatches);
+        bitslice_free(&bs);
+        free(values);
+        return 1;
+    }
+
+    printf("BETWEEN %u AND %u: %llu rows\n", lo, hi,
+            (unsigned long long)slicedMatches);
+    printf("row scan:         %8.3f rows/ns\n", rowCount / bestRows * 1e-9);
+    printf("bit-sliced scan:  %8.3f rows/ns (kernel: %s)\n",
+            rowCount / bestSliced * 1e-9, count_bits_kernel());
+    printf("= %u: %llu rows, %8.3f rows/ns\n", lo,
+            (unsigned long long)equalMatches, rowCount / bestEqual * 1e-9);
+
+    bitslice_free(&bs);
+    free(values);
+
+    return 0;
+}
+#endif
+
+// The predicates of the scans, `hi` is the constant of the one-sided ones.
+enum {
+    PRED_EQUAL,         ///< `value == hi`.
+    PRED_LESS_EQUAL,    ///< `value <= hi`.
+    PRED_BETWEEN        ///< `lo <= value <= hi`.
+};
+
+static inline uint32_t max_value(unsigned bitWidth) {
+    return 32 == bitWidth ? UINT32_MAX : (1U << bitWidth) - 1;
+}
+
+int bitslice_build(bitslice_t *bs, const uint32_t *values, uint64_t rowCount,
+        unsigned bitWidth) {
+    bs->planes = NULL;
+    bs->rowCount = rowCount;
+    bs->segmentCount = (rowCount + BITSLICE_SEGMENT_ROWS - 1)
+        / BITSLICE_SEGMENT_ROWS;
+    bs->bitWidth = bitWidth;
+    if (0 == bitWidth || bitWidth > 32)
+        return -1;
+
+    // Rounded up to whole cache lines for `aligned_alloc`.
+    size_t bytes = bs->segmentCount * bitWidth * SEGMENT_WORDS
+        * sizeof(uint64_t);
+    bytes = (bytes + 63) / 64 * 64;
+    if (0 == bytes)
+        return 0;
+    bs->planes = aligned_alloc(64, bytes);
+    if (NULL == bs->planes)
+        return -1;
+    memset(bs->planes, 0, bytes);
+
+    for (uint64_t row = 0; row < rowCount; ++row) {
+        uint64_t *planes = bs->planes
+            + row / BITSLICE_SEGMENT_ROWS * bitWidth * SEGMENT_WORDS
+            + row % BITSLICE_SEGMENT_ROWS / 64;
+        uint64_t bit = 1ULL << (row % 64);
+        for (unsigned plane = 0; plane < bitWidth; ++plane)
+            if (values[row] >> (bitWidth - 1 - plane) & 1)
+                planes[plane * SEGMENT_WORDS] |= bit;
+    }
+
+    return 0;
+}
+
+void bitslice_free(bitslice_t *bs) {
+    free(bs->planes);
+    bs->planes = NULL;
+    bs->rowCount = 0;
+    bs->segmentCount = 0;
+}
+
+uint32_t bitslice_get(const bitslice_t *bs, uint64_t row) {
+    const uint64_t *planes = bs->planes
+        + row / BITSLICE_SEGMENT_ROWS * bs->bitWidth * SEGMENT_WORDS
+        + row % BITSLICE_SEGMENT_ROWS / 64;
+    uint32_t value = 0;
+    for (unsigned plane = 0; plane < bs->bitWidth; ++plane)
+        value = value << 1 | (uint32_t)(planes[plane * SEGMENT_WORDS]
+                >> (row % 64) & 1);
+
+    return value;
+}
+
+/**
+ * @brief Evaluate `pred` on the 256 rows of one segment.
+ *
+ * @details A row is less than `hi` if at the first plane where they differ
+ * `hi` has a 1, `eqHi` tracks the rows equal to `hi` so far and `ltHi`
+ * those already below it (likewise `gtLo`/`eqLo` for `lo`). The bits of the
+ * constants become all-ones or all-zero masks, so there is no branch per
+ * plane other than the early exit once no row is undecided.
+ */
+static ALWAYS_INLINE void scan_segment(const uint64_t *planes,
+        unsigned bitWidth, uint32_t lo, uint32_t hi, int pred,
+        uint64_t out[SEGMENT_WORDS]) {
+    uint64_t ltHi[SEGMENT_WORDS], eqHi[SEGMENT_WORDS];
+    uint64_t gtLo[SEGMENT_WORDS], eqLo[SEGMENT_WORDS];
+    for (int w = 0; w < SEGMENT_WORDS; ++w) {
+        ltHi[w] = gtLo[w] = 0;
+        eqHi[w] = eqLo[w] = ~0ULL;
+    }
+
+    for (unsigned plane = 0; plane < bitWidth; ++plane) {
+        const uint64_t *v = planes + plane * SEGMENT_WORDS;
+        unsigned shift = bitWidth - 1 - plane;
+        uint64_t hiBit = 0 - (uint64_t)(hi >> shift & 1);
+        uint64_t loBit = 0 - (uint64_t)(lo >> shift & 1);
+
+        uint64_t undecided = 0;
+        for (int w = 0; w < SEGMENT_WORDS; ++w) {
+            if (PRED_EQUAL != pred)
+                ltHi[w] |= eqHi[w] & ~v[w] & hiBit;
+            eqHi[w] &= ~(v[w] ^ hiBit);
+            undecided |= eqHi[w];
+            if (PRED_BETWEEN == pred) {
+                gtLo[w] |= eqLo[w] & v[w] & ~loBit;
+                eqLo[w] &= ~(v[w] ^ loBit);
+                undecided |= eqLo[w];
+            }
+        }
+        if (0 == undecided)
+            break;
+    }
+
+    for (int w = 0; w < SEGMENT_WORDS; ++w) {
+        if (PRED_EQUAL == pred)
+            out[w] = eqHi[w];
+        else if (PRED_LESS_EQUAL == pred)
+            out[w] = ltHi[w] | eqHi[w];
+        else
+            out[w] = (ltHi[w] | eqHi[w]) & (gtLo[w] | eqLo[w]);
+    }
+}
+
+/**
+ * @brief Scan every segment and count the matches, chunk by chunk.
+ *
+ * @details Without `matches` the segments go to a small buffer that stays
+ * in L1 and is counted by the bulk popcount before it is overwritten.
+ */
+static ALWAYS_INLINE uint64_t scan(const bitslice_t *bs, uint32_t lo,
+        uint32_t hi, int pred, uint64_t *matches) {
+    uint64_t chunk[CHUNK_SEGMENTS * SEGMENT_WORDS];
+    uint64_t count = 0;
+
+    for (size_t first = 0; first < bs->segmentCount; first += CHUNK_SEGMENTS) {
+        size_t last = bs->segmentCount - first < CHUNK_SEGMENTS
+            ? bs->segmentCount : first + CHUNK_SEGMENTS;
+        uint64_t *out = NULL != matches
+            ? matches + first * SEGMENT_WORDS : chunk;
+
+        for (size_t segment = first; segment < last; ++segment)
+            scan_segment(bs->planes + segment * bs->bitWidth * SEGMENT_WORDS,
+                    bs->bitWidth, lo, hi, pred,
+                    out + (segment - first) * SEGMENT_WORDS);
+
+        // The padding rows of the last segment are 0 and may match.
+        if (last == bs->segmentCount) {
+            size_t rows = bs->rowCount - first * BITSLICE_SEGMENT_ROWS;
+            for (size_t word = rows / 64;
+                    word < (last - first) * SEGMENT_WORDS; ++word)
+                out[word] &= word == rows / 64
+                    ? (1ULL << (rows % 64)) - 1 : 0;
+        }
+
+        count += count_bits_buffer(out,
+                (last - first) * SEGMENT_WORDS * sizeof(uint64_t));
+    }
+
+    return count;
+}
+
+// No row matches.
+static uint64_t scan_none(const bitslice_t *bs, uint64_t *matches) {
+    if (NULL != matches)
+        memset(matches, 0, bitslice_match_words(bs) * sizeof(uint64_t));
+
+    return 0;
+}
+
+uint64_t bitslice_less(const bitslice_t *bs, uint32_t constant,
+        uint64_t *matches) {
+    if (0 == constant)
+        return scan_none(bs, matches);
+
+    // `value < constant` is `value <= constant - 1`, within the value range.
+    uint32_t hi = constant - 1 < max_value(bs->bitWidth)
+        ? constant - 1 : max_value(bs->bitWidth);
+    return scan(bs, 0, hi, PRED_LESS_EQUAL, matches);
+}
+
+uint64_t bitslice_equal(const bitslice_t *bs, uint32_t constant,
+        uint64_t *matches) {
+    if (constant > max_value(bs->bitWidth))
+        return scan_none(bs, matches);
+
+    return scan(bs, constant, constant, PRED_EQUAL, matches);
+}
+
+uint64_t bitslice_between(const bitslice_t *bs, uint32_t lo, uint32_t hi,
+        uint64_t *matches) {
+    if (hi > max_value(bs->bitWidth))
+        hi = max_value(bs->bitWidth);
+    if (lo > hi)
+        return scan_none(bs, matches);
+    if (0 == lo)
+        return scan(bs, 0, hi, PRED_LESS_EQUAL, matches);
+
+    return scan(bs, lo, hi, PRED_BETWEEN, matches);
+}
+
+size_t bitslice_size(const bitslice_t *bs) {
+    return (bs->segmentCount * bs->bitWidth * SEGMENT_WORDS * sizeof(uint64_t)
+            + 63) / 64 * 64;
+}
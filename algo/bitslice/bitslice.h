@@ -0,0 +1,95 @@
+#ifndef BITSLICE_H
+#define BITSLICE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Rows per segment, the unit every scan works on (four 64-bit words).
+#define BITSLICE_SEGMENT_ROWS   256
+#define BITSLICE_SEGMENT_WORDS  (BITSLICE_SEGMENT_ROWS / 64)
+
+/**
+ * @brief An integer column in vertical (bit-sliced) layout.
+ *
+ * @details The rows are split into segments of 256. A segment stores one
+ * 256-bit plane per bit position of the values, most significant first, and
+ * the planes of a segment are contiguous. Bit `r % 256` of plane `b` of
+ * segment `r / 256` is bit `bitWidth - 1 - b` of row `r`.
+ */
+typedef struct {
+    uint64_t        *planes;        ///< `segmentCount * bitWidth` planes.
+    uint64_t        rowCount;
+    size_t          segmentCount;
+    unsigned        bitWidth;       ///< 1 to 32.
+} bitslice_t;
+
+/**
+ * @brief Transpose `rowCount` values into a new column.
+ *
+ * @param[out]  bs              The column to initialize.
+ * @param[in]   values          The rows, only their low `bitWidth` bits are
+ * stored.
+ * @param[in]   rowCount        The number of rows.
+ * @param[in]   bitWidth        The bits per value, 1 to 32.
+ *
+ * @return 0 on success, -1 if `bitWidth` is out of range or memory could not
+ * be allocated.
+ */
+int bitslice_build(bitslice_t *bs, const uint32_t *values, uint64_t rowCount,
+        unsigned bitWidth);
+
+/**
+ * @brief Release the memory of the column.
+ */
+void bitslice_free(bitslice_t *bs);
+
+/**
+ * @brief The value of row `row`, gathered from the planes.
+ */
+uint32_t bitslice_get(const bitslice_t *bs, uint64_t row);
+
+/**
+ * @brief The number of words of a match bitmap, a multiple of
+ * `BITSLICE_SEGMENT_WORDS`.
+ */
+static inline size_t bitslice_match_words(const bitslice_t *bs) {
+    return bs->segmentCount * BITSLICE_SEGMENT_WORDS;
+}
+
+/**
+ * @brief Scan for the rows with `value < constant`, `value == constant` or
+ * `lo <= value <= hi`.
+ *
+ * @details A segment is compared plane by plane from the most significant
+ * bit with word-wide logic, i.e. 256 rows per step, and stops as soon as
+ * every row is decided. The matches are counted with `count_bits_buffer`
+ * every 64 segments, while they are still in L1.
+ *
+ * @param[in]   bs              The column.
+ * @param[out]  matches         NULL to only count, otherwise
+ * `bitslice_match_words(bs)` words receiving bit `r` for every matching row
+ * `r`, bits past `rowCount` are 0.
+ *
+ * @return The number of matching rows.
+ */
+uint64_t bitslice_less(const bitslice_t *bs, uint32_t constant,
+        uint64_t *matches);
+uint64_t bitslice_equal(const bitslice_t *bs, uint32_t constant,
+        uint64_t *matches);
+uint64_t bitslice_between(const bitslice_t *bs, uint32_t lo, uint32_t hi,
+        uint64_t *matches);
+
+/**
+ * @brief The heap memory used by the column in bytes.
+ */
+size_t bitslice_size(const bitslice_t *bs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BITSLICE_H
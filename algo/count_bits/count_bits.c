@@ -1,15 +1,52 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
-uint32_t count_bit_one(uint32_t target);
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define COUNT_BITS_X86
+#define COUNT_BITS_TARGET(isa)  __attribute__((target(isa)))
+#else
+#define COUNT_BITS_TARGET(isa)
+#endif
 
+#include "count_bits.h"
+#include "count_bits_perf.h"
+
+// The body of the bulk routines starts at this alignment (in bytes) of the
+// first buffer, so that its loads never split a cache line.
+#define COUNT_BITS_ALIGN    64
+
+// Environment variable forcing a kernel by name, e.g. `COUNT_BITS_KERNEL=avx2`.
+#define COUNT_BITS_ENV      "COUNT_BITS_KERNEL"
+
+#define ALWAYS_INLINE       inline __attribute__((always_inline))
+
+#ifndef COUNT_BITS_NO_MAIN
 int main(int argc, char *argv[]) {
     printf("Count 0: %d\n", count_bit_one(0));
     printf("Count 1: %d\n", count_bit_one(1));
     printf("Count 0x952D: %d\n", count_bit_one(0x952D));
 
+    // 100 bytes of 0xFF starting at an odd address, exercises head and tail.
+    uint8_t buffer[128];
+    memset(buffer, 0xFF, sizeof(buffer));
+    printf("Count 100 bytes of 0xFF: %llu (kernel: %s)\n",
+            (unsigned long long)count_bits_buffer(buffer + 3, 100),
+            count_bits_kernel());
+
+    // 0xFF.. against 0x0F.. gives 4 common and 4 different bits per byte.
+    uint8_t other[128];
+    memset(other, 0x0F, sizeof(other));
+    printf("AND: %llu, XOR: %llu, Jaccard: %.2f\n",
+            (unsigned long long)count_bits_and(buffer, other, 100),
+            (unsigned long long)count_bits_xor(buffer, other, 100),
+            count_bits_jaccard(buffer, other, 100));
+
     return 0;
 }
+#endif
 
 uint32_t count_bit_one(uint32_t target) {
     uint32_t count = 0;
@@ -20,3 +57,1718 @@ uint32_t count_bit_one(uint32_t target) {
 
     return count;
 }
+
+// The bitwise operation applied to the two inputs before counting. The first
+// input alone is `OP_FIRST`, used by `count_bits_buffer`.
+enum {
+    OP_FIRST,
+    OP_AND,
+    OP_OR,
+    OP_XOR,
+    OP_ANDNOT,
+    OP_NUM
+};
+
+// Unaligned, aliasing-safe 64-bit load, compiles to a single `mov`.
+static inline uint64_t load64(const uint8_t *bytes) {
+    uint64_t word;
+    memcpy(&word, bytes, sizeof(word));
+    return word;
+}
+
+// `op` is a compile-time constant in every kernel, the switch folds away.
+static ALWAYS_INLINE uint64_t combine64(uint64_t a, uint64_t b, int op) {
+    switch (op) {
+    case OP_AND:    return a & b;
+    case OP_OR:     return a | b;
+    case OP_XOR:    return a ^ b;
+    case OP_ANDNOT: return a & ~b;
+    default:        return a;
+    }
+}
+
+// Portable SWAR popcount of a 64-bit word, independent of the set bits.
+static inline uint64_t popcount64(uint64_t x) {
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (x * 0x0101010101010101ULL) >> 56;
+}
+
+// Carry-save adder: adds three bit vectors into a sum (low) and carry (high).
+static inline void csa64(uint64_t *high, uint64_t *low,
+        uint64_t a, uint64_t b, uint64_t c) {
+    uint64_t u = a ^ b;
+    *high = (a & b) | (u & c);
+    *low = u ^ c;
+}
+
+// Reference kernel: `count_bit_one` on both halves of every word.
+static ALWAYS_INLINE uint64_t kernighan_op(const uint8_t *a, const uint8_t *b,
+        size_t wordCount, int op) {
+    uint64_t total = 0;
+    for (size_t idx = 0; idx < wordCount; ++idx) {
+        uint64_t word = combine64(load64(a + idx * 8), load64(b + idx * 8), op);
+        total += count_bit_one((uint32_t)word)
+            + count_bit_one((uint32_t)(word >> 32));
+    }
+
+    return total;
+}
+
+/**
+ * @brief Harley-Seal popcount over 64-bit words.
+ *
+ * @details Sixteen words are folded into the `ones`, `twos`, `fours` and
+ * `eights` accumulators by a tree of carry-save adders, so only the resulting
+ * `sixteens` word has to be popcounted per iteration.
+ */
+static ALWAYS_INLINE uint64_t scalar_op(const uint8_t *a, const uint8_t *b,
+        size_t wordCount, int op) {
+    uint64_t total = 0;
+    uint64_t ones = 0, twos = 0, fours = 0, eights = 0, sixteens;
+    uint64_t twosA, twosB, foursA, foursB, eightsA, eightsB;
+
+#define W(i)    combine64(load64(a + (idx + (i)) * 8), \
+        load64(b + (idx + (i)) * 8), op)
+    size_t idx = 0;
+    for (; idx + 16 <= wordCount; idx += 16) {
+        csa64(&twosA, &ones, ones, W(0), W(1));
+        csa64(&twosB, &ones, ones, W(2), W(3));
+        csa64(&foursA, &twos, twos, twosA, twosB);
+        csa64(&twosA, &ones, ones, W(4), W(5));
+        csa64(&twosB, &ones, ones, W(6), W(7));
+        csa64(&foursB, &twos, twos, twosA, twosB);
+        csa64(&eightsA, &fours, fours, foursA, foursB);
+        csa64(&twosA, &ones, ones, W(8), W(9));
+        csa64(&twosB, &ones, ones, W(10), W(11));
+        csa64(&foursA, &twos, twos, twosA, twosB);
+        csa64(&twosA, &ones, ones, W(12), W(13));
+        csa64(&twosB, &ones, ones, W(14), W(15));
+        csa64(&foursB, &twos, twos, twosA, twosB);
+        csa64(&eightsB, &fours, fours, foursA, foursB);
+        csa64(&sixteens, &eights, eights, eightsA, eightsB);
+
+        total += popcount64(sixteens);
+    }
+
+    total = 16 * total + 8 * popcount64(eights) + 4 * popcount64(fours)
+        + 2 * popcount64(twos) + popcount64(ones);
+
+    for (; idx < wordCount; ++idx)
+        total += popcount64(W(0));
+#undef W
+
+    return total;
+}
+
+#ifdef COUNT_BITS_X86
+// Hardware `POPCNT`, four independent accumulators to hide its latency.
+COUNT_BITS_TARGET("popcnt")
+static ALWAYS_INLINE uint64_t popcnt_op(const uint8_t *a, const uint8_t *b,
+        size_t wordCount, int op) {
+    uint64_t c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+
+#define W(i)    combine64(load64(a + (idx + (i)) * 8), \
+        load64(b + (idx + (i)) * 8), op)
+    size_t idx = 0;
+    for (; idx + 4 <= wordCount; idx += 4) {
+        c0 += __builtin_popcountll(W(0));
+        c1 += __builtin_popcountll(W(1));
+        c2 += __builtin_popcountll(W(2));
+        c3 += __builtin_popcountll(W(3));
+    }
+    for (; idx < wordCount; ++idx)
+        c0 += __builtin_popcountll(W(0));
+#undef W
+
+    return c0 + c1 + c2 + c3;
+}
+
+COUNT_BITS_TARGET("avx2")
+static ALWAYS_INLINE __m256i combine256(__m256i a, __m256i b, int op) {
+    switch (op) {
+    case OP_AND:    return _mm256_and_si256(a, b);
+    case OP_OR:     return _mm256_or_si256(a, b);
+    case OP_XOR:    return _mm256_xor_si256(a, b);
+    case OP_ANDNOT: return _mm256_andnot_si256(b, a);
+    default:        return a;
+    }
+}
+
+// Popcount of every 64-bit lane, using a `pshufb` nibble lookup table.
+COUNT_BITS_TARGET("avx2")
+static inline __m256i popcount256(__m256i v) {
+    const __m256i lookup = _mm256_setr_epi8(
+            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i lowMask = _mm256_set1_epi8(0x0F);
+    __m256i lo = _mm256_and_si256(v, lowMask);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), lowMask);
+    __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo),
+            _mm256_shuffle_epi8(lookup, hi));
+    return _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+}
+
+COUNT_BITS_TARGET("avx2")
+static inline void csa256(__m256i *high, __m256i *low,
+        __m256i a, __m256i b, __m256i c) {
+    __m256i u = _mm256_xor_si256(a, b);
+    *high = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(u, c));
+    *low = _mm256_xor_si256(u, c);
+}
+
+COUNT_BITS_TARGET("avx2")
+static inline uint64_t sum256(__m256i v) {
+    return (uint64_t)_mm256_extract_epi64(v, 0)
+        + (uint64_t)_mm256_extract_epi64(v, 1)
+        + (uint64_t)_mm256_extract_epi64(v, 2)
+        + (uint64_t)_mm256_extract_epi64(v, 3);
+}
+
+/**
+ * @brief Harley-Seal popcount over 256-bit AVX2 lanes.
+ *
+ * @details Same adder tree as `scalar_op`, but on 32-byte vectors. The words
+ * after the last full vector are counted with `popcount64`.
+ */
+COUNT_BITS_TARGET("avx2")
+static ALWAYS_INLINE uint64_t avx2_op(const uint8_t *a, const uint8_t *b,
+        size_t wordCount, int op) {
+    const __m256i *va = (const __m256i *)a, *vb = (const __m256i *)b;
+    size_t vecCount = wordCount / 4;
+    __m256i total = _mm256_setzero_si256();
+    __m256i ones = _mm256_setzero_si256(), twos = _mm256_setzero_si256();
+    __m256i fours = _mm256_setzero_si256(), eights = _mm256_setzero_si256();
+    __m256i sixteens, twosA, twosB, foursA, foursB, eightsA, eightsB;
+
+#define V(i)    combine256(_mm256_loadu_si256(va + idx + (i)), \
+        _mm256_loadu_si256(vb + idx + (i)), op)
+    size_t idx = 0;
+    for (; idx + 16 <= vecCount; idx += 16) {
+        csa256(&twosA, &ones, ones, V(0), V(1));
+        csa256(&twosB, &ones, ones, V(2), V(3));
+        csa256(&foursA, &twos, twos, twosA, twosB);
+        csa256(&twosA, &ones, ones, V(4), V(5));
+        csa256(&twosB, &ones, ones, V(6), V(7));
+        csa256(&foursB, &twos, twos, twosA, twosB);
+        csa256(&eightsA, &fours, fours, foursA, foursB);
+        csa256(&twosA, &ones, ones, V(8), V(9));
+        csa256(&twosB, &ones, ones, V(10), V(11));
+        csa256(&foursA, &twos, twos, twosA, twosB);
+        csa256(&twosA, &ones, ones, V(12), V(13));
+        csa256(&twosB, &ones, ones, V(14), V(15));
+        csa256(&foursB, &twos, twos, twosA, twosB);
+        csa256(&eightsB, &fours, fours, foursA, foursB);
+        csa256(&sixteens, &eights, eights, eightsA, eightsB);
+
+        total = _mm256_add_epi64(total, popcount256(sixteens));
+    }
+
+    total = _mm256_slli_epi64(total, 4);
+    total = _mm256_add_epi64(total,
+            _mm256_slli_epi64(popcount256(eights), 3));
+    total = _mm256_add_epi64(total,
+            _mm256_slli_epi64(popcount256(fours), 2));
+    total = _mm256_add_epi64(total,
+            _mm256_slli_epi64(popcount256(twos), 1));
+    total = _mm256_add_epi64(total, popcount256(ones));
+
+    for (; idx < vecCount; ++idx)
+        total = _mm256_add_epi64(total, popcount256(V(0)));
+#undef V
+
+    uint64_t count = sum256(total);
+    for (size_t word = vecCount * 4; word < wordCount; ++word)
+        count += popcount64(combine64(load64(a + word * 8),
+                    load64(b + word * 8), op));
+
+    return count;
+}
+
+COUNT_BITS_TARGET("avx512f")
+static ALWAYS_INLINE __m512i combine512(__m512i a, __m512i b, int op) {
+    switch (op) {
+    case OP_AND:    return _mm512_and_si512(a, b);
+    case OP_OR:     return _mm512_or_si512(a, b);
+    case OP_XOR:    return _mm512_xor_si512(a, b);
+    case OP_ANDNOT: return _mm512_andnot_si512(b, a);
+    default:        return a;
+    }
+}
+
+// AVX-512 `VPOPCNTDQ`, the tail is handled with a masked load.
+COUNT_BITS_TARGET("avx512f,avx512vpopcntdq")
+static ALWAYS_INLINE uint64_t avx512_op(const uint8_t *a, const uint8_t *b,
+        size_t wordCount, int op) {
+    size_t vecCount = wordCount / 8;
+    __m512i c0 = _mm512_setzero_si512(), c1 = _mm512_setzero_si512();
+    __m512i c2 = _mm512_setzero_si512(), c3 = _mm512_setzero_si512();
+
+#define V(i)    combine512(_mm512_loadu_si512(a + (idx + (i)) * 64), \
+        _mm512_loadu_si512(b + (idx + (i)) * 64), op)
+    size_t idx = 0;
+    for (; idx + 4 <= vecCount; idx += 4) {
+        c0 = _mm512_add_epi64(c0, _mm512_popcnt_epi64(V(0)));
+        c1 = _mm512_add_epi64(c1, _mm512_popcnt_epi64(V(1)));
+        c2 = _mm512_add_epi64(c2, _mm512_popcnt_epi64(V(2)));
+        c3 = _mm512_add_epi64(c3, _mm512_popcnt_epi64(V(3)));
+    }
+    for (; idx < vecCount; ++idx)
+        c0 = _mm512_add_epi64(c0, _mm512_popcnt_epi64(V(0)));
+#undef V
+
+    __mmask8 tailMask = (__mmask8)((1U << (wordCount % 8)) - 1);
+    __m512i tail = combine512(
+            _mm512_maskz_loadu_epi64(tailMask, a + vecCount * 64),
+            _mm512_maskz_loadu_epi64(tailMask, b + vecCount * 64), op);
+    c1 = _mm512_add_epi64(c1, _mm512_popcnt_epi64(tail));
+
+    c0 = _mm512_add_epi64(_mm512_add_epi64(c0, c1), _mm512_add_epi64(c2, c3));
+    return (uint64_t)_mm512_reduce_add_epi64(c0);
+}
+#endif
+
+// Counts of `a & b` and `a | b` in one pass, used by the Jaccard index.
+static ALWAYS_INLINE void pair_words(const uint8_t *a, const uint8_t *b,
+        size_t wordCount, uint64_t *andCount, uint64_t *orCount,
+        uint64_t (*popcount)(uint64_t)) {
+    uint64_t c0 = 0, c1 = 0;
+    for (size_t idx = 0; idx < wordCount; ++idx) {
+        uint64_t wa = load64(a + idx * 8), wb = load64(b + idx * 8);
+        c0 += popcount(wa & wb);
+        c1 += popcount(wa | wb);
+    }
+    *andCount = c0;
+    *orCount = c1;
+}
+
+static uint64_t kernighan64(uint64_t word) {
+    return count_bit_one((uint32_t)word)
+        + count_bit_one((uint32_t)(word >> 32));
+}
+
+static void kernighan_pair(const uint8_t *a, const uint8_t *b,
+        size_t wordCount, uint64_t *andCount, uint64_t *orCount) {
+    pair_words(a, b, wordCount, andCount, orCount, kernighan64);
+}
+
+static void scalar_pair(const uint8_t *a, const uint8_t *b,
+        size_t wordCount, uint64_t *andCount, uint64_t *orCount) {
+    pair_words(a, b, wordCount, andCount, orCount, popcount64);
+}
+
+#ifdef COUNT_BITS_X86
+COUNT_BITS_TARGET("popcnt")
+static inline uint64_t popcnt64(uint64_t word) {
+    return __builtin_popcountll(word);
+}
+
+COUNT_BITS_TARGET("popcnt")
+static void popcnt_pair(const uint8_t *a, const uint8_t *b,
+        size_t wordCount, uint64_t *andCount, uint64_t *orCount) {
+    pair_words(a, b, wordCount, andCount, orCount, popcnt64);
+}
+
+COUNT_BITS_TARGET("avx2")
+static void avx2_pair(const uint8_t *a, const uint8_t *b,
+        size_t wordCount, uint64_t *andCount, uint64_t *orCount) {
+    size_t vecCount = wordCount / 4;
+    __m256i c0 = _mm256_setzero_si256(), c1 = _mm256_setzero_si256();
+    for (size_t idx = 0; idx < vecCount; ++idx) {
+        __m256i va = _mm256_loadu_si256((const __m256i *)a + idx);
+        __m256i vb = _mm256_loadu_si256((const __m256i *)b + idx);
+        c0 = _mm256_add_epi64(c0, popcount256(_mm256_and_si256(va, vb)));
+        c1 = _mm256_add_epi64(c1, popcount256(_mm256_or_si256(va, vb)));
+    }
+
+    uint64_t tailAnd, tailOr;
+    pair_words(a + vecCount * 32, b + vecCount * 32, wordCount % 4,
+            &tailAnd, &tailOr, popcount64);
+    *andCount = sum256(c0) + tailAnd;
+    *orCount = sum256(c1) + tailOr;
+}
+
+COUNT_BITS_TARGET("avx512f,avx512vpopcntdq")
+static void avx512_pair(const uint8_t *a, const uint8_t *b,
+        size_t wordCount, uint64_t *andCount, uint64_t *orCount) {
+    size_t vecCount = (wordCount + 7) / 8;
+    __m512i c0 = _mm512_setzero_si512(), c1 = _mm512_setzero_si512();
+    for (size_t idx = 0; idx < vecCount; ++idx) {
+        // The last vector is partial unless `wordCount % 8 == 0`.
+        __mmask8 mask = idx + 1 < vecCount || 0 == wordCount % 8
+            ? 0xFF : (__mmask8)((1U << (wordCount % 8)) - 1);
+        __m512i va = _mm512_maskz_loadu_epi64(mask, a + idx * 64);
+        __m512i vb = _mm512_maskz_loadu_epi64(mask, b + idx * 64);
+        c0 = _mm512_add_epi64(c0,
+                _mm512_popcnt_epi64(_mm512_and_si512(va, vb)));
+        c1 = _mm512_add_epi64(c1,
+                _mm512_popcnt_epi64(_mm512_or_si512(va, vb)));
+    }
+    *andCount = (uint64_t)_mm512_reduce_add_epi64(c0);
+    *orCount = (uint64_t)_mm512_reduce_add_epi64(c1);
+}
+#endif
+
+/*
+ * Positional popcount: for every bit position of the words, how many words
+ * have that bit set. Sixteen words go through the same carry-save adder tree
+ * as `scalar_op`, only the `sixteens` word is spread over per-position byte
+ * counters, 8 positions per add. The byte counters are flushed into the
+ * 64-bit `counts` before they can overflow. Bit `p` of a wider vector is
+ * position `p % 64`, which is a valid position for every lane width.
+ */
+
+// Byte counters are flushed after this many adder tree iterations.
+#define POSITIONAL_FLUSH    255
+
+// `counts[(i * 8 + bit) % 64] += weight * bytes[i]`.
+static void add_byte_counters(uint64_t counts[64], const uint8_t *bytes,
+        size_t byteCount, unsigned bit, uint64_t weight) {
+    for (size_t idx = 0; idx < byteCount; ++idx)
+        counts[(idx * 8 + bit) % 64] += weight * bytes[idx];
+}
+
+// `counts[p % 64] += weight * bit p` for every bit of `words`.
+static void add_bits(uint64_t counts[64], const uint64_t *words,
+        size_t wordCount, uint64_t weight) {
+    for (size_t idx = 0; idx < wordCount; ++idx)
+        for (unsigned pos = 0; pos < 64; ++pos)
+            counts[pos] += weight * ((words[idx] >> pos) & 1);
+}
+
+static void scalar_positional(const uint8_t *bytes, size_t wordCount,
+        uint64_t counts[64]) {
+    uint64_t ones = 0, twos = 0, fours = 0, eights = 0, sixteens;
+    uint64_t twosA, twosB, foursA, foursB, eightsA, eightsB;
+    uint64_t acc[8] = { 0 };
+    unsigned pending = 0;
+
+#define W(i)    load64(bytes + (idx + (i)) * 8)
+    size_t idx = 0;
+    for (; idx + 16 <= wordCount; idx += 16) {
+        csa64(&twosA, &ones, ones, W(0), W(1));
+        csa64(&twosB, &ones, ones, W(2), W(3));
+        csa64(&foursA, &twos, twos, twosA, twosB);
+        csa64(&twosA, &ones, ones, W(4), W(5));
+        csa64(&twosB, &ones, ones, W(6), W(7));
+        csa64(&foursB, &twos, twos, twosA, twosB);
+        csa64(&eightsA, &fours, fours, foursA, foursB);
+        csa64(&twosA, &ones, ones, W(8), W(9));
+        csa64(&twosB, &ones, ones, W(10), W(11));
+        csa64(&foursA, &twos, twos, twosA, twosB);
+        csa64(&twosA, &ones, ones, W(12), W(13));
+        csa64(&twosB, &ones, ones, W(14), W(15));
+        csa64(&foursB, &twos, twos, twosA, twosB);
+        csa64(&eightsB, &fours, fours, foursA, foursB);
+        csa64(&sixteens, &eights, eights, eightsA, eightsB);
+
+        for (unsigned bit = 0; bit < 8; ++bit)
+            acc[bit] += (sixteens >> bit) & 0x0101010101010101ULL;
+
+        if (POSITIONAL_FLUSH == ++pending || idx + 32 > wordCount) {
+            for (unsigned bit = 0; bit < 8; ++bit) {
+                uint8_t accBytes[8];
+                memcpy(accBytes, &acc[bit], sizeof(accBytes));
+                add_byte_counters(counts, accBytes, 8, bit, 16);
+                acc[bit] = 0;
+            }
+            pending = 0;
+        }
+    }
+#undef W
+
+    const uint64_t partial[4] = { eights, fours, twos, ones };
+    for (unsigned level = 0; level < 4; ++level)
+        add_bits(counts, &partial[level], 1, 8 >> level);
+
+    for (; idx < wordCount; ++idx) {
+        uint64_t word = load64(bytes + idx * 8);
+        add_bits(counts, &word, 1, 1);
+    }
+}
+
+#ifdef COUNT_BITS_X86
+COUNT_BITS_TARGET("avx2")
+static void avx2_positional(const uint8_t *bytes, size_t wordCount,
+        uint64_t counts[64]) {
+    const __m256i *v = (const __m256i *)bytes;
+    const __m256i lowBit = _mm256_set1_epi8(1);
+    size_t vecCount = wordCount / 4;
+    __m256i ones = _mm256_setzero_si256(), twos = _mm256_setzero_si256();
+    __m256i fours = _mm256_setzero_si256(), eights = _mm256_setzero_si256();
+    __m256i sixteens, twosA, twosB, foursA, foursB, eightsA, eightsB;
+    __m256i acc[8];
+    unsigned pending = 0;
+
+    for (unsigned bit = 0; bit < 8; ++bit)
+        acc[bit] = _mm256_setzero_si256();
+
+#define V(i)    _mm256_loadu_si256(v + idx + (i))
+    size_t idx = 0;
+    for (; idx + 16 <= vecCount; idx += 16) {
+        csa256(&twosA, &ones, ones, V(0), V(1));
+        csa256(&twosB, &ones, ones, V(2), V(3));
+        csa256(&foursA, &twos, twos, twosA, twosB);
+        csa256(&twosA, &ones, ones, V(4), V(5));
+        csa256(&twosB, &ones, ones, V(6), V(7));
+        csa256(&foursB, &twos, twos, twosA, twosB);
+        csa256(&eightsA, &fours, fours, foursA, foursB);
+        csa256(&twosA, &ones, ones, V(8), V(9));
+        csa256(&twosB, &ones, ones, V(10), V(11));
+        csa256(&foursA, &twos, twos, twosA, twosB);
+        csa256(&twosA, &ones, ones, V(12), V(13));
+        csa256(&twosB, &ones, ones, V(14), V(15));
+        csa256(&foursB, &twos, twos, twosA, twosB);
+        csa256(&eightsB, &fours, fours, foursA, foursB);
+        csa256(&sixteens, &eights, eights, eightsA, eightsB);
+
+        // Bit `bit` of every byte, `psrlw` does not leak across bytes after
+        // the mask.
+        for (unsigned bit = 0; bit < 8; ++bit)
+            acc[bit] = _mm256_add_epi8(acc[bit], _mm256_and_si256(
+                        _mm256_srli_epi16(sixteens, bit), lowBit));
+
+        if (POSITIONAL_FLUSH == ++pending || idx + 32 > vecCount) {
+            for (unsigned bit = 0; bit < 8; ++bit) {
+                uint8_t accBytes[32];
+                _mm256_storeu_si256((__m256i *)accBytes, acc[bit]);
+                add_byte_counters(counts, accBytes, 32, bit, 16);
+                acc[bit] = _mm256_setzero_si256();
+            }
+            pending = 0;
+        }
+    }
+#undef V
+
+    const __m256i partial[4] = { eights, fours, twos, ones };
+    for (unsigned level = 0; level < 4; ++level) {
+        uint64_t words[4];
+        _mm256_storeu_si256((__m256i *)words, partial[level]);
+        add_bits(counts, words, 4, 8 >> level);
+    }
+
+    scalar_positional(bytes + idx * 32, wordCount - idx * 4, counts);
+}
+
+// The adder tree with `vpternlogq`: 0x96 is the 3-way XOR, 0xE8 the majority.
+COUNT_BITS_TARGET("avx512f")
+static inline void csa512(__m512i *high, __m512i *low,
+        __m512i a, __m512i b, __m512i c) {
+    *high = _mm512_ternarylogic_epi64(a, b, c, 0xE8);
+    *low = _mm512_ternarylogic_epi64(a, b, c, 0x96);
+}
+
+COUNT_BITS_TARGET("avx512f,avx512bw")
+static void avx512_positional(const uint8_t *bytes, size_t wordCount,
+        uint64_t counts[64]) {
+    const __m512i lowBit = _mm512_set1_epi8(1);
+    size_t vecCount = wordCount / 8;
+    __m512i ones = _mm512_setzero_si512(), twos = _mm512_setzero_si512();
+    __m512i fours = _mm512_setzero_si512(), eights = _mm512_setzero_si512();
+    __m512i sixteens, twosA, twosB, foursA, foursB, eightsA, eightsB;
+    __m512i acc[8];
+    unsigned pending = 0;
+
+    for (unsigned bit = 0; bit < 8; ++bit)
+        acc[bit] = _mm512_setzero_si512();
+
+#define V(i)    _mm512_loadu_si512(bytes + (idx + (i)) * 64)
+    size_t idx = 0;
+    for (; idx + 16 <= vecCount; idx += 16) {
+        csa512(&twosA, &ones, ones, V(0), V(1));
+        csa512(&twosB, &ones, ones, V(2), V(3));
+        csa512(&foursA, &twos, twos, twosA, twosB);
+        csa512(&twosA, &ones, ones, V(4), V(5));
+        csa512(&twosB, &ones, ones, V(6), V(7));
+        csa512(&foursB, &twos, twos, twosA, twosB);
+        csa512(&eightsA, &fours, fours, foursA, foursB);
+        csa512(&twosA, &ones, ones, V(8), V(9));
+        csa512(&twosB, &ones, ones, V(10), V(11));
+        csa512(&foursA, &twos, twos, twosA, twosB);
+        csa512(&twosA, &ones, ones, V(12), V(13));
+        csa512(&twosB, &ones, ones, V(14), V(15));
+        csa512(&foursB, &twos, twos, twosA, twosB);
+        csa512(&eightsB, &fours, fours, foursA, foursB);
+        csa512(&sixteens, &eights, eights, eightsA, eightsB);
+
+        for (unsigned bit = 0; bit < 8; ++bit)
+            acc[bit] = _mm512_add_epi8(acc[bit], _mm512_and_si512(
+                        _mm512_srli_epi16(sixteens, bit), lowBit));
+
+        if (POSITIONAL_FLUSH == ++pending || idx + 32 > vecCount) {
+            for (unsigned bit = 0; bit < 8; ++bit) {
+                uint8_t accBytes[64];
+                _mm512_storeu_si512(accBytes, acc[bit]);
+                add_byte_counters(counts, accBytes, 64, bit, 16);
+                acc[bit] = _mm512_setzero_si512();
+            }
+            pending = 0;
+        }
+    }
+#undef V
+
+    const __m512i partial[4] = { eights, fours, twos, ones };
+    for (unsigned level = 0; level < 4; ++level) {
+        uint64_t words[8];
+        _mm512_storeu_si512(words, partial[level]);
+        add_bits(counts, words, 8, 8 >> level);
+    }
+
+    scalar_positional(bytes + idx * 64, wordCount - idx * 8, counts);
+}
+#endif
+
+/*
+ * Decoding: the positions of the set bits of `wordCount` words, `base` plus
+ * the bit index, are written to `positions` and their number is returned. A
+ * kernel may write up to `DECODE_SLACK` entries past its result, the caller
+ * leaves that much room (checked with the popcount of the words).
+ */
+
+#define DECODE_SLACK    16
+
+static size_t scalar_decode(const uint8_t *bytes, size_t wordCount,
+        uint32_t base, uint32_t *positions) {
+    uint32_t *out = positions;
+    for (size_t idx = 0; idx < wordCount; ++idx, base += 64) {
+        uint64_t word = load64(bytes + idx * 8);
+        while (0 != word) {
+            *out++ = base + (uint32_t)__builtin_ctzll(word);
+            word &= word - 1;
+        }
+    }
+
+    return (size_t)(out - positions);
+}
+
+#ifdef COUNT_BITS_X86
+// The set bit indices of every byte value, one per byte, unused bytes are 0.
+static uint64_t decodeTable[256];
+
+static void decode_table_init(void) {
+    for (unsigned value = 0; value < 256; ++value) {
+        uint64_t entry = 0;
+        unsigned count = 0;
+        for (unsigned bit = 0; bit < 8; ++bit)
+            if (value >> bit & 1)
+                entry |= (uint64_t)bit << (8 * count++);
+        decodeTable[value] = entry;
+    }
+}
+
+// Eight indices per byte are widened from the table and stored, the pointer
+// moves by the popcount of the byte. There is no branch on the bits, which
+// would mispredict on sparse data.
+COUNT_BITS_TARGET("avx2,popcnt")
+static size_t avx2_decode(const uint8_t *bytes, size_t wordCount,
+        uint32_t base, uint32_t *positions) {
+    uint32_t *out = positions;
+    for (size_t idx = 0; idx < wordCount; ++idx, base += 64) {
+        uint64_t word = load64(bytes + idx * 8);
+        for (unsigned byte = 0; byte < 8; ++byte, word >>= 8) {
+            unsigned value = word & 0xFF;
+            __m256i offsets = _mm256_cvtepu8_epi32(
+                    _mm_loadl_epi64((const __m128i *)&decodeTable[value]));
+            _mm256_storeu_si256((__m256i *)out, _mm256_add_epi32(offsets,
+                        _mm256_set1_epi32((int)(base + byte * 8))));
+            out += _mm_popcnt_u32(value);
+        }
+    }
+
+    return (size_t)(out - positions);
+}
+
+// Every 16 bits of a word select lanes of `base + 0..15`, the selected lanes
+// are compressed to the front and stored as a full vector. A store is faster
+// than `vpcompressd` to memory, which is microcoded on some CPUs.
+COUNT_BITS_TARGET("avx512f,popcnt")
+static size_t avx512_decode(const uint8_t *bytes, size_t wordCount,
+        uint32_t base, uint32_t *positions) {
+    const __m512i iota = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
+            11, 12, 13, 14, 15);
+    uint32_t *out = positions;
+    for (size_t idx = 0; idx < wordCount; ++idx, base += 64) {
+        uint64_t word = load64(bytes + idx * 8);
+        for (unsigned quarter = 0; quarter < 4; ++quarter, word >>= 16) {
+            __mmask16 mask = (__mmask16)word;
+            __m512i lanes = _mm512_add_epi32(iota,
+                    _mm512_set1_epi32((int)(base + quarter * 16)));
+            _mm512_storeu_si512(out, _mm512_maskz_compress_epi32(mask, lanes));
+            out += _mm_popcnt_u32(mask);
+        }
+    }
+
+    return (size_t)(out - positions);
+}
+#endif
+
+/*
+ * Prefix popcount: `ranks[i]` is `base` plus the set bits of the blocks of
+ * `blockWords` words before block `i`, the last block may be short. The
+ * ranks are written with non-temporal stores, they are not read back soon
+ * and would only evict the bitmap from the caches. Ranks of single words get
+ * a fused loop: the popcount of a vector is scanned in registers and stored
+ * as one full cache line (or half of one). Short blocks on AVX2 are counted
+ * vector by vector with one horizontal add per block.
+ */
+
+// A rank store that bypasses the caches.
+static inline void stream_rank(uint64_t *rank, uint64_t value) {
+#if defined(COUNT_BITS_X86) && defined(__x86_64__)
+    _mm_stream_si64((long long *)rank, (long long)value);
+#else
+    *rank = value;
+#endif
+}
+
+// Blocks of up to this many words skip the adder tree of `avx2_op`.
+#define PREFIX_SMALL_WORDS  32
+
+// The general loop, one rank per block counted by `<level>_op`.
+#define COUNT_BITS_PREFIX_BLOCKS(level) \
+    for (size_t word = 0; word < wordCount; word += blockWords) { \
+        size_t n = wordCount - word < blockWords \
+            ? wordCount - word : blockWords; \
+        stream_rank(ranks++, base); \
+        base += level##_op(bytes + word * 8, bytes + word * 8, n, OP_FIRST); \
+    }
+
+static uint64_t scalar_prefix(const uint8_t *bytes, size_t wordCount,
+        size_t blockWords, uint64_t base, uint64_t *ranks) {
+    if (1 == blockWords) {
+        for (size_t word = 0; word < wordCount; ++word) {
+            stream_rank(ranks + word, base);
+            base += popcount64(load64(bytes + word * 8));
+        }
+        return base;
+    }
+
+    COUNT_BITS_PREFIX_BLOCKS(scalar);
+    return base;
+}
+
+#ifdef COUNT_BITS_X86
+COUNT_BITS_TARGET("popcnt")
+static uint64_t popcnt_prefix(const uint8_t *bytes, size_t wordCount,
+        size_t blockWords, uint64_t base, uint64_t *ranks) {
+    if (1 == blockWords) {
+        for (size_t word = 0; word < wordCount; ++word) {
+            stream_rank(ranks + word, base);
+            base += popcnt64(load64(bytes + word * 8));
+        }
+        return base;
+    }
+
+    COUNT_BITS_PREFIX_BLOCKS(popcnt);
+    return base;
+}
+
+// Exclusive scan of the four lanes, plus the carry in every lane.
+COUNT_BITS_TARGET("avx2")
+static inline __m256i scan256(__m256i counts, __m256i carry) {
+    const __m256i zero = _mm256_setzero_si256();
+    // Lanes up by one, then by one and by two lanes added in.
+    __m256i x = _mm256_blend_epi32(
+            _mm256_permute4x64_epi64(counts, _MM_SHUFFLE(2, 1, 0, 0)),
+            zero, 0x03);
+    x = _mm256_add_epi64(x, _mm256_blend_epi32(
+                _mm256_permute4x64_epi64(x, _MM_SHUFFLE(2, 1, 0, 0)),
+                zero, 0x03));
+    x = _mm256_add_epi64(x, _mm256_permute2x128_si256(x, x, 0x08));
+    return _mm256_add_epi64(x, carry);
+}
+
+// The popcount of a short block, vector by vector and one horizontal add.
+// `avx2_op` would flush its empty adder tree with four `popcount256` per
+// block.
+COUNT_BITS_TARGET("avx2,popcnt")
+static inline uint64_t avx2_block(const uint8_t *bytes, size_t n) {
+    __m256i total = _mm256_setzero_si256();
+    size_t word = 0;
+    for (; word + 4 <= n; word += 4)
+        total = _mm256_add_epi64(total, popcount256(
+                    _mm256_loadu_si256((const __m256i *)(bytes + word * 8))));
+    uint64_t count = sum256(total);
+    for (; word < n; ++word)
+        count += popcnt64(load64(bytes + word * 8));
+    return count;
+}
+
+COUNT_BITS_TARGET("avx2,popcnt")
+static uint64_t avx2_prefix(const uint8_t *bytes, size_t wordCount,
+        size_t blockWords, uint64_t base, uint64_t *ranks) {
+    if (1 != blockWords && blockWords <= PREFIX_SMALL_WORDS) {
+        for (size_t word = 0; word < wordCount; word += blockWords) {
+            size_t n = wordCount - word < blockWords
+                ? wordCount - word : blockWords;
+            stream_rank(ranks++, base);
+            base += avx2_block(bytes + word * 8, n);
+        }
+        return base;
+    }
+    if (1 != blockWords) {
+        COUNT_BITS_PREFIX_BLOCKS(avx2);
+        return base;
+    }
+
+    // Up to the alignment of the ranks for `vmovntdq`.
+    size_t word = 0;
+    for (; word < wordCount && 0 != (uintptr_t)(ranks + word) % 32; ++word) {
+        stream_rank(ranks + word, base);
+        base += popcnt64(load64(bytes + word * 8));
+    }
+
+    __m256i carry = _mm256_set1_epi64x((long long)base);
+    for (; word + 4 <= wordCount; word += 4) {
+        __m256i counts = popcount256(
+                _mm256_loadu_si256((const __m256i *)(bytes + word * 8)));
+        __m256i x = scan256(counts, carry);
+        _mm256_stream_si256((__m256i *)(ranks + word), x);
+        // The next carry is the inclusive sum of the last lane.
+        carry = _mm256_permute4x64_epi64(_mm256_add_epi64(x, counts),
+                _MM_SHUFFLE(3, 3, 3, 3));
+    }
+    base = (uint64_t)_mm256_extract_epi64(carry, 0);
+
+    for (; word < wordCount; ++word) {
+        stream_rank(ranks + word, base);
+        base += popcnt64(load64(bytes + word * 8));
+    }
+
+    return base;
+}
+
+COUNT_BITS_TARGET("avx512f,avx512vpopcntdq,popcnt")
+static uint64_t avx512_prefix(const uint8_t *bytes, size_t wordCount,
+        size_t blockWords, uint64_t base, uint64_t *ranks) {
+    if (1 != blockWords) {
+        COUNT_BITS_PREFIX_BLOCKS(avx512);
+        return base;
+    }
+
+    size_t word = 0;
+    for (; word < wordCount && 0 != (uintptr_t)(ranks + word) % 64; ++word) {
+        stream_rank(ranks + word, base);
+        base += popcnt64(load64(bytes + word * 8));
+    }
+
+    // `alignr(x, 0, 8 - k)` moves the lanes up by `k`, zeros shift in.
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i last = _mm512_set1_epi64(7);
+    __m512i carry = _mm512_set1_epi64((long long)base);
+    for (; word + 8 <= wordCount; word += 8) {
+        __m512i counts = _mm512_popcnt_epi64(
+                _mm512_loadu_si512(bytes + word * 8));
+        __m512i x = _mm512_alignr_epi64(counts, zero, 7);
+        x = _mm512_add_epi64(x, _mm512_alignr_epi64(x, zero, 7));
+        x = _mm512_add_epi64(x, _mm512_alignr_epi64(x, zero, 6));
+        x = _mm512_add_epi64(x, _mm512_alignr_epi64(x, zero, 4));
+        x = _mm512_add_epi64(x, carry);
+        _mm512_stream_si512((__m512i *)(ranks + word), x);
+        carry = _mm512_permutexvar_epi64(last, _mm512_add_epi64(x, counts));
+    }
+    base = (uint64_t)_mm_cvtsi128_si64(_mm512_castsi512_si128(carry));
+
+    for (; word < wordCount; ++word) {
+        stream_rank(ranks + word, base);
+        base += popcnt64(load64(bytes + word * 8));
+    }
+
+    return base;
+}
+#endif
+
+/*
+ * Bulk bitwise operations for the bitset classes: `dst = op(a, b)` word by
+ * word, where `OP_FIRST` writes the complement `~a`. `dst` may be `a` or `b`
+ * but must not overlap them otherwise. A shift moves every word by 1 to 63
+ * bits and fills it with the bits shifted out of its neighbour, the left
+ * shift runs from the top word down and the right shift from the bottom up,
+ * so both work in place and with `dst` a few words past (left) or before
+ * (right) `src`.
+ */
+
+// `op` is a compile-time constant, `OP_FIRST` is the complement.
+static ALWAYS_INLINE uint64_t bitwise64(uint64_t a, uint64_t b, int op) {
+    return OP_FIRST == op ? ~a : combine64(a, b, op);
+}
+
+static inline void store64(uint8_t *bytes, uint64_t word) {
+    memcpy(bytes, &word, sizeof(word));
+}
+
+static ALWAYS_INLINE void scalar_bitwise_op(uint8_t *dst, const uint8_t *a,
+        const uint8_t *b, size_t wordCount, int op) {
+    for (size_t idx = 0; idx < wordCount; ++idx)
+        store64(dst + idx * 8, bitwise64(load64(a + idx * 8),
+                    load64(b + idx * 8), op));
+}
+
+// Words `[0, end)` of a left shift, from the top down.
+static inline void shift_left_words(uint8_t *dst, const uint8_t *src,
+        size_t end, unsigned shift) {
+    for (size_t idx = end; idx-- > 1;)
+        store64(dst + idx * 8, load64(src + idx * 8) << shift
+                | load64(src + (idx - 1) * 8) >> (64 - shift));
+    if (0 != end)
+        store64(dst, load64(src) << shift);
+}
+
+// Words `[start, wordCount)` of a right shift, from the bottom up.
+static inline void shift_right_words(uint8_t *dst, const uint8_t *src,
+        size_t start, size_t wordCount, unsigned shift) {
+    for (size_t idx = start; idx + 1 < wordCount; ++idx)
+        store64(dst + idx * 8, load64(src + idx * 8) >> shift
+                | load64(src + (idx + 1) * 8) << (64 - shift));
+    if (start < wordCount)
+        store64(dst + (wordCount - 1) * 8,
+                load64(src + (wordCount - 1) * 8) >> shift);
+}
+
+static void scalar_shift(uint8_t *dst, const uint8_t *src, size_t wordCount,
+        unsigned shift, int right) {
+    if (right)
+        shift_right_words(dst, src, 0, wordCount, shift);
+    else
+        shift_left_words(dst, src, wordCount, shift);
+}
+
+// The index of the first non-zero word, `wordCount` if there is none.
+static size_t scalar_find(const uint8_t *bytes, size_t wordCount) {
+    size_t idx = 0;
+    while (idx < wordCount && 0 == load64(bytes + idx * 8))
+        ++idx;
+
+    return idx;
+}
+
+#ifdef COUNT_BITS_X86
+COUNT_BITS_TARGET("avx2")
+static ALWAYS_INLINE void avx2_bitwise_op(uint8_t *dst, const uint8_t *a,
+        const uint8_t *b, size_t wordCount, int op) {
+    const __m256i ones = _mm256_set1_epi8(-1);
+    size_t idx = 0;
+    for (; idx + 8 <= wordCount; idx += 8) {
+        __m256i a0 = _mm256_loadu_si256((const __m256i *)(a + idx * 8));
+        __m256i a1 = _mm256_loadu_si256((const __m256i *)(a + idx * 8 + 32));
+        __m256i b0 = _mm256_loadu_si256((const __m256i *)(b + idx * 8));
+        __m256i b1 = _mm256_loadu_si256((const __m256i *)(b + idx * 8 + 32));
+        _mm256_storeu_si256((__m256i *)(dst + idx * 8), OP_FIRST == op
+                ? _mm256_xor_si256(a0, ones) : combine256(a0, b0, op));
+        _mm256_storeu_si256((__m256i *)(dst + idx * 8 + 32), OP_FIRST == op
+                ? _mm256_xor_si256(a1, ones) : combine256(a1, b1, op));
+    }
+    scalar_bitwise_op(dst + idx * 8, a + idx * 8, b + idx * 8,
+            wordCount - idx, op);
+}
+
+COUNT_BITS_TARGET("avx2")
+static void avx2_shift(uint8_t *dst, const uint8_t *src, size_t wordCount,
+        unsigned shift, int right) {
+    const __m128i count = _mm_cvtsi32_si128((int)shift);
+    const __m128i carry = _mm_cvtsi32_si128((int)(64 - shift));
+    if (right) {
+        size_t idx = 0;
+        for (; idx + 5 <= wordCount; idx += 4) {
+            __m256i x = _mm256_loadu_si256((const __m256i *)(src + idx * 8));
+            __m256i next = _mm256_loadu_si256(
+                    (const __m256i *)(src + idx * 8 + 8));
+            _mm256_storeu_si256((__m256i *)(dst + idx * 8), _mm256_or_si256(
+                        _mm256_srl_epi64(x, count),
+                        _mm256_sll_epi64(next, carry)));
+        }
+        shift_right_words(dst, src, idx, wordCount, shift);
+        return;
+    }
+
+    size_t end = wordCount;
+    for (; end >= 5; end -= 4) {
+        const uint8_t *block = src + (end - 4) * 8;
+        __m256i x = _mm256_loadu_si256((const __m256i *)block);
+        __m256i prev = _mm256_loadu_si256((const __m256i *)(block - 8));
+        _mm256_storeu_si256((__m256i *)(dst + (end - 4) * 8),
+                _mm256_or_si256(_mm256_sll_epi64(x, count),
+                    _mm256_srl_epi64(prev, carry)));
+    }
+    shift_left_words(dst, src, end, shift);
+}
+
+// Four vectors are tested at once, the word is found by the scalar loop.
+COUNT_BITS_TARGET("avx2")
+static size_t avx2_find(const uint8_t *bytes, size_t wordCount) {
+    size_t idx = 0;
+    for (; idx + 16 <= wordCount; idx += 16) {
+        const __m256i *v = (const __m256i *)(bytes + idx * 8);
+        __m256i x = _mm256_or_si256(
+                _mm256_or_si256(_mm256_loadu_si256(v),
+                    _mm256_loadu_si256(v + 1)),
+                _mm256_or_si256(_mm256_loadu_si256(v + 2),
+                    _mm256_loadu_si256(v + 3)));
+        if (!_mm256_testz_si256(x, x))
+            break;
+    }
+
+    return idx + scalar_find(bytes + idx * 8, wordCount - idx);
+}
+
+COUNT_BITS_TARGET("avx512f")
+static ALWAYS_INLINE void avx512_bitwise_op(uint8_t *dst, const uint8_t *a,
+        const uint8_t *b, size_t wordCount, int op) {
+    const __m512i ones = _mm512_set1_epi64(-1);
+    size_t idx = 0;
+    for (; idx + 8 <= wordCount; idx += 8) {
+        __m512i x = _mm512_loadu_si512(a + idx * 8);
+        __m512i y = _mm512_loadu_si512(b + idx * 8);
+        _mm512_storeu_si512(dst + idx * 8, OP_FIRST == op
+                ? _mm512_xor_si512(x, ones) : combine512(x, y, op));
+    }
+
+    // The tail with masked loads and a masked store.
+    __mmask8 tailMask = (__mmask8)((1U << (wordCount - idx)) - 1);
+    __m512i x = _mm512_maskz_loadu_epi64(tailMask, a + idx * 8);
+    __m512i y = _mm512_maskz_loadu_epi64(tailMask, b + idx * 8);
+    _mm512_mask_storeu_epi64(dst + idx * 8, tailMask, OP_FIRST == op
+            ? _mm512_xor_si512(x, ones) : combine512(x, y, op));
+}
+
+COUNT_BITS_TARGET("avx512f")
+static void avx512_shift(uint8_t *dst, const uint8_t *src, size_t wordCount,
+        unsigned shift, int right) {
+    const __m128i count = _mm_cvtsi32_si128((int)shift);
+    const __m128i carry = _mm_cvtsi32_si128((int)(64 - shift));
+    if (right) {
+        size_t idx = 0;
+        for (; idx + 9 <= wordCount; idx += 8) {
+            __m512i x = _mm512_loadu_si512(src + idx * 8);
+            __m512i next = _mm512_loadu_si512(src + idx * 8 + 8);
+            _mm512_storeu_si512(dst + idx * 8, _mm512_or_si512(
+                        _mm512_srl_epi64(x, count),
+                        _mm512_sll_epi64(next, carry)));
+        }
+        shift_right_words(dst, src, idx, wordCount, shift);
+        return;
+    }
+
+    size_t end = wordCount;
+    for (; end >= 9; end -= 8) {
+        const uint8_t *block = src + (end - 8) * 8;
+        __m512i x = _mm512_loadu_si512(block);
+        __m512i prev = _mm512_loadu_si512(block - 8);
+        _mm512_storeu_si512(dst + (end - 8) * 8, _mm512_or_si512(
+                    _mm512_sll_epi64(x, count), _mm512_srl_epi64(prev, carry)));
+    }
+    shift_left_words(dst, src, end, shift);
+}
+
+COUNT_BITS_TARGET("avx512f")
+static size_t avx512_find(const uint8_t *bytes, size_t wordCount) {
+    size_t idx = 0;
+    for (; idx + 16 <= wordCount; idx += 16) {
+        __m512i x = _mm512_or_si512(_mm512_loadu_si512(bytes + idx * 8),
+                _mm512_loadu_si512(bytes + idx * 8 + 64));
+        if (0 != _mm512_test_epi64_mask(x, x))
+            break;
+    }
+
+    return idx + scalar_find(bytes + idx * 8, wordCount - idx);
+}
+#endif
+
+// A kernel counts the bits of `op(a, b)` over `wordCount` 64-bit words.
+typedef uint64_t (*count_bits_kernel_fn)(const uint8_t *, const uint8_t *,
+        size_t);
+typedef void (*count_bits_pair_fn)(const uint8_t *, const uint8_t *,
+        size_t, uint64_t *, uint64_t *);
+// A batch kernel writes the XOR-popcount of a query against `codeCount`
+// consecutive codes of `codeWords` words each.
+typedef void (*count_bits_batch_fn)(const uint8_t *, const uint8_t *,
+        size_t, size_t, uint32_t *);
+// A positional kernel adds the set bits of every position of `wordCount`
+// words to `counts[64]`.
+typedef void (*count_bits_positional_fn)(const uint8_t *, size_t,
+        uint64_t *);
+// A decode kernel writes the set bit positions of `wordCount` words.
+typedef size_t (*count_bits_decode_fn)(const uint8_t *, size_t, uint32_t,
+        uint32_t *);
+// A prefix kernel writes the ranks of `wordCount` words in blocks of
+// `blockWords` and returns `base` plus their popcount.
+typedef uint64_t (*count_bits_prefix_fn)(const uint8_t *, size_t, size_t,
+        uint64_t, uint64_t *);
+// Bitwise kernels write `op(a, b)`, shift or find the first non-zero word.
+typedef void (*count_bits_bitwise_fn)(uint8_t *, const uint8_t *,
+        const uint8_t *, size_t, int);
+typedef void (*count_bits_shift_fn)(uint8_t *, const uint8_t *, size_t,
+        unsigned, int);
+typedef size_t (*count_bits_find_fn)(const uint8_t *, size_t);
+
+// Instantiate `<level>_op` for every operation, each with a constant `op`.
+#define COUNT_BITS_OPS(level, target) \
+    target static uint64_t level##_first( \
+            const uint8_t *a, const uint8_t *b, size_t n) \
+    { return level##_op(a, b, n, OP_FIRST); } \
+    target static uint64_t level##_and( \
+            const uint8_t *a, const uint8_t *b, size_t n) \
+    { return level##_op(a, b, n, OP_AND); } \
+    target static uint64_t level##_or( \
+            const uint8_t *a, const uint8_t *b, size_t n) \
+    { return level##_op(a, b, n, OP_OR); } \
+    target static uint64_t level##_xor( \
+            const uint8_t *a, const uint8_t *b, size_t n) \
+    { return level##_op(a, b, n, OP_XOR); } \
+    target static uint64_t level##_andnot( \
+            const uint8_t *a, const uint8_t *b, size_t n) \
+    { return level##_op(a, b, n, OP_ANDNOT); }
+
+// Instantiate `<level>_batch`. The common code widths (256, 512 and 1024
+// bits) get their own loop with a constant word count, so that the inlined
+// kernel is fully unrolled and the query stays in registers.
+#define COUNT_BITS_BATCH_LOOP(level, words) \
+    for (size_t idx = 0; idx < codeCount; ++idx) \
+        distances[idx] = (uint32_t)level##_op( \
+                query, codes + idx * (words) * 8, (words), OP_XOR)
+
+#define COUNT_BITS_BATCH(level, target) \
+    target static void level##_batch(const uint8_t *query, \
+            const uint8_t *codes, size_t codeWords, size_t codeCount, \
+            uint32_t *distances) { \
+        switch (codeWords) { \
+        case 4:     COUNT_BITS_BATCH_LOOP(level, 4); break; \
+        case 8:     COUNT_BITS_BATCH_LOOP(level, 8); break; \
+        case 16:    COUNT_BITS_BATCH_LOOP(level, 16); break; \
+        default:    COUNT_BITS_BATCH_LOOP(level, codeWords); break; \
+        } \
+    }
+
+// Instantiate `<level>_bitwise`, `op` is a constant in every loop.
+#define COUNT_BITS_BITWISE(level, target) \
+    target static void level##_bitwise(uint8_t *dst, const uint8_t *a, \
+            const uint8_t *b, size_t n, int op) { \
+        switch (op) { \
+        case OP_AND:    level##_bitwise_op(dst, a, b, n, OP_AND); break; \
+        case OP_OR:     level##_bitwise_op(dst, a, b, n, OP_OR); break; \
+        case OP_XOR:    level##_bitwise_op(dst, a, b, n, OP_XOR); break; \
+        case OP_ANDNOT: level##_bitwise_op(dst, a, b, n, OP_ANDNOT); break; \
+        default:        level##_bitwise_op(dst, a, b, n, OP_FIRST); break; \
+        } \
+    }
+
+#define COUNT_BITS_OP_TABLE(level) \
+    { level##_first, level##_and, level##_or, level##_xor, level##_andnot }
+
+#define COUNT_BITS_KERNEL_ENTRY(name, isaLevel, level, positional, decode, \
+        prefix, bitwise) \
+    { name, isaLevel, COUNT_BITS_OP_TABLE(level), level##_pair, \
+        level##_batch, positional, decode, prefix, bitwise##_bitwise, \
+        bitwise##_shift, bitwise##_find }
+
+// The ISA level of a kernel, checked against the CPU.
+enum {
+    LEVEL_PORTABLE,
+    LEVEL_POPCNT,
+    LEVEL_AVX2,
+    LEVEL_AVX512
+};
+
+typedef struct {
+    const char              *name;
+    int                     level;
+    count_bits_kernel_fn    count[OP_NUM];
+    count_bits_pair_fn      pair;
+    count_bits_batch_fn     batch;
+    count_bits_positional_fn    positional;
+    count_bits_decode_fn    decode;
+    count_bits_prefix_fn    prefix;
+    count_bits_bitwise_fn   bitwise;
+    count_bits_shift_fn     shift;
+    count_bits_find_fn      find;
+} count_bits_kernel_t;
+
+COUNT_BITS_OPS(kernighan, )
+COUNT_BITS_OPS(scalar, )
+COUNT_BITS_BATCH(kernighan, )
+COUNT_BITS_BATCH(scalar, )
+COUNT_BITS_BITWISE(scalar, )
+#ifdef COUNT_BITS_X86
+COUNT_BITS_OPS(popcnt, COUNT_BITS_TARGET("popcnt"))
+COUNT_BITS_OPS(avx2, COUNT_BITS_TARGET("avx2"))
+COUNT_BITS_OPS(avx512, COUNT_BITS_TARGET("avx512f,avx512vpopcntdq"))
+COUNT_BITS_BATCH(popcnt, COUNT_BITS_TARGET("popcnt"))
+COUNT_BITS_BATCH(avx2, COUNT_BITS_TARGET("avx2"))
+COUNT_BITS_BATCH(avx512, COUNT_BITS_TARGET("avx512f,avx512vpopcntdq"))
+COUNT_BITS_BITWISE(avx2, COUNT_BITS_TARGET("avx2"))
+COUNT_BITS_BITWISE(avx512, COUNT_BITS_TARGET("avx512f"))
+#endif
+
+// All kernels, from the slowest to the fastest.
+static const count_bits_kernel_t kernelTable[] = {
+    COUNT_BITS_KERNEL_ENTRY("kernighan", LEVEL_PORTABLE, kernighan,
+            scalar_positional, scalar_decode, scalar_prefix, scalar),
+    COUNT_BITS_KERNEL_ENTRY("scalar", LEVEL_PORTABLE, scalar,
+            scalar_positional, scalar_decode, scalar_prefix, scalar),
+#ifdef COUNT_BITS_X86
+    COUNT_BITS_KERNEL_ENTRY("popcnt", LEVEL_POPCNT, popcnt,
+            scalar_positional, scalar_decode, popcnt_prefix, scalar),
+    COUNT_BITS_KERNEL_ENTRY("avx2", LEVEL_AVX2, avx2, avx2_positional,
+            avx2_decode, avx2_prefix, avx2),
+    COUNT_BITS_KERNEL_ENTRY("avx512", LEVEL_AVX512, avx512,
+            avx512_positional, avx512_decode, avx512_prefix, avx512),
+#endif
+};
+
+#define KERNEL_NUM  (sizeof(kernelTable) / sizeof(kernelTable[0]))
+
+static int kernel_supported(const count_bits_kernel_t *kernel) {
+    switch (kernel->level) {
+#ifdef COUNT_BITS_X86
+    case LEVEL_POPCNT:
+        return __builtin_cpu_supports("popcnt");
+    case LEVEL_AVX2:
+        return __builtin_cpu_supports("avx2");
+    case LEVEL_AVX512:
+        return __builtin_cpu_supports("avx512f")
+            && __builtin_cpu_supports("avx512bw")
+            && __builtin_cpu_supports("avx512vpopcntdq");
+#endif
+    default:
+        return LEVEL_PORTABLE == kernel->level;
+    }
+}
+
+static void select_kernel(void);
+
+// Resolver stubs: select the kernel, then forward the call to it.
+static const count_bits_kernel_t *selectedKernel;
+
+static ALWAYS_INLINE uint64_t resolve_op(const uint8_t *a, const uint8_t *b,
+        size_t wordCount, int op) {
+    select_kernel();
+    return selectedKernel->count[op](a, b, wordCount);
+}
+
+static void resolve_pair(const uint8_t *a, const uint8_t *b,
+        size_t wordCount, uint64_t *andCount, uint64_t *orCount) {
+    select_kernel();
+    selectedKernel->pair(a, b, wordCount, andCount, orCount);
+}
+
+static void resolve_batch(const uint8_t *query, const uint8_t *codes,
+        size_t codeWords, size_t codeCount, uint32_t *distances) {
+    select_kernel();
+    selectedKernel->batch(query, codes, codeWords, codeCount, distances);
+}
+
+COUNT_BITS_OPS(resolve, )
+
+static void resolve_positional(const uint8_t *bytes, size_t wordCount,
+        uint64_t *counts) {
+    select_kernel();
+    selectedKernel->positional(bytes, wordCount, counts);
+}
+
+static size_t resolve_decode(const uint8_t *bytes, size_t wordCount,
+        uint32_t base, uint32_t *positions) {
+    select_kernel();
+    return selectedKernel->decode(bytes, wordCount, base, positions);
+}
+
+static uint64_t resolve_prefix(const uint8_t *bytes, size_t wordCount,
+        size_t blockWords, uint64_t base, uint64_t *ranks) {
+    select_kernel();
+    return selectedKernel->prefix(bytes, wordCount, blockWords, base, ranks);
+}
+
+static void resolve_bitwise(uint8_t *dst, const uint8_t *a, const uint8_t *b,
+        size_t wordCount, int op) {
+    select_kernel();
+    selectedKernel->bitwise(dst, a, b, wordCount, op);
+}
+
+static void resolve_shift(uint8_t *dst, const uint8_t *src, size_t wordCount,
+        unsigned shift, int right) {
+    select_kernel();
+    selectedKernel->shift(dst, src, wordCount, shift, right);
+}
+
+static size_t resolve_find(const uint8_t *bytes, size_t wordCount) {
+    select_kernel();
+    return selectedKernel->find(bytes, wordCount);
+}
+
+static const count_bits_kernel_t resolveKernel =
+    COUNT_BITS_KERNEL_ENTRY("resolve", LEVEL_PORTABLE, resolve,
+            resolve_positional, resolve_decode, resolve_prefix, resolve);
+
+// The selected kernel. It starts at the resolver, so that calls made before
+// the constructor ran (e.g. from other constructors) are still correct.
+static const count_bits_kernel_t *selectedKernel = &resolveKernel;
+
+// The supported kernel called `name`, or NULL.
+static const count_bits_kernel_t *find_kernel(const char *name) {
+    for (size_t idx = 0; idx < KERNEL_NUM; ++idx)
+        if (0 == strcmp(name, kernelTable[idx].name))
+            return kernel_supported(&kernelTable[idx])
+                ? &kernelTable[idx] : NULL;
+
+    return NULL;
+}
+
+/**
+ * @brief Pick the kernel, once, at program start.
+ *
+ * @details The fastest kernel supported by the CPU (queried by cpuid through
+ * `__builtin_cpu_supports`) is chosen. `COUNT_BITS_KERNEL` forces a kernel by
+ * name, an unknown or unsupported name falls back to the automatic choice.
+ */
+__attribute__((constructor))
+static void select_kernel(void) {
+    const count_bits_kernel_t *chosen = &kernelTable[0];
+
+    if (&resolveKernel != selectedKernel)
+        return;
+
+#ifdef COUNT_BITS_X86
+    __builtin_cpu_init();
+    decode_table_init();
+#endif
+    for (size_t idx = 0; idx < KERNEL_NUM; ++idx)
+        if (kernel_supported(&kernelTable[idx]))
+            chosen = &kernelTable[idx];
+
+    const char *forced = getenv(COUNT_BITS_ENV);
+    if (NULL != forced) {
+        const count_bits_kernel_t *named = find_kernel(forced);
+        if (NULL != named)
+            chosen = named;
+        else
+            fprintf(stderr, "%s=%s is unknown or unsupported, using %s\n",
+                    COUNT_BITS_ENV, forced, chosen->name);
+    }
+
+    selectedKernel = chosen;
+}
+
+const char *count_bits_kernel(void) {
+    select_kernel();
+    return selectedKernel->name;
+}
+
+int count_bits_set_kernel(const char *name) {
+    select_kernel();
+
+    const count_bits_kernel_t *kernel = find_kernel(name);
+    if (NULL == kernel)
+        return -1;
+    selectedKernel = kernel;
+
+    return 0;
+}
+
+#ifdef COUNT_BITS_X86
+COUNT_BITS_TARGET("bmi,bmi2")
+static uint32_t select_pdep(uint64_t word, uint32_t k) {
+    uint64_t bit = _pdep_u64(1ULL << k, word);
+    return 0 == bit ? 64 : (uint32_t)_tzcnt_u64(bit);
+}
+#endif
+
+static uint32_t select_broadword(uint64_t word, uint32_t k) {
+    return count_bits_select_broadword(word, k);
+}
+
+// The in-word select of `count_bits_select`, set by `select_word_init`.
+static uint32_t (*selectWord)(uint64_t word, uint32_t k) = select_broadword;
+
+/**
+ * @brief Use `PDEP` for the in-word select if the CPU has BMI2 and it is
+ * fast, i.e. not microcoded as on AMD families 15h to 17h (up to Zen 2).
+ */
+__attribute__((constructor))
+static void select_word_init(void) {
+#ifdef COUNT_BITS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("bmi2") && !__builtin_cpu_is("amdfam15h")
+            && !__builtin_cpu_is("amdfam17h"))
+        selectWord = select_pdep;
+#endif
+}
+
+// Bytes before the first aligned address of `a`, at most `length`.
+static inline size_t head_length(const uint8_t *a, size_t length) {
+    size_t head = (COUNT_BITS_ALIGN - (uintptr_t)a % COUNT_BITS_ALIGN)
+        % COUNT_BITS_ALIGN;
+    return head < length ? head : length;
+}
+
+#ifdef COUNT_BITS_PERF
+// The call of every op in the perf report.
+static const char *opNames[OP_NUM] = { "count", "and", "or", "xor", "andnot" };
+#endif
+
+/**
+ * @brief Count the bits of `op(a, b)` in one pass, nothing is written.
+ *
+ * @details The head up to the alignment of `a` and the tail shorter than a
+ * word are counted byte by byte, the body by the selected kernel.
+ */
+static uint64_t count_op(const uint8_t *a, const uint8_t *b, size_t length,
+        int op) {
+    uint64_t count = 0;
+
+    size_t head = head_length(a, length);
+    for (size_t idx = 0; idx < head; ++idx)
+        count += popcount64(combine64(a[idx], b[idx], op) & 0xFF);
+    a += head;
+    b += head;
+    length -= head;
+
+    size_t wordCount = length / 8;
+    COUNT_BITS_PERF_BEGIN(span);
+    count += selectedKernel->count[op](a, b, wordCount);
+    COUNT_BITS_PERF_END(span, selectedKernel->name, opNames[op],
+            wordCount * 8);
+    a += wordCount * 8;
+    b += wordCount * 8;
+
+    for (size_t idx = 0; idx < length % 8; ++idx)
+        count += popcount64(combine64(a[idx], b[idx], op) & 0xFF);
+
+    return count;
+}
+
+uint64_t count_bits_buffer(const void *buffer, size_t length) {
+    return count_op(buffer, buffer, length, OP_FIRST);
+}
+
+uint64_t count_bits_and(const void *a, const void *b, size_t length) {
+    return count_op(a, b, length, OP_AND);
+}
+
+uint64_t count_bits_or(const void *a, const void *b, size_t length) {
+    return count_op(a, b, length, OP_OR);
+}
+
+uint64_t count_bits_xor(const void *a, const void *b, size_t length) {
+    return count_op(a, b, length, OP_XOR);
+}
+
+uint64_t count_bits_andnot(const void *a, const void *b, size_t length) {
+    return count_op(a, b, length, OP_ANDNOT);
+}
+
+void count_bits_and_or(const void *a, const void *b, size_t length,
+        uint64_t *andCount, uint64_t *orCount) {
+    const uint8_t *pa = a, *pb = b;
+    uint64_t headAnd = 0, headOr = 0;
+
+    size_t head = head_length(pa, length);
+    for (size_t idx = 0; idx < head; ++idx) {
+        headAnd += popcount64(pa[idx] & pb[idx]);
+        headOr += popcount64(pa[idx] | pb[idx]);
+    }
+    pa += head;
+    pb += head;
+    length -= head;
+
+    size_t wordCount = length / 8;
+    COUNT_BITS_PERF_BEGIN(span);
+    selectedKernel->pair(pa, pb, wordCount, andCount, orCount);
+    COUNT_BITS_PERF_END(span, selectedKernel->name, "and_or", wordCount * 8);
+    pa += wordCount * 8;
+    pb += wordCount * 8;
+
+    for (size_t idx = 0; idx < length % 8; ++idx) {
+        headAnd += popcount64(pa[idx] & pb[idx]);
+        headOr += popcount64(pa[idx] | pb[idx]);
+    }
+    *andCount += headAnd;
+    *orCount += headOr;
+}
+
+double count_bits_jaccard(const void *a, const void *b, size_t length) {
+    uint64_t andCount, orCount;
+    count_bits_and_or(a, b, length, &andCount, &orCount);
+
+    // Two empty sets are identical.
+    return 0 == orCount ? 1.0 : (double)andCount / orCount;
+}
+
+double count_bits_tanimoto(const void *a, const void *b, size_t length) {
+    return count_bits_jaccard(a, b, length);
+}
+
+// Bytes skipped at once by `count_bits_select`, an eighth of it at the next
+// level down to a cache line.
+#define SELECT_BLOCK    4096
+
+static uint64_t select_bit(const void *buffer, size_t length, uint64_t k) {
+    const uint8_t *bytes = buffer;
+    size_t offset = 0, end = length;
+
+    // Skip spans by their popcount, then narrow the one holding the bit.
+    for (size_t span = SELECT_BLOCK; span >= 64; span /= 8) {
+        for (;; offset += span) {
+            if (offset >= end)
+                return UINT64_MAX;
+
+            size_t spanLength = end - offset < span ? end - offset : span;
+            uint64_t count = count_op(bytes + offset, bytes + offset,
+                    spanLength, OP_FIRST);
+            if (k < count) {
+                end = offset + spanLength;
+                break;
+            }
+            k -= count;
+        }
+    }
+
+    for (; offset < end; offset += 8) {
+        // The last word of the buffer may be short, its missing bytes are 0.
+        uint64_t word = 0;
+        memcpy(&word, bytes + offset, end - offset < 8 ? end - offset : 8);
+        uint64_t count = popcount64(word);
+        if (k < count)
+            return offset * 8 + selectWord(word, (uint32_t)k);
+        k -= count;
+    }
+
+    return UINT64_MAX;
+}
+
+uint64_t count_bits_select(const void *buffer, size_t length, uint64_t k) {
+    // The spans counted on the way are part of this call.
+    COUNT_BITS_PERF_BEGIN(span);
+    uint64_t position = select_bit(buffer, length, k);
+    COUNT_BITS_PERF_END(span, selectedKernel->name, "select", length);
+
+    return position;
+}
+
+// Words decoded per popcount check by `count_bits_decode_next`.
+#define DECODE_BLOCK    64
+
+// Set bits per word from which the vector decode kernels are faster.
+#define DECODE_DENSE    8
+
+void count_bits_decoder_init(count_bits_decoder_t *decoder,
+        const void *bitmap, size_t length) {
+    decoder->bytes = bitmap;
+    decoder->length = length;
+    decoder->offset = 0;
+    decoder->word = 0;
+    decoder->wordBase = 0;
+}
+
+// Write the bits left in the current word, at most `capacity` of them.
+static size_t decode_word(count_bits_decoder_t *decoder, uint32_t *positions,
+        size_t capacity) {
+    size_t count = 0;
+    for (; count < capacity && 0 != decoder->word; ++count) {
+        positions[count] = decoder->wordBase
+            + (uint32_t)__builtin_ctzll(decoder->word);
+        decoder->word &= decoder->word - 1;
+    }
+
+    return count;
+}
+
+size_t count_bits_decode_next(count_bits_decoder_t *decoder,
+        uint32_t *positions, size_t capacity) {
+    COUNT_BITS_PERF_BEGIN(span);
+#ifdef COUNT_BITS_PERF
+    size_t start = decoder->offset;
+#endif
+    size_t count = decode_word(decoder, positions, capacity);
+
+    while (count < capacity && decoder->offset < decoder->length) {
+        const uint8_t *bytes = decoder->bytes + decoder->offset;
+        size_t rest = decoder->length - decoder->offset;
+        size_t wordCount = rest / 8 < DECODE_BLOCK ? rest / 8 : DECODE_BLOCK;
+
+        // A block goes to the kernel if all its positions and the slack fit,
+        // else a single word if it fits. Empty blocks are skipped.
+        uint64_t blockCount = 0 == wordCount ? 0
+            : selectedKernel->count[OP_FIRST](bytes, bytes, wordCount);
+        if (0 != wordCount && 0 == blockCount) {
+            decoder->offset += wordCount * 8;
+            continue;
+        }
+        if (blockCount + DECODE_SLACK > capacity - count) {
+            blockCount = 0 != wordCount ? popcount64(load64(bytes)) : 0;
+            wordCount = blockCount + DECODE_SLACK <= capacity - count;
+        }
+        if (0 != wordCount) {
+            // Sparse words are faster with the branchy scalar loop.
+            count_bits_decode_fn decode = blockCount < wordCount * DECODE_DENSE
+                ? scalar_decode : selectedKernel->decode;
+            count += decode(bytes, wordCount,
+                    (uint32_t)(decoder->offset * 8), positions + count);
+            decoder->offset += wordCount * 8;
+            continue;
+        }
+
+        // Otherwise one word at a time, the last one may be short.
+        size_t length = rest < 8 ? rest : 8;
+        decoder->word = 0;
+        memcpy(&decoder->word, bytes, length);
+        decoder->wordBase = (uint32_t)(decoder->offset * 8);
+        decoder->offset += length;
+        count += decode_word(decoder, positions + count, capacity - count);
+    }
+    COUNT_BITS_PERF_END(span, selectedKernel->name, "decode",
+            decoder->offset - start);
+
+    return count;
+}
+
+size_t count_bits_decode(const void *bitmap, size_t length,
+        uint32_t *positions, size_t capacity) {
+    count_bits_decoder_t decoder;
+    count_bits_decoder_init(&decoder, bitmap, length);
+
+    return count_bits_decode_next(&decoder, positions, capacity);
+}
+
+uint64_t count_bits_prefix(const void *bitmap, size_t wordCount,
+        size_t blockWords, uint64_t base, uint64_t *ranks) {
+    COUNT_BITS_PERF_BEGIN(span);
+    base = selectedKernel->prefix(bitmap, wordCount, blockWords, base, ranks);
+#ifdef COUNT_BITS_X86
+    // Non-temporal stores are ordered before anything that follows.
+    _mm_sfence();
+#endif
+    COUNT_BITS_PERF_END(span, selectedKernel->name, "prefix", wordCount * 8);
+
+    return base;
+}
+
+void count_bits_xor_batch(const void *query, const void *codes,
+        size_t codeBytes, size_t codeCount, uint32_t *distances) {
+    COUNT_BITS_PERF_BEGIN(span);
+    selectedKernel->batch(query, codes, codeBytes / 8, codeCount, distances);
+    COUNT_BITS_PERF_END(span, selectedKernel->name, "xor_batch",
+            codeBytes * codeCount);
+}
+
+static void bitwise_words(uint64_t *dst, const uint64_t *a,
+        const uint64_t *b, size_t wordCount, int op) {
+    COUNT_BITS_PERF_BEGIN(span);
+    selectedKernel->bitwise((uint8_t *)dst, (const uint8_t *)a,
+            (const uint8_t *)b, wordCount, op);
+    COUNT_BITS_PERF_END(span, selectedKernel->name, "bitwise", wordCount * 8);
+}
+
+void count_bits_and_words(uint64_t *dst, const uint64_t *a,
+        const uint64_t *b, size_t wordCount) {
+    bitwise_words(dst, a, b, wordCount, OP_AND);
+}
+
+void count_bits_or_words(uint64_t *dst, const uint64_t *a,
+        const uint64_t *b, size_t wordCount) {
+    bitwise_words(dst, a, b, wordCount, OP_OR);
+}
+
+void count_bits_xor_words(uint64_t *dst, const uint64_t *a,
+        const uint64_t *b, size_t wordCount) {
+    bitwise_words(dst, a, b, wordCount, OP_XOR);
+}
+
+void count_bits_andnot_words(uint64_t *dst, const uint64_t *a,
+        const uint64_t *b, size_t wordCount) {
+    bitwise_words(dst, a, b, wordCount, OP_ANDNOT);
+}
+
+void count_bits_not_words(uint64_t *dst, const uint64_t *a, size_t wordCount) {
+    bitwise_words(dst, a, a, wordCount, OP_FIRST);
+}
+
+void count_bits_shift_left(uint64_t *words, size_t wordCount, uint64_t shift) {
+    size_t wordShift = shift / 64 < wordCount ? shift / 64 : wordCount;
+    size_t kept = wordCount - wordShift;
+
+    // Whole words move by `memmove`, the kernel moves them by the rest.
+    COUNT_BITS_PERF_BEGIN(span);
+    if (0 == shift % 64 || 0 == kept)
+        memmove(words + wordShift, words, kept * sizeof(uint64_t));
+    else
+        selectedKernel->shift((uint8_t *)(words + wordShift),
+                (const uint8_t *)words, kept, shift % 64, 0);
+    memset(words, 0, wordShift * sizeof(uint64_t));
+    COUNT_BITS_PERF_END(span, selectedKernel->name, "shift", wordCount * 8);
+}
+
+void count_bits_shift_right(uint64_t *words, size_t wordCount,
+        uint64_t shift) {
+    size_t wordShift = shift / 64 < wordCount ? shift / 64 : wordCount;
+    size_t kept = wordCount - wordShift;
+
+    COUNT_BITS_PERF_BEGIN(span);
+    if (0 == shift % 64 || 0 == kept)
+        memmove(words, words + wordShift, kept * sizeof(uint64_t));
+    else
+        selectedKernel->shift((uint8_t *)words,
+                (const uint8_t *)(words + wordShift), kept, shift % 64, 1);
+    memset(words + kept, 0, wordShift * sizeof(uint64_t));
+    COUNT_BITS_PERF_END(span, selectedKernel->name, "shift", wordCount * 8);
+}
+
+uint64_t count_bits_find_next(const uint64_t *words, size_t wordCount,
+        uint64_t from) {
+    size_t word = from / 64;
+    if (word >= wordCount)
+        return UINT64_MAX;
+
+    // The rest of the first word is checked alone.
+    uint64_t bits = words[word] & (~0ULL << (from % 64));
+    if (0 != bits)
+        return word * 64 + (uint64_t)__builtin_ctzll(bits);
+
+    COUNT_BITS_PERF_BEGIN(span);
+    ++word;
+    word += selectedKernel->find((const uint8_t *)(words + word),
+            wordCount - word);
+    COUNT_BITS_PERF_END(span, selectedKernel->name, "find",
+            (word - from / 64) * 8);
+
+    return word < wordCount
+        ? word * 64 + (uint64_t)__builtin_ctzll(words[word]) : UINT64_MAX;
+}
+
+// Positional popcount of `length` bytes of `width`-bit lanes into `counts`.
+static void count_positional(const uint8_t *bytes, size_t length,
+        unsigned width, uint64_t *counts) {
+    uint64_t counts64[64] = { 0 };
+    size_t wordCount = length / 8;
+    COUNT_BITS_PERF_BEGIN(span);
+    selectedKernel->positional(bytes, wordCount, counts64);
+    COUNT_BITS_PERF_END(span, selectedKernel->name, "positional",
+            wordCount * 8);
+
+    for (unsigned pos = 0; pos < 64; ++pos)
+        counts[pos % width] += counts64[pos];
+
+    // Lanes narrower than a word after the last full word.
+    for (size_t idx = wordCount * 8; idx < length; ++idx)
+        for (unsigned bit = 0; bit < 8; ++bit)
+            counts[(idx * 8 + bit) % width] += (bytes[idx] >> bit) & 1;
+}
+
+void count_bits_positional8(const uint8_t *data, size_t count,
+        uint64_t counts[8]) {
+    count_positional(data, count, 8, counts);
+}
+
+void count_bits_positional16(const uint16_t *data, size_t count,
+        uint64_t counts[16]) {
+    count_positional((const uint8_t *)data, count * 2, 16, counts);
+}
+
+void count_bits_positional32(const uint32_t *data, size_t count,
+        uint64_t counts[32]) {
+    count_positional((const uint8_t *)data, count * 4, 32, counts);
+}
+
+void count_bits_positional64(const uint64_t *data, size_t count,
+        uint64_t counts[64]) {
+    count_positional((const uint8_t *)data, count * 8, 64, counts);
+}
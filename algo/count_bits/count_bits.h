@@ -0,0 +1,313 @@
+#ifndef COUNT_BITS_H
+#define COUNT_BITS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Count the set bits of a single 32-bit word (Kernighan's loop).
+ *
+ * @details The loop runs once per set bit, so its cost depends on the data.
+ */
+uint32_t count_bit_one(uint32_t target);
+
+/**
+ * @brief Count the set bits of an arbitrary byte buffer.
+ *
+ * @details The buffer does not have to be aligned. The unaligned head and
+ * tail are counted byte-wise, the aligned body is counted by the kernel that
+ * was selected at program start (see `count_bits_kernel`).
+ *
+ * @param[in]   buffer          The buffer to count.
+ * @param[in]   length          The length of the buffer in bytes.
+ *
+ * @return The number of set bits in the buffer.
+ */
+uint64_t count_bits_buffer(const void *buffer, size_t length);
+
+/**
+ * @brief Fused combine-and-count of two buffers of the same length.
+ *
+ * @details The bits of `a & b`, `a | b`, `a ^ b` and `a & ~b` are counted in a
+ * single streaming pass with the selected kernel, no intermediate buffer is
+ * written. They are the intersection cardinality, the union cardinality, the
+ * Hamming distance and the difference cardinality of two bit sets.
+ */
+uint64_t count_bits_and(const void *a, const void *b, size_t length);
+uint64_t count_bits_or(const void *a, const void *b, size_t length);
+uint64_t count_bits_xor(const void *a, const void *b, size_t length);
+uint64_t count_bits_andnot(const void *a, const void *b, size_t length);
+
+/**
+ * @brief The intersection and union cardinalities of two buffers in one pass.
+ */
+void count_bits_and_or(const void *a, const void *b, size_t length,
+        uint64_t *andCount, uint64_t *orCount);
+
+/**
+ * @brief Jaccard index `|A & B| / |A | B|` of two bit sets, 1 if both are
+ * empty.
+ *
+ * @details The Tanimoto coefficient `|A & B| / (|A| + |B| - |A & B|)` is the
+ * same number for bit sets, `count_bits_tanimoto` is provided for readability.
+ */
+double count_bits_jaccard(const void *a, const void *b, size_t length);
+double count_bits_tanimoto(const void *a, const void *b, size_t length);
+
+/**
+ * @brief Hamming distances of one query against consecutive codes.
+ *
+ * @details `distances[i]` is the popcount of `query ^ codes[i]`, where every
+ * code is `codeBytes` long. `codeBytes` must be a multiple of 8, 256-, 512-
+ * and 1024-bit codes have specialized loops.
+ */
+void count_bits_xor_batch(const void *query, const void *codes,
+        size_t codeBytes, size_t codeCount, uint32_t *distances);
+
+/**
+ * @brief Positional popcount: `counts[j]` is increased by the number of
+ * elements of `data` that have bit `j` set.
+ *
+ * @details The counts are accumulated, so a large array can be processed in
+ * chunks. The elements go through a carry-save adder tree 16 words (or
+ * vectors) at a time, only the carry-out is spread over per-position
+ * counters, so the cost per word is a few logic operations instead of one
+ * per bit.
+ *
+ * @param[in]       data        The elements.
+ * @param[in]       count       The number of elements.
+ * @param[in,out]   counts      One counter per bit position.
+ */
+void count_bits_positional8(const uint8_t *data, size_t count,
+        uint64_t counts[8]);
+void count_bits_positional16(const uint16_t *data, size_t count,
+        uint64_t counts[16]);
+void count_bits_positional32(const uint32_t *data, size_t count,
+        uint64_t counts[32]);
+void count_bits_positional64(const uint64_t *data, size_t count,
+        uint64_t counts[64]);
+
+/**
+ * @brief Position of the `k`-th set bit (counting from 0) of a buffer, bit
+ * `i` is bit `i % 8` of byte `i / 8`.
+ *
+ * @details Blocks of 4 KiB are skipped by their bulk popcount (selected
+ * kernel), the block holding the bit is narrowed down to 512 and 64 bytes the
+ * same way, then word by word. The word is searched with `PDEP` and `TZCNT`
+ * if the CPU has fast BMI2, otherwise by `count_bits_select_broadword`.
+ *
+ * @return The bit position, `UINT64_MAX` if the buffer has at most `k` set
+ * bits.
+ */
+uint64_t count_bits_select(const void *buffer, size_t length, uint64_t k);
+
+/**
+ * @brief State of a chunked bitmap decode, see `count_bits_decode_next`.
+ */
+typedef struct {
+    const uint8_t   *bytes;
+    size_t          length;
+    size_t          offset;         ///< Next byte to decode.
+    uint64_t        word;           ///< Bits of a partly written word.
+    uint32_t        wordBase;       ///< Position of bit 0 of `word`.
+} count_bits_decoder_t;
+
+/**
+ * @brief Start decoding `length` bytes of `bitmap`, which must outlive the
+ * decoder. Bit `i` is bit `i % 8` of byte `i / 8`, `length` is at most
+ * 512 MiB so that every position fits 32 bits.
+ */
+void count_bits_decoder_init(count_bits_decoder_t *decoder,
+        const void *bitmap, size_t length);
+
+/**
+ * @brief Write the next set bit positions, in increasing order, e.g. to
+ * process a large filter result in fixed-size batches.
+ *
+ * @details Blocks of 64 words whose popcount plus 16 entries of slack fit
+ * the room left are decoded at once (single words near the end). Dense
+ * blocks go to the decode kernel of the selected kernel: a table expansion
+ * of every byte with AVX2, a `vpcompressd` of every 16 bits with AVX-512.
+ * Sparse blocks use a `TZCNT` loop, empty ones are skipped. The rest is
+ * decoded word by word, stopping exactly at `capacity`.
+ *
+ * @return The number of positions written, less than `capacity` only once
+ * the bitmap is exhausted, 0 at the end.
+ */
+size_t count_bits_decode_next(count_bits_decoder_t *decoder,
+        uint32_t *positions, size_t capacity);
+
+/**
+ * @brief Write all set bit positions of `bitmap` in one call, at most
+ * `capacity`. `count_bits_buffer(bitmap, length)` gives the exact size.
+ *
+ * @return The number of positions written.
+ */
+size_t count_bits_decode(const void *bitmap, size_t length,
+        uint32_t *positions, size_t capacity);
+
+/**
+ * @brief Prefix popcount: `ranks[i]` is `base` plus the set bits of the
+ * words before block `i`, e.g. the counts of a rank directory.
+ *
+ * @details There is one rank per block of `blockWords` words (at least 1),
+ * `(wordCount + blockWords - 1) / blockWords` ranks in total. Single-word
+ * blocks fuse the SIMD popcount with an in-register scan. The ranks are
+ * written with non-temporal stores, so that they do not evict the bitmap.
+ *
+ * @return `base` plus the set bits of all words.
+ */
+uint64_t count_bits_prefix(const void *bitmap, size_t wordCount,
+        size_t blockWords, uint64_t base, uint64_t *ranks);
+
+/**
+ * @brief `count_bits_prefix` by `threadCount` threads (0 for one per CPU),
+ * in two passes (`count_bits_prefix.c`).
+ *
+ * @details The bitmap is cut into chunks of about 8 MiB (whole blocks),
+ * which the threads claim one by one. The first pass counts every chunk with
+ * `count_bits_buffer`, the chunk totals are scanned into offsets, the second
+ * pass writes the ranks of every chunk from its offset. `total` receives
+ * the set bits of all words.
+ *
+ * @return 0 on success, -1 if memory could not be allocated.
+ */
+int count_bits_prefix_parallel(const void *bitmap, size_t wordCount,
+        size_t blockWords, uint64_t *ranks, unsigned threadCount,
+        uint64_t *total);
+
+/**
+ * @brief Bulk bitwise operations on 64-bit words with the selected kernel:
+ * `dst = a & b`, `a | b`, `a ^ b`, `a & ~b` and `~a`.
+ *
+ * @details `dst` may be the same array as `a` or `b`, but must not overlap
+ * them otherwise. These are the word loops of `ts::bitset`
+ * (`count_bits_bitset.hpp`).
+ */
+void count_bits_and_words(uint64_t *dst, const uint64_t *a,
+        const uint64_t *b, size_t wordCount);
+void count_bits_or_words(uint64_t *dst, const uint64_t *a,
+        const uint64_t *b, size_t wordCount);
+void count_bits_xor_words(uint64_t *dst, const uint64_t *a,
+        const uint64_t *b, size_t wordCount);
+void count_bits_andnot_words(uint64_t *dst, const uint64_t *a,
+        const uint64_t *b, size_t wordCount);
+void count_bits_not_words(uint64_t *dst, const uint64_t *a, size_t wordCount);
+
+/**
+ * @brief Shift `wordCount` words in place by `shift` bits towards the higher
+ * (left) or lower (right) bit positions, zeros are shifted in. Bit `i` is
+ * bit `i % 64` of word `i / 64`.
+ */
+void count_bits_shift_left(uint64_t *words, size_t wordCount, uint64_t shift);
+void count_bits_shift_right(uint64_t *words, size_t wordCount,
+        uint64_t shift);
+
+/**
+ * @brief The position of the first set bit at or after bit `from`.
+ *
+ * @details Runs of zero words are skipped 16 words at a time.
+ *
+ * @return The bit position, or UINT64_MAX if there is none.
+ */
+uint64_t count_bits_find_next(const uint64_t *words, size_t wordCount,
+        uint64_t from);
+
+/**
+ * @brief Count the set bits of a file (`count_bits_file.c`).
+ *
+ * @details The file is memory-mapped with `MADV_SEQUENTIAL` and huge page
+ * hints and cut into 8 MiB chunks, which `threadCount` threads (0 for one per
+ * CPU) claim one by one and count with `count_bits_buffer`. The per-thread
+ * totals are added at the end.
+ *
+ * @return 0 on success, -1 with `errno` set on failure.
+ */
+int count_bits_file(const char *path, unsigned threadCount, uint64_t *count);
+
+/**
+ * @brief The name of the kernel used by the bulk routines.
+ *
+ * @details One of `kernighan`, `scalar` (Harley-Seal on 64-bit words),
+ * `popcnt`, `avx2` (Harley-Seal with `pshufb` lookup) and `avx512`
+ * (`VPOPCNTDQ`). The fastest one supported by the CPU is picked once at
+ * program start, the environment variable `COUNT_BITS_KERNEL` forces one.
+ */
+const char *count_bits_kernel(void);
+
+/**
+ * @brief Switch the bulk routines to the kernel called `name`, e.g. to
+ * compare kernels in one benchmark run. Not thread-safe against concurrent
+ * calls of the bulk routines.
+ *
+ * @return 0 on success, -1 if the kernel is unknown or not supported.
+ */
+int count_bits_set_kernel(const char *name);
+
+/**
+ * @brief Popcount of one 64-bit word, for latency-bound query paths.
+ *
+ * @details Inlined, compiles to a single `POPCNT` with `-mpopcnt`.
+ */
+static inline uint32_t count_bits_word(uint64_t word) {
+    return (uint32_t)__builtin_popcountll(word);
+}
+
+/**
+ * @brief Position of the `k`-th set bit of `word` (counting from 0), 64 if
+ * `k >= popcount(word)`. `k` must be less than 64.
+ *
+ * @details Broadword select without `PDEP`: the byte popcounts are summed by
+ * one multiplication into a prefix sum per byte, all bytes are compared
+ * against `k` at once to find the byte holding the bit, and the few bits
+ * below it in that byte are cleared.
+ */
+static inline uint32_t count_bits_select_broadword(uint64_t word, uint32_t k) {
+    const uint64_t ones = 0x0101010101010101ULL, highs = 0x8080808080808080ULL;
+    uint64_t s = word - ((word >> 1) & 0x5555555555555555ULL);
+    s = (s & 0x3333333333333333ULL) + ((s >> 2) & 0x3333333333333333ULL);
+    s = (s + (s >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+
+    // Byte `i` of `sums` is the popcount of bytes `0..i`, the high bit of
+    // byte `i` of `below` is set if the bit is past byte `i`.
+    uint64_t sums = s * ones;
+    uint64_t below = ((k * ones | highs) - sums) & highs;
+    uint32_t place = (uint32_t)((below >> 7) * ones >> 56) * 8;
+    if (64 == place)
+        return 64;
+
+    uint32_t rank = k - (uint32_t)((sums << 8) >> place & 0xFF);
+    uint32_t byte = (uint32_t)(word >> place) & 0xFF;
+    while (0 != rank--)
+        byte &= byte - 1;
+
+    return place + (uint32_t)__builtin_ctz(byte);
+}
+
+/**
+ * @brief Position of the `k`-th set bit of `word`, as
+ * `count_bits_select_broadword`, inlined for latency-bound query paths.
+ *
+ * @details With `-mbmi2` this is `TZCNT(PDEP(1 << k, word))`: `PDEP` deposits
+ * the single bit onto the `k`-th set bit of `word`. `PDEP` is microcoded and
+ * slow on AMD before Zen 3, define `COUNT_BITS_SLOW_PDEP` there to keep the
+ * broadword code. `count_bits_select` picks the variant at runtime.
+ */
+static inline uint32_t count_bits_select_word(uint64_t word, uint32_t k) {
+#if defined(__BMI2__) && !defined(COUNT_BITS_SLOW_PDEP)
+    uint64_t bit = __builtin_ia32_pdep_di(1ULL << k, word);
+    return 0 == bit ? 64 : (uint32_t)__builtin_ctzll(bit);
+#else
+    return count_bits_select_broadword(word, k);
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // COUNT_BITS_H
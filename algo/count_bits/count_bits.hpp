@@ -0,0 +1,188 @@
+#ifndef COUNT_BITS_HPP
+#define COUNT_BITS_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+/**
+ * @file count_bits.hpp
+ *
+ * @brief `constexpr` bit counting and bit manipulation for 8- to 128-bit
+ * unsigned integers (C++17, GCC or Clang).
+ *
+ * @details In a constant expression every function uses portable SWAR code,
+ * so masks and lookup tables can be computed by the compiler. At runtime the
+ * same call uses the compiler intrinsics (`POPCNT`, `LZCNT`, `TZCNT`, `BSWAP`
+ * with the matching `-m` flags). 128-bit values are handled as two halves.
+ */
+
+namespace ts {
+
+namespace detail {
+
+template < class T >
+struct is_bit_word : std::integral_constant<bool,
+    std::is_integral<T>::value && std::is_unsigned<T>::value
+        && !std::is_same<T, bool>::value> {};
+
+#ifdef __SIZEOF_INT128__
+template <>
+struct is_bit_word<unsigned __int128> : std::true_type {};
+#endif
+
+template < class T >
+constexpr bool is_bit_word_v = is_bit_word<T>::value;
+
+template < class T >
+constexpr int width_v = static_cast<int>(sizeof(T) * 8);
+
+constexpr bool constant_evaluated() noexcept {
+    return __builtin_is_constant_evaluated();
+}
+
+constexpr int swar_popcount(std::uint64_t x) noexcept {
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return static_cast<int>((x * 0x0101010101010101ULL) >> 56);
+}
+
+// Leading zeros of a non-zero word, by binary search.
+constexpr int swar_countl_zero(std::uint64_t x) noexcept {
+    int count = 0;
+    for (int shift = 32; shift > 0; shift >>= 1) {
+        if (0 == (x >> (64 - shift))) {
+            count += shift;
+            x <<= shift;
+        }
+    }
+
+    return count;
+}
+
+// Trailing zeros of a non-zero word, the lowest set bit is isolated first.
+constexpr int swar_countr_zero(std::uint64_t x) noexcept {
+    return swar_popcount((x & (0 - x)) - 1);
+}
+
+constexpr std::uint64_t swar_bit_reverse(std::uint64_t x) noexcept {
+    x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+    x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+    x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    return __builtin_bswap64(x);
+}
+
+} // namespace detail
+
+/**
+ * @brief The number of set bits.
+ */
+template < class T, std::enable_if_t<detail::is_bit_word_v<T>, int> = 0 >
+constexpr int popcount(T x) noexcept {
+    if constexpr (sizeof(T) > 8) {
+        return popcount(static_cast<std::uint64_t>(x))
+            + popcount(static_cast<std::uint64_t>(x >> 64));
+    }
+    else {
+        if (detail::constant_evaluated())
+            return detail::swar_popcount(x);
+        return __builtin_popcountll(x);
+    }
+}
+
+/**
+ * @brief 1 if the number of set bits is odd, otherwise 0.
+ */
+template < class T, std::enable_if_t<detail::is_bit_word_v<T>, int> = 0 >
+constexpr int parity(T x) noexcept {
+    if constexpr (sizeof(T) > 8) {
+        return parity(static_cast<std::uint64_t>(x)
+                ^ static_cast<std::uint64_t>(x >> 64));
+    }
+    else {
+        if (detail::constant_evaluated())
+            return detail::swar_popcount(x) & 1;
+        return __builtin_parityll(x);
+    }
+}
+
+/**
+ * @brief The number of zero bits above the highest set bit, the width of `T`
+ * for 0.
+ */
+template < class T, std::enable_if_t<detail::is_bit_word_v<T>, int> = 0 >
+constexpr int countl_zero(T x) noexcept {
+    if constexpr (sizeof(T) > 8) {
+        const auto high = static_cast<std::uint64_t>(x >> 64);
+        return 0 != high ? countl_zero(high)
+            : 64 + countl_zero(static_cast<std::uint64_t>(x));
+    }
+    else {
+        if (0 == x)
+            return detail::width_v<T>;
+
+        // The word is widened to 64 bits, the extra zeros are not counted.
+        constexpr int extra = 64 - detail::width_v<T>;
+        if (detail::constant_evaluated())
+            return detail::swar_countl_zero(x) - extra;
+        return __builtin_clzll(x) - extra;
+    }
+}
+
+/**
+ * @brief The number of zero bits below the lowest set bit, the width of `T`
+ * for 0.
+ */
+template < class T, std::enable_if_t<detail::is_bit_word_v<T>, int> = 0 >
+constexpr int countr_zero(T x) noexcept {
+    if constexpr (sizeof(T) > 8) {
+        const auto low = static_cast<std::uint64_t>(x);
+        return 0 != low ? countr_zero(low)
+            : 64 + countr_zero(static_cast<std::uint64_t>(x >> 64));
+    }
+    else {
+        if (0 == x)
+            return detail::width_v<T>;
+        if (detail::constant_evaluated())
+            return detail::swar_countr_zero(x);
+        return __builtin_ctzll(x);
+    }
+}
+
+/**
+ * @brief The bits in reverse order, bit `i` moves to bit `width - 1 - i`.
+ */
+template < class T, std::enable_if_t<detail::is_bit_word_v<T>, int> = 0 >
+constexpr T bit_reverse(T x) noexcept {
+    if constexpr (sizeof(T) > 8) {
+        return (static_cast<T>(
+                    detail::swar_bit_reverse(static_cast<std::uint64_t>(x)))
+                << 64)
+            | detail::swar_bit_reverse(static_cast<std::uint64_t>(x >> 64));
+    }
+    else {
+        return static_cast<T>(detail::swar_bit_reverse(x)
+                >> (64 - detail::width_v<T>));
+    }
+}
+
+/**
+ * @brief A lookup table `{ f(0), f(1), ..., f(N - 1) }` built at compile time.
+ *
+ * @details E.g. `constexpr auto table = ts::make_table<std::uint8_t, 256>(
+ * [](std::size_t i) { return ts::popcount(i); });`.
+ */
+template < class T, std::size_t N, class Function >
+constexpr std::array<T, N> make_table(Function f) {
+    std::array<T, N> table{};
+    for (std::size_t idx = 0; idx < N; ++idx)
+        table[idx] = static_cast<T>(f(idx));
+
+    return table;
+}
+
+} // namespace ts
+
+#endif // COUNT_BITS_HPP
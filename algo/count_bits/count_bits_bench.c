@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "count_bits.h"
+#include "count_bits_perf.h"
+
+// Every measurement is the best of this many runs.
+#define BENCH_REPEAT    3
+
+// A run repeats the count until it took at least this long, in seconds.
+#define BENCH_MIN_TIME  0.02
+
+// Random bytes generated per density, larger buffers repeat them.
+#define PATTERN_BYTES   (4 << 20)
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t xorshift64(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// `count_bit_one` on every 32-bit word, its cost grows with the set bits.
+static uint64_t count_kernighan(const void *buffer, size_t length) {
+    const uint32_t *words = buffer;
+    uint64_t count = 0;
+    for (size_t idx = 0; idx < length / 4; ++idx)
+        count += count_bit_one(words[idx]);
+
+    return count;
+}
+
+// SWAR popcount of every 64-bit word, without an adder tree.
+static uint64_t count_swar(const void *buffer, size_t length) {
+    const uint64_t *words = buffer;
+    uint64_t count = 0;
+    for (size_t idx = 0; idx < length / 8; ++idx) {
+        uint64_t x = words[idx];
+        x = x - ((x >> 1) & 0x5555555555555555ULL);
+        x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+        x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+        count += (x * 0x0101010101010101ULL) >> 56;
+    }
+
+    return count;
+}
+
+static uint8_t byteTable[256];
+
+// One table lookup per byte.
+static uint64_t count_lookup(const void *buffer, size_t length) {
+    const uint8_t *bytes = buffer;
+    uint64_t count = 0;
+    for (size_t idx = 0; idx < length; ++idx)
+        count += byteTable[bytes[idx]];
+
+    return count;
+}
+
+// The bulk routine, with the kernel chosen by `count_bits_set_kernel`.
+static uint64_t count_dispatched(const void *buffer, size_t length) {
+    return count_bits_buffer(buffer, length);
+}
+
+// Positional popcount of 16-bit lanes, its counts add up to the total.
+static uint64_t count_positional(const void *buffer, size_t length) {
+    uint64_t counts[16] = { 0 }, count = 0;
+    count_bits_positional16(buffer, length / 2, counts);
+    for (int pos = 0; pos < 16; ++pos)
+        count += counts[pos];
+
+    return count;
+}
+
+typedef struct {
+    const char      *name;
+    const char      *kernel;    ///< Dispatch kernel, NULL for the default,
+                                ///< "-" outside the dispatch.
+    uint64_t        (*count)(const void *buffer, size_t length);
+} strategy_t;
+
+static const strategy_t strategies[] = {
+    { "kernighan",      "-",        count_kernighan },
+    { "swar",           "-",        count_swar },
+    { "lookup",         "-",        count_lookup },
+    { "harley-seal",    "scalar",   count_dispatched },
+    { "popcnt",         "popcnt",   count_dispatched },
+    { "avx2-pshufb",    "avx2",     count_dispatched },
+    { "avx512",         "avx512",   count_dispatched },
+    { "positional16",   NULL,       count_positional },
+};
+
+#define STRATEGY_NUM    (sizeof(strategies) / sizeof(strategies[0]))
+
+// From L1-resident to DRAM-resident, capped by the command line.
+static const size_t sizes[] = {
+    16 << 10, 128 << 10, 1 << 20, 8 << 20, 64 << 20, 256 << 20
+};
+
+#define SIZE_NUM        (sizeof(sizes) / sizeof(sizes[0]))
+
+// Percent of set bits.
+static const int densities[] = { 0, 1, 10, 25, 50, 75, 90, 99, 100 };
+
+#define DENSITY_NUM     (sizeof(densities) / sizeof(densities[0]))
+
+// The same densities as perf report sites, one per strategy and density.
+static const char *densityNames[DENSITY_NUM] = {
+    "0%", "1%", "10%", "25%", "50%", "75%", "90%", "99%", "100%"
+};
+
+// Every bit is set with probability `percent` / 100.
+static void fill_density(uint8_t *buffer, size_t length, int percent,
+        uint64_t *state) {
+    size_t pattern = length < PATTERN_BYTES ? length : PATTERN_BYTES;
+    uint64_t threshold = (uint64_t)percent * 65536 / 100;
+    for (size_t idx = 0; idx < pattern; ++idx) {
+        unsigned byte = 0;
+        for (int bit = 0; bit < 8; ++bit)
+            byte |= (unsigned)((xorshift64(state) >> 48) < threshold) << bit;
+        buffer[idx] = (uint8_t)byte;
+    }
+
+    for (size_t idx = pattern; idx < length; idx += pattern)
+        memcpy(buffer + idx, buffer,
+                length - idx < pattern ? length - idx : pattern);
+}
+
+// Best GB/s of `strategy` on `length` bytes, its result goes to `count`.
+// With `COUNT_BITS_PERF` every run is measured as one batch of `density`.
+static double measure(const strategy_t *strategy, const void *buffer,
+        size_t length, const char *density, uint64_t *count) {
+    double best = 0;
+    (void)density;
+    for (int rep = 0; rep < BENCH_REPEAT; ++rep) {
+        size_t iterations = 0;
+        double start = now_seconds(), elapsed;
+        COUNT_BITS_PERF_BEGIN(span);
+        do {
+            *count = strategy->count(buffer, length);
+            ++iterations;
+            elapsed = now_seconds() - start;
+        } while (elapsed < BENCH_MIN_TIME);
+        COUNT_BITS_PERF_END(span, strategy->name, density,
+                (uint64_t)length * iterations);
+
+        double rate = (double)length * iterations / elapsed * 1e-9;
+        if (rate > best)
+            best = rate;
+    }
+
+    return best;
+}
+
+int main(int argc, char *argv[]) {
+    // Usage: count_bits_bench [csv|json] [max MiB], 64 MiB stays out of the
+    // caches of most machines.
+    int json = argc > 1 && 0 == strcmp("json", argv[1]);
+    size_t maxBytes = (argc > 2 ? strtoul(argv[2], NULL, 10) : 64) << 20;
+    if (maxBytes < sizes[0])
+        maxBytes = sizes[0];
+
+    uint8_t *buffer = aligned_alloc(64, maxBytes);
+    if (NULL == buffer) {
+        fprintf(stderr, "Cannot allocate %zu MiB\n", maxBytes >> 20);
+        return 1;
+    }
+
+    for (unsigned idx = 0; idx < 256; ++idx)
+        byteTable[idx] = (uint8_t)count_bit_one(idx);
+
+    const char *defaultKernel = count_bits_kernel();
+    if (json)
+        printf("{\n  \"default_kernel\": \"%s\",\n  \"results\": [",
+                defaultKernel);
+    else
+        printf("strategy,kernel,bytes,density,gbps,ns_per_word,set_bits\n");
+
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    const char *separator = "";
+    for (size_t d = 0; d < DENSITY_NUM; ++d) {
+        fill_density(buffer, maxBytes, densities[d], &state);
+
+        for (size_t s = 0; s < SIZE_NUM && sizes[s] <= maxBytes; ++s) {
+            uint64_t expected = count_bits_buffer(buffer, sizes[s]);
+
+            for (size_t idx = 0; idx < STRATEGY_NUM; ++idx) {
+                const strategy_t *strategy = &strategies[idx];
+                // Strategies outside the dispatch run no kernel, they are
+                // run with the default one set.
+                const char *kernelLabel = NULL != strategy->kernel
+                    ? strategy->kernel : defaultKernel;
+                const char *kernel = 0 == strcmp(kernelLabel, "-")
+                    ? defaultKernel : kernelLabel;
+                // Kernels this CPU does not support are left out.
+                if (0 != count_bits_set_kernel(kernel))
+                    continue;
+
+                uint64_t count;
+                double gbps = measure(strategy, buffer, sizes[s],
+                        densityNames[d], &count);
+                count_bits_set_kernel(defaultKernel);
+                if (count != expected) {
+                    fprintf(stderr, "Mismatch: %s counted %llu, not %llu\n",
+                            strategy->name, (unsigned long long)count,
+                            (unsigned long long)expected);
+                    free(buffer);
+                    return 1;
+                }
+
+                // A 64-bit word is 8 bytes, so ns per word is 8 / (GB/s).
+                double nsPerWord = 8.0 / gbps;
+                if (json)
+                    printf("%s\n    {\"strategy\": \"%s\", \"kernel\": "
+                            "\"%s\", \"bytes\": %zu, \"density\": %d, "
+                            "\"gbps\": %.4f, \"ns_per_word\": %.4f, "
+                            "\"set_bits\": %llu}", separator, strategy->name,
+                            kernelLabel, sizes[s], densities[d], gbps,
+                            nsPerWord, (unsigned long long)count);
+                else
+                    printf("%s,%s,%zu,%d,%.4f,%.4f,%llu\n", strategy->name,
+                            kernelLabel, sizes[s], densities[d], gbps,
+                            nsPerWord, (unsigned long long)count);
+                separator = ",";
+                fflush(stdout);
+            }
+        }
+    }
+
+    if (json)
+        printf("\n  ]\n}\n");
+    COUNT_BITS_PERF_REPORT(stderr);
+
+    free(buffer);
+
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include <bitset>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include "count_bits_bitset.hpp"
+
+// Compared against `std::bitset`, with a size that is not a word multiple.
+constexpr std::size_t kBits = 100003;
+
+static std::uint64_t xorshift64(std::uint64_t &state) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+template < class Bitset >
+static bool same(const Bitset &bits, const std::bitset<kBits> &reference) {
+    if (bits.count() != reference.count())
+        return false;
+    for (std::size_t idx = 0; idx < kBits; ++idx)
+        if (bits.test(idx) != reference.test(idx))
+            return false;
+
+    return true;
+}
+
+static bool check() {
+    std::uint64_t state = 0x9E3779B97F4A7C15ULL;
+    ts::bitset<kBits> a, b;
+    std::bitset<kBits> ra, rb;
+    for (std::size_t idx = 0; idx < kBits; ++idx) {
+        bool bitA = 0 == xorshift64(state) % 3;
+        bool bitB = 0 == xorshift64(state) % 5;
+        a.set(idx, bitA);
+        ra.set(idx, bitA);
+        b.set(idx, bitB);
+        rb.set(idx, bitB);
+    }
+
+    if (!same(a & b, ra & rb) || !same(a | b, ra | rb)
+            || !same(a ^ b, ra ^ rb) || !same(~a, ~ra)
+            || a.count_and(b) != (ra & rb).count()
+            || a.count_xor(b) != (ra ^ rb).count())
+        return false;
+    for (std::size_t shift : { 0, 1, 63, 64, 65, 1000, 99999, 100003 })
+        if (!same(a << shift, ra << shift) || !same(a >> shift, ra >> shift))
+            return false;
+
+    // Every set bit in order, then the same bits through a view.
+    std::size_t pos = a.find_first();
+    for (std::size_t idx = 0; idx < kBits; ++idx) {
+        if (ra.test(idx) != (pos == idx))
+            return false;
+        if (pos == idx)
+            pos = a.find_next(pos);
+    }
+    if (ts::bitset<kBits>::npos != pos)
+        return false;
+
+    ts::dynamic_bitset c(a);
+    ts::const_bitset_view view(c.data(), kBits);
+    c.subtract(b);
+    if (!same(view, ra & ~rb) || view != (a & ~b))
+        return false;
+
+    // Growing by 1s and shrinking keep the unused bits 0.
+    c.resize(kBits + 200, true);
+    c.resize(kBits - 5);
+    c.resize(kBits);
+    return same(c, (ra & ~rb) & ~(std::bitset<kBits>().set() << (kBits - 5)));
+}
+
+int main(int argc, char *argv[]) {
+    if (!check()) {
+        std::fprintf(stderr, "Mismatch against std::bitset\n");
+        return 1;
+    }
+
+    // Bulk operations on two bitsets of `MiB` each.
+    std::size_t bits = (argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 64)
+        << 23;
+    ts::dynamic_bitset a(bits, true), b(bits);
+    for (std::size_t idx = 0; idx < bits; idx += 3)
+        b.set(idx);
+
+    const auto start = std::chrono::steady_clock::now();
+    a ^= b;
+    a <<= 1;
+    const std::size_t count = a.count();
+    const std::size_t first = a.find_first();
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::printf("%zu bits: xor, shift, count (%zu), find_first (%zu) in "
+            "%.3f ms (kernel: %s)\n", bits, count, first,
+            elapsed.count() * 1e3, count_bits_kernel());
+
+    return 0;
+}
@@ -0,0 +1,424 @@
+#ifndef COUNT_BITS_BITSET_HPP
+#define COUNT_BITS_BITSET_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#include "count_bits.h"
+
+/**
+ * @file count_bits_bitset.hpp
+ *
+ * @brief Bitsets over 64-bit words whose bulk operations run on the
+ * dispatched count_bits kernels (C++17, link `count_bits.c`).
+ *
+ * @details `ts::bitset<N>` stores its words inline, `ts::dynamic_bitset` on
+ * the heap, both aligned to 64 bytes so that the kernels never split a cache
+ * line. `ts::bitset_view` and `ts::const_bitset_view` work on borrowed words
+ * without copying them, e.g. a bitmap inside a memory-mapped file.
+ *
+ * Bit `i` is bit `i % 64` of word `i / 64`. The bits past `size()` in the
+ * last word are always 0: every operation relies on it and keeps it so,
+ * memory handed to a view must follow it too.
+ */
+
+namespace ts {
+
+namespace detail {
+
+constexpr std::size_t bitset_words(std::size_t bits) noexcept {
+    return (bits + 63) / 64;
+}
+
+// The bits of the last word that are in use, all of them if it is full.
+constexpr std::uint64_t bitset_tail(std::size_t bits) noexcept {
+    return 0 == bits % 64 ? ~std::uint64_t{0}
+        : (std::uint64_t{1} << (bits % 64)) - 1;
+}
+
+/**
+ * @brief The operations shared by all bitsets and views, `Derived` provides
+ * `data()` and `size()`.
+ *
+ * @details The operands of a binary operation must have the same size, it is
+ * checked by `assert`. Members that write are only instantiated when they
+ * are called, so a view of `const` words simply does not have them.
+ */
+template < class Derived >
+class bitset_base {
+public:
+    static constexpr std::size_t npos = ~std::size_t{0};
+
+    std::size_t word_count() const noexcept {
+        return bitset_words(self().size());
+    }
+
+    bool test(std::size_t pos) const noexcept {
+        assert(pos < self().size());
+        return 0 != (self().data()[pos / 64] >> (pos % 64) & 1);
+    }
+
+    bool operator[](std::size_t pos) const noexcept { return test(pos); }
+
+    Derived &set(std::size_t pos, bool value = true) noexcept {
+        assert(pos < self().size());
+        const std::uint64_t bit = std::uint64_t{1} << (pos % 64);
+        auto &word = self().data()[pos / 64];
+        word = value ? word | bit : word & ~bit;
+        return self();
+    }
+
+    Derived &reset(std::size_t pos) noexcept { return set(pos, false); }
+
+    Derived &flip(std::size_t pos) noexcept {
+        assert(pos < self().size());
+        self().data()[pos / 64] ^= std::uint64_t{1} << (pos % 64);
+        return self();
+    }
+
+    Derived &set() noexcept {
+        std::memset(self().data(), 0xFF, word_count() * 8);
+        return clear_tail();
+    }
+
+    Derived &reset() noexcept {
+        std::memset(self().data(), 0, word_count() * 8);
+        return self();
+    }
+
+    Derived &flip() noexcept {
+        count_bits_not_words(self().data(), self().data(), word_count());
+        return clear_tail();
+    }
+
+    /**
+     * @brief The number of set bits, by `count_bits_buffer`.
+     */
+    std::size_t count() const noexcept {
+        return count_bits_buffer(self().data(), word_count() * 8);
+    }
+
+    bool any() const noexcept { return npos != find_first(); }
+    bool none() const noexcept { return !any(); }
+    bool all() const noexcept { return count() == self().size(); }
+
+    /**
+     * @brief The first set bit, `npos` if there is none.
+     */
+    std::size_t find_first() const noexcept { return find_from(0); }
+
+    /**
+     * @brief The first set bit after `pos`, `npos` if there is none.
+     */
+    std::size_t find_next(std::size_t pos) const noexcept {
+        return pos + 1 < self().size() ? find_from(pos + 1) : npos;
+    }
+
+    template < class Other >
+    Derived &operator&=(const bitset_base<Other> &other) noexcept {
+        count_bits_and_words(self().data(), self().data(), words_of(other),
+                word_count());
+        return self();
+    }
+
+    template < class Other >
+    Derived &operator|=(const bitset_base<Other> &other) noexcept {
+        count_bits_or_words(self().data(), self().data(), words_of(other),
+                word_count());
+        return self();
+    }
+
+    template < class Other >
+    Derived &operator^=(const bitset_base<Other> &other) noexcept {
+        count_bits_xor_words(self().data(), self().data(), words_of(other),
+                word_count());
+        return self();
+    }
+
+    /**
+     * @brief `*this &= ~other`, the set difference.
+     */
+    template < class Other >
+    Derived &subtract(const bitset_base<Other> &other) noexcept {
+        count_bits_andnot_words(self().data(), self().data(),
+                words_of(other), word_count());
+        return self();
+    }
+
+    /**
+     * @brief Move every bit to a higher (`<<=`) or lower (`>>=`) position,
+     * the bits moved past either end are dropped.
+     */
+    Derived &operator<<=(std::size_t shift) noexcept {
+        count_bits_shift_left(self().data(), word_count(), shift);
+        return clear_tail();
+    }
+
+    Derived &operator>>=(std::size_t shift) noexcept {
+        count_bits_shift_right(self().data(), word_count(), shift);
+        return self();
+    }
+
+    /**
+     * @brief The set bits of `*this & other`, `*this | other` and
+     * `*this ^ other` by the fused kernels, nothing is written.
+     */
+    template < class Other >
+    std::size_t count_and(const bitset_base<Other> &other) const noexcept {
+        return count_bits_and(self().data(), words_of(other),
+                word_count() * 8);
+    }
+
+    template < class Other >
+    std::size_t count_or(const bitset_base<Other> &other) const noexcept {
+        return count_bits_or(self().data(), words_of(other),
+                word_count() * 8);
+    }
+
+    template < class Other >
+    std::size_t count_xor(const bitset_base<Other> &other) const noexcept {
+        return count_bits_xor(self().data(), words_of(other),
+                word_count() * 8);
+    }
+
+    template < class Other >
+    bool operator==(const bitset_base<Other> &other) const noexcept {
+        const auto &rhs = static_cast<const Other &>(other);
+        return self().size() == rhs.size() && 0 == std::memcmp(self().data(),
+                rhs.data(), word_count() * 8);
+    }
+
+    template < class Other >
+    bool operator!=(const bitset_base<Other> &other) const noexcept {
+        return !(*this == other);
+    }
+
+protected:
+    Derived &self() noexcept { return static_cast<Derived &>(*this); }
+
+    const Derived &self() const noexcept {
+        return static_cast<const Derived &>(*this);
+    }
+
+    Derived &clear_tail() noexcept {
+        if (0 != word_count())
+            self().data()[word_count() - 1] &= bitset_tail(self().size());
+        return self();
+    }
+
+private:
+    template < class Other >
+    const std::uint64_t *words_of(const bitset_base<Other> &other)
+        const noexcept {
+        const auto &rhs = static_cast<const Other &>(other);
+        assert(self().size() == rhs.size());
+        return rhs.data();
+    }
+
+    std::size_t find_from(std::size_t pos) const noexcept {
+        const std::uint64_t found = count_bits_find_next(self().data(),
+                word_count(), pos);
+        return UINT64_MAX == found ? npos : static_cast<std::size_t>(found);
+    }
+};
+
+} // namespace detail
+
+/**
+ * @brief A view of `size` bits in borrowed words, nothing is copied. A view
+ * of `const` words only reads.
+ */
+template < class Word >
+class basic_bitset_view
+    : public detail::bitset_base<basic_bitset_view<Word>> {
+public:
+    constexpr basic_bitset_view(Word *words, std::size_t size) noexcept
+        : words_(words), size_(size) {}
+
+    // A view of mutable words converts to a view of `const` words.
+    template < class Other >
+    constexpr basic_bitset_view(const basic_bitset_view<Other> &other)
+        noexcept : words_(other.data()), size_(other.size()) {}
+
+    constexpr Word *data() const noexcept { return words_; }
+    constexpr std::size_t size() const noexcept { return size_; }
+
+private:
+    Word            *words_;
+    std::size_t     size_;
+};
+
+using bitset_view = basic_bitset_view<std::uint64_t>;
+using const_bitset_view = basic_bitset_view<const std::uint64_t>;
+
+/**
+ * @brief `N` bits stored inline.
+ */
+template < std::size_t N >
+class bitset : public detail::bitset_base<bitset<N>> {
+public:
+    constexpr bitset() noexcept = default;
+
+    std::uint64_t *data() noexcept { return words_; }
+    const std::uint64_t *data() const noexcept { return words_; }
+    static constexpr std::size_t size() noexcept { return N; }
+
+    bitset_view view() noexcept { return { words_, N }; }
+    const_bitset_view view() const noexcept { return { words_, N }; }
+
+    // The operands are passed by reference, over-aligned by-value arguments
+    // are copied around by the ABI.
+    friend bitset operator&(const bitset &a, const bitset &b) noexcept {
+        return bitset(a) &= b;
+    }
+    friend bitset operator|(const bitset &a, const bitset &b) noexcept {
+        return bitset(a) |= b;
+    }
+    friend bitset operator^(const bitset &a, const bitset &b) noexcept {
+        return bitset(a) ^= b;
+    }
+    friend bitset operator~(const bitset &a) noexcept {
+        return bitset(a).flip();
+    }
+    friend bitset operator<<(const bitset &a, std::size_t shift) noexcept {
+        return bitset(a) <<= shift;
+    }
+    friend bitset operator>>(const bitset &a, std::size_t shift) noexcept {
+        return bitset(a) >>= shift;
+    }
+
+private:
+    // At least one word, so that `data()` is never a zero-length array.
+    alignas(64) std::uint64_t words_[N > 0 ? detail::bitset_words(N) : 1]{};
+};
+
+/**
+ * @brief A bitset sized at runtime, its words are on the heap and padded to
+ * whole cache lines.
+ */
+class dynamic_bitset : public detail::bitset_base<dynamic_bitset> {
+public:
+    dynamic_bitset() noexcept = default;
+
+    /**
+     * @brief `size` bits, all 0 or all 1. Throws `std::bad_alloc`.
+     */
+    explicit dynamic_bitset(std::size_t size, bool value = false) {
+        resize(size, value);
+    }
+
+    // A copy of the bits of any bitset or view.
+    template < class Other >
+    explicit dynamic_bitset(const detail::bitset_base<Other> &other)
+        : dynamic_bitset(static_cast<const Other &>(other).size()) {
+        std::memcpy(words_, static_cast<const Other &>(other).data(),
+                word_count() * 8);
+    }
+
+    dynamic_bitset(const dynamic_bitset &other)
+        : dynamic_bitset(other.view()) {}
+
+    dynamic_bitset(dynamic_bitset &&other) noexcept
+        : words_(std::exchange(other.words_, nullptr)),
+          size_(std::exchange(other.size_, 0)),
+          capacity_(std::exchange(other.capacity_, 0)) {}
+
+    dynamic_bitset &operator=(dynamic_bitset other) noexcept {
+        std::swap(words_, other.words_);
+        std::swap(size_, other.size_);
+        std::swap(capacity_, other.capacity_);
+        return *this;
+    }
+
+    ~dynamic_bitset() { release(words_); }
+
+    std::uint64_t *data() noexcept { return words_; }
+    const std::uint64_t *data() const noexcept { return words_; }
+    std::size_t size() const noexcept { return size_; }
+
+    bitset_view view() noexcept { return { words_, size_ }; }
+    const_bitset_view view() const noexcept { return { words_, size_ }; }
+
+    /**
+     * @brief Change the size, new bits are `value`. The words are reallocated
+     * only if the capacity is exceeded. Throws `std::bad_alloc`.
+     */
+    void resize(std::size_t size, bool value = false) {
+        const std::size_t words = detail::bitset_words(size);
+        if (words > capacity_) {
+            // Whole cache lines, grown by half to amortize repeated calls.
+            std::size_t capacity = (words + 7) / 8 * 8;
+            if (capacity < capacity_ + capacity_ / 2)
+                capacity = (capacity_ + capacity_ / 2 + 7) / 8 * 8;
+            auto *grown = static_cast<std::uint64_t *>(::operator new(
+                        capacity * 8, std::align_val_t{64}));
+            if (nullptr != words_)
+                std::memcpy(grown, words_, word_count() * 8);
+            std::memset(grown + word_count(), 0,
+                    (capacity - word_count()) * 8);
+            release(words_);
+            words_ = grown;
+            capacity_ = capacity;
+        }
+
+        const std::size_t old = size_;
+        if (size < old) {
+            // The dropped bits become the 0 tail of the last word.
+            size_ = size;
+            this->clear_tail();
+            std::memset(words_ + words, 0,
+                    (detail::bitset_words(old) - words) * 8);
+            return;
+        }
+
+        size_ = size;
+        if (value && size > old) {
+            // The rest of the old last word, then whole words.
+            const std::size_t firstWord = (old + 63) / 64;
+            if (0 != old % 64)
+                words_[old / 64] |= ~detail::bitset_tail(old);
+            std::memset(words_ + firstWord, 0xFF, (words - firstWord) * 8);
+            this->clear_tail();
+        }
+    }
+
+    friend dynamic_bitset operator&(dynamic_bitset a,
+            const dynamic_bitset &b) {
+        return std::move(a &= b);
+    }
+    friend dynamic_bitset operator|(dynamic_bitset a,
+            const dynamic_bitset &b) {
+        return std::move(a |= b);
+    }
+    friend dynamic_bitset operator^(dynamic_bitset a,
+            const dynamic_bitset &b) {
+        return std::move(a ^= b);
+    }
+    friend dynamic_bitset operator~(dynamic_bitset a) {
+        return std::move(a.flip());
+    }
+    friend dynamic_bitset operator<<(dynamic_bitset a, std::size_t shift) {
+        return std::move(a <<= shift);
+    }
+    friend dynamic_bitset operator>>(dynamic_bitset a, std::size_t shift) {
+        return std::move(a >>= shift);
+    }
+
+private:
+    static void release(std::uint64_t *words) noexcept {
+        if (nullptr != words)
+            ::operator delete(words, std::align_val_t{64});
+    }
+
+    std::uint64_t   *words_ = nullptr;
+    std::size_t     size_ = 0;
+    std::size_t     capacity_ = 0;      ///< In words, a multiple of 8.
+};
+
+} // namespace ts
+
+#endif // COUNT_BITS_BITSET_HPP
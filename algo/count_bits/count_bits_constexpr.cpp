@@ -0,0 +1,43 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include "count_bits.hpp"
+
+// All of these are folded by the compiler.
+static_assert(0 == ts::popcount(std::uint8_t{0}), "popcount");
+static_assert(8 == ts::popcount(std::uint32_t{0x952D}), "popcount");
+static_assert(64 == ts::popcount(~std::uint64_t{0}), "popcount");
+static_assert(1 == ts::parity(std::uint16_t{0x0106}), "parity");
+static_assert(16 == ts::countl_zero(std::uint16_t{0}), "countl_zero");
+static_assert(3 == ts::countl_zero(std::uint8_t{0x10}), "countl_zero");
+static_assert(4 == ts::countr_zero(std::uint32_t{0x10}), "countr_zero");
+static_assert(0x80 == ts::bit_reverse(std::uint8_t{1}), "bit_reverse");
+static_assert(0xF000 == ts::bit_reverse(std::uint16_t{0x000F}), "bit_reverse");
+
+#ifdef __SIZEOF_INT128__
+constexpr unsigned __int128 kHighBit = static_cast<unsigned __int128>(1) << 127;
+static_assert(1 == ts::popcount(kHighBit), "popcount 128");
+static_assert(0 == ts::countl_zero(kHighBit), "countl_zero 128");
+static_assert(127 == ts::countr_zero(kHighBit), "countr_zero 128");
+static_assert(1 == ts::bit_reverse(kHighBit), "bit_reverse 128");
+#endif
+
+// A byte bit-reversal table, computed at compile time.
+constexpr auto kReverseTable = ts::make_table<std::uint8_t, 256>(
+        [](std::size_t idx) {
+            return ts::bit_reverse(static_cast<std::uint8_t>(idx));
+        });
+static_assert(0x0F == kReverseTable[0xF0], "make_table");
+
+int main(int argc, char *argv[]) {
+    // The same calls at runtime use the intrinsics.
+    std::uint64_t value = argc > 1 ? std::strtoull(argv[1], nullptr, 0)
+        : 0x952D;
+    std::printf("popcount: %d, parity: %d, clz: %d, ctz: %d, "
+            "reverse: 0x%016llx\n", ts::popcount(value), ts::parity(value),
+            ts::countl_zero(value), ts::countr_zero(value),
+            static_cast<unsigned long long>(ts::bit_reverse(value)));
+
+    return 0;
+}
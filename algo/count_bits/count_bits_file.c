@@ -0,0 +1,155 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "count_bits.h"
+
+// Bytes per chunk, a multiple of the page size and of a 2 MiB huge page.
+#define FILE_CHUNK      (8 << 20)
+
+// One thread's state, padded to its own cache line.
+typedef struct {
+    _Alignas(64) uint64_t   count;
+    const uint8_t           *data;
+    size_t                  length;
+    atomic_size_t           *nextChunk;
+} file_task_t;
+
+#ifndef COUNT_BITS_FILE_NO_MAIN
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <file> [threads]\n", argv[0]);
+        return 1;
+    }
+    unsigned threadCount = argc > 2 ? strtoul(argv[2], NULL, 10) : 0;
+
+    struct stat st;
+    uint64_t count;
+    double start = now_seconds();
+    if (0 != stat(argv[1], &st)
+            || 0 != count_bits_file(argv[1], threadCount, &count)) {
+        fprintf(stderr, "Cannot count %s: %s\n", argv[1], strerror(errno));
+        return 1;
+    }
+    double elapsed = now_seconds() - start;
+
+    printf("%s: %llu set bits in %lld bytes, %.3f s, %.3f GB/s "
+            "(kernel: %s)\n", argv[1], (unsigned long long)count,
+            (long long)st.st_size, elapsed, st.st_size / elapsed * 1e-9,
+            count_bits_kernel());
+
+    return 0;
+}
+#endif
+
+static void *file_worker(void *arg) {
+    file_task_t *task = arg;
+    uint64_t count = 0;
+
+    // Chunks are claimed dynamically, slow pages do not stall other threads.
+    for (;;) {
+        size_t chunk = atomic_fetch_add_explicit(task->nextChunk, 1,
+                memory_order_relaxed);
+        size_t offset = chunk * (size_t)FILE_CHUNK;
+        if (offset >= task->length)
+            break;
+
+        size_t length = task->length - offset < FILE_CHUNK
+            ? task->length - offset : FILE_CHUNK;
+        count += count_bits_buffer(task->data + offset, length);
+    }
+    task->count = count;
+
+    return NULL;
+}
+
+int count_bits_file(const char *path, unsigned threadCount, uint64_t *count) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if (0 != fstat(fd, &st)) {
+        close(fd);
+        return -1;
+    }
+
+    *count = 0;
+    size_t length = (size_t)st.st_size;
+    if (0 == length) {
+        close(fd);
+        return 0;
+    }
+
+    uint8_t *data = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == data)
+        return -1;
+
+    // Hints only, failures are ignored.
+    madvise(data, length, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    madvise(data, length, MADV_HUGEPAGE);
+#endif
+
+    if (0 == threadCount)
+        threadCount = (unsigned)sysconf(_SC_NPROCESSORS_ONLN);
+    size_t chunkCount = (length + FILE_CHUNK - 1) / FILE_CHUNK;
+    if (threadCount > chunkCount)
+        threadCount = (unsigned)chunkCount;
+    if (0 == threadCount)
+        threadCount = 1;
+
+    file_task_t *tasks = aligned_alloc(64, threadCount * sizeof(file_task_t));
+    pthread_t *threads = calloc(threadCount, sizeof(pthread_t));
+    if (NULL == tasks || NULL == threads) {
+        free(tasks);
+        free(threads);
+        munmap(data, length);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    atomic_size_t nextChunk = 0;
+    for (unsigned idx = 0; idx < threadCount; ++idx) {
+        tasks[idx].count = 0;
+        tasks[idx].data = data;
+        tasks[idx].length = length;
+        tasks[idx].nextChunk = &nextChunk;
+    }
+
+    // The calling thread is worker 0, a thread that cannot be started just
+    // leaves its chunks to the others.
+    unsigned started = 1;
+    for (; started < threadCount; ++started)
+        if (0 != pthread_create(&threads[started], NULL, file_worker,
+                    &tasks[started]))
+            break;
+    file_worker(&tasks[0]);
+    for (unsigned idx = 1; idx < started; ++idx)
+        pthread_join(threads[idx], NULL);
+
+    for (unsigned idx = 0; idx < started; ++idx)
+        *count += tasks[idx].count;
+
+    free(threads);
+    free(tasks);
+    munmap(data, length);
+
+    return 0;
+}
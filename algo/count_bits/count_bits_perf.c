@@ -0,0 +1,291 @@
+#define _GNU_SOURCE
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef COUNT_BITS_PERF
+#define COUNT_BITS_PERF
+#endif
+#include "count_bits_perf.h"
+
+// Sites kept, further ones are not recorded.
+#define PERF_SITES      256
+
+#define CACHE_EVENT(cache, op, result) \
+    ((cache) | (op) << 8 | (result) << 16)
+
+// The events in `COUNT_BITS_PERF_*` order.
+static const struct {
+    uint32_t        type;
+    uint64_t        config;
+} perfEvents[COUNT_BITS_PERF_EVENTS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D,
+            PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+};
+
+static const char *eventNames[COUNT_BITS_PERF_EVENTS] = {
+    "cycles", "instructions", "branches", "branch-misses", "L1D-misses",
+    "LLC-misses"
+};
+
+/**
+ * @brief The counter group of one thread, opened by its first span.
+ *
+ * @details The group counts user space only and is never stopped, a span
+ * reads all of it with one `read` at either end.
+ */
+typedef struct {
+    int             fds[COUNT_BITS_PERF_EVENTS];    ///< -1 if not opened.
+    unsigned        slots[COUNT_BITS_PERF_EVENTS];  ///< Index in the read.
+    unsigned        count;                          ///< Events in the group.
+    int             opened;
+    unsigned        depth;                          ///< Spans in progress.
+} perf_thread_t;
+
+typedef struct {
+    const char          *kernel;
+    const char          *call;
+    count_bits_perf_t   perf;
+} perf_site_t;
+
+static _Thread_local perf_thread_t perfThread;
+
+static perf_site_t perfSites[PERF_SITES];
+static unsigned siteCount;
+static pthread_mutex_t siteLock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned openedEvents;
+
+static pthread_key_t threadKey;
+static pthread_once_t threadKeyOnce = PTHREAD_ONCE_INIT;
+
+static void close_group(void *arg) {
+    perf_thread_t *thread = arg;
+    for (unsigned idx = 0; idx < COUNT_BITS_PERF_EVENTS; ++idx)
+        if (thread->fds[idx] >= 0)
+            close(thread->fds[idx]);
+}
+
+static void create_key(void) {
+    pthread_key_create(&threadKey, close_group);
+}
+
+// The first event that opens leads the group, the others join it.
+static void open_group(perf_thread_t *thread) {
+    int leader = -1;
+    thread->count = 0;
+    thread->opened = 1;
+
+    for (unsigned idx = 0; idx < COUNT_BITS_PERF_EVENTS; ++idx) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = perfEvents[idx].type;
+        attr.config = perfEvents[idx].config;
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+        thread->fds[idx] = fd;
+        if (fd < 0)
+            continue;
+        if (leader < 0)
+            leader = fd;
+        thread->slots[idx] = thread->count++;
+        __atomic_fetch_or(&openedEvents, 1u << idx, __ATOMIC_RELAXED);
+    }
+
+    if (leader >= 0) {
+        pthread_once(&threadKeyOnce, create_key);
+        pthread_setspecific(threadKey, thread);
+    }
+}
+
+// The current value of every event, 0 for the ones that did not open.
+static void read_group(perf_thread_t *thread, uint64_t *events) {
+    uint64_t values[1 + COUNT_BITS_PERF_EVENTS] = { 0 };
+    int leader = -1;
+    for (unsigned idx = 0; idx < COUNT_BITS_PERF_EVENTS && leader < 0; ++idx)
+        leader = thread->fds[idx];
+
+    if (leader < 0 || read(leader, values, sizeof(values))
+            != (ssize_t)((1 + thread->count) * sizeof(uint64_t)))
+        memset(values, 0, sizeof(values));
+
+    for (unsigned idx = 0; idx < COUNT_BITS_PERF_EVENTS; ++idx)
+        events[idx] = thread->fds[idx] >= 0
+            ? values[1 + thread->slots[idx]] : 0;
+}
+
+static uint64_t now_nanoseconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// The site of (`kernel`, `call`), created if needed, NULL if the table is
+// full.
+static perf_site_t *find_site(const char *kernel, const char *call) {
+    unsigned count = __atomic_load_n(&siteCount, __ATOMIC_ACQUIRE);
+    for (unsigned idx = 0; idx < count; ++idx)
+        if (perfSites[idx].kernel == kernel && perfSites[idx].call == call)
+            return &perfSites[idx];
+    for (unsigned idx = 0; idx < count; ++idx)
+        if (0 == strcmp(perfSites[idx].kernel, kernel)
+                && 0 == strcmp(perfSites[idx].call, call))
+            return &perfSites[idx];
+
+    perf_site_t *site = NULL;
+    pthread_mutex_lock(&siteLock);
+    // Another thread may have added it in the meantime.
+    for (unsigned idx = count; idx < siteCount && NULL == site; ++idx)
+        if (0 == strcmp(perfSites[idx].kernel, kernel)
+                && 0 == strcmp(perfSites[idx].call, call))
+            site = &perfSites[idx];
+    if (NULL == site && siteCount < PERF_SITES) {
+        site = &perfSites[siteCount];
+        site->kernel = kernel;
+        site->call = call;
+        __atomic_store_n(&siteCount, siteCount + 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&siteLock);
+
+    return site;
+}
+
+void count_bits_perf_begin(count_bits_perf_span_t *span) {
+    perf_thread_t *thread = &perfThread;
+    span->outer = 0 == thread->depth++;
+    if (!span->outer)
+        return;
+
+    if (!thread->opened)
+        open_group(thread);
+    span->nanoseconds = now_nanoseconds();
+    read_group(thread, span->events);
+}
+
+void count_bits_perf_end(count_bits_perf_span_t *span, const char *kernel,
+        const char *call, uint64_t bytes) {
+    perf_thread_t *thread = &perfThread;
+    --thread->depth;
+    if (!span->outer)
+        return;
+
+    uint64_t events[COUNT_BITS_PERF_EVENTS];
+    read_group(thread, events);
+    uint64_t nanoseconds = now_nanoseconds() - span->nanoseconds;
+
+    perf_site_t *site = find_site(kernel, call);
+    if (NULL == site)
+        return;
+    __atomic_fetch_add(&site->perf.calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&site->perf.bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&site->perf.nanoseconds, nanoseconds,
+            __ATOMIC_RELAXED);
+    for (unsigned idx = 0; idx < COUNT_BITS_PERF_EVENTS; ++idx)
+        __atomic_fetch_add(&site->perf.events[idx],
+                events[idx] - span->events[idx], __ATOMIC_RELAXED);
+}
+
+int count_bits_perf_get(const char *kernel, const char *call,
+        count_bits_perf_t *perf) {
+    unsigned count = __atomic_load_n(&siteCount, __ATOMIC_ACQUIRE);
+    for (unsigned idx = 0; idx < count; ++idx) {
+        const perf_site_t *site = &perfSites[idx];
+        if (0 != strcmp(site->kernel, kernel) || 0 != strcmp(site->call, call))
+            continue;
+
+        perf->calls = __atomic_load_n(&site->perf.calls, __ATOMIC_RELAXED);
+        perf->bytes = __atomic_load_n(&site->perf.bytes, __ATOMIC_RELAXED);
+        perf->nanoseconds = __atomic_load_n(&site->perf.nanoseconds,
+                __ATOMIC_RELAXED);
+        for (unsigned event = 0; event < COUNT_BITS_PERF_EVENTS; ++event)
+            perf->events[event] = __atomic_load_n(&site->perf.events[event],
+                    __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    return -1;
+}
+
+unsigned count_bits_perf_events(void) {
+    return __atomic_load_n(&openedEvents, __ATOMIC_RELAXED);
+}
+
+// `numerator / denominator` in a column of `width`, "-" if an event is
+// missing or nothing was counted.
+static void print_ratio(FILE *stream, int width, int precision,
+        int available, double numerator, double denominator) {
+    if (available && 0 != denominator)
+        fprintf(stream, " %*.*f", width, precision, numerator / denominator);
+    else
+        fprintf(stream, " %*s", width, "-");
+}
+
+void count_bits_perf_report(FILE *stream) {
+    unsigned events = count_bits_perf_events();
+    unsigned count = __atomic_load_n(&siteCount, __ATOMIC_ACQUIRE);
+
+    fprintf(stream, "%-12s %-12s %10s %12s %12s %8s %6s %8s %13s %13s\n",
+            "kernel", "call", "calls", "ns/call", "cycles/call", "cycles/B",
+            "IPC", "br-miss%", "L1D-miss/call", "LLC-miss/call");
+    for (unsigned idx = 0; idx < count; ++idx) {
+        count_bits_perf_t perf;
+        if (0 != count_bits_perf_get(perfSites[idx].kernel,
+                    perfSites[idx].call, &perf) || 0 == perf.calls)
+            continue;
+
+        const uint64_t *e = perf.events;
+        fprintf(stream, "%-12s %-12s %10llu", perfSites[idx].kernel,
+                perfSites[idx].call, (unsigned long long)perf.calls);
+        print_ratio(stream, 12, 1, 1, perf.nanoseconds, perf.calls);
+        print_ratio(stream, 12, 1, events >> COUNT_BITS_PERF_CYCLES & 1,
+                e[COUNT_BITS_PERF_CYCLES], perf.calls);
+        print_ratio(stream, 8, 3, events >> COUNT_BITS_PERF_CYCLES & 1,
+                e[COUNT_BITS_PERF_CYCLES], perf.bytes);
+        print_ratio(stream, 6, 2, (events >> COUNT_BITS_PERF_CYCLES & 1)
+                && (events >> COUNT_BITS_PERF_INSTRUCTIONS & 1),
+                e[COUNT_BITS_PERF_INSTRUCTIONS], e[COUNT_BITS_PERF_CYCLES]);
+        print_ratio(stream, 8, 2, (events >> COUNT_BITS_PERF_BRANCHES & 1)
+                && (events >> COUNT_BITS_PERF_BRANCH_MISSES & 1),
+                100.0 * e[COUNT_BITS_PERF_BRANCH_MISSES],
+                e[COUNT_BITS_PERF_BRANCHES]);
+        print_ratio(stream, 13, 1, events >> COUNT_BITS_PERF_L1D_MISSES & 1,
+                e[COUNT_BITS_PERF_L1D_MISSES], perf.calls);
+        print_ratio(stream, 13, 1, events >> COUNT_BITS_PERF_LLC_MISSES & 1,
+                e[COUNT_BITS_PERF_LLC_MISSES], perf.calls);
+        fputc('\n', stream);
+    }
+
+    if (events != (1u << COUNT_BITS_PERF_EVENTS) - 1) {
+        fprintf(stream, "Not available:");
+        for (unsigned idx = 0; idx < COUNT_BITS_PERF_EVENTS; ++idx)
+            if (!(events >> idx & 1))
+                fprintf(stream, " %s", eventNames[idx]);
+        fprintf(stream, " (no PMU, or perf_event_paranoid is too high)\n");
+    }
+}
+
+void count_bits_perf_reset(void) {
+    unsigned count = __atomic_load_n(&siteCount, __ATOMIC_ACQUIRE);
+    for (unsigned idx = 0; idx < count; ++idx) {
+        count_bits_perf_t *perf = &perfSites[idx].perf;
+        __atomic_store_n(&perf->calls, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&perf->bytes, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&perf->nanoseconds, 0, __ATOMIC_RELAXED);
+        for (unsigned event = 0; event < COUNT_BITS_PERF_EVENTS; ++event)
+            __atomic_store_n(&perf->events[event], 0, __ATOMIC_RELAXED);
+    }
+}
@@ -0,0 +1,110 @@
+#ifndef COUNT_BITS_PERF_H
+#define COUNT_BITS_PERF_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Hardware counters around the count_bits kernels, built only with
+ * `-DCOUNT_BITS_PERF` (and `count_bits_perf.c` linked in). Without it the
+ * macros below expand to nothing and no code or data is left behind.
+ *
+ * Every measured call is accumulated under its site, a (kernel, call) pair
+ * such as ("avx2", "count") or ("kernighan", "and_or"). A span inside
+ * another one on the same thread is not measured on its own, so wrapping a
+ * loop of calls gives the numbers per batch instead of per call.
+ */
+
+/**
+ * @brief The events of a site, in the order of `count_bits_perf_t::events`.
+ */
+enum {
+    COUNT_BITS_PERF_CYCLES,
+    COUNT_BITS_PERF_INSTRUCTIONS,
+    COUNT_BITS_PERF_BRANCHES,
+    COUNT_BITS_PERF_BRANCH_MISSES,
+    COUNT_BITS_PERF_L1D_MISSES,             ///< L1 data cache read misses.
+    COUNT_BITS_PERF_LLC_MISSES,
+    COUNT_BITS_PERF_EVENTS
+};
+
+/**
+ * @brief The totals of one site.
+ */
+typedef struct {
+    uint64_t        calls;
+    uint64_t        bytes;
+    uint64_t        nanoseconds;
+    uint64_t        events[COUNT_BITS_PERF_EVENTS];
+} count_bits_perf_t;
+
+#ifdef COUNT_BITS_PERF
+
+/**
+ * @brief A measurement in progress, lives on the stack of the caller.
+ */
+typedef struct {
+    uint64_t        events[COUNT_BITS_PERF_EVENTS];
+    uint64_t        nanoseconds;
+    int             outer;                  ///< 0 inside another span.
+} count_bits_perf_span_t;
+
+void count_bits_perf_begin(count_bits_perf_span_t *span);
+
+/**
+ * @brief Add the counters since `count_bits_perf_begin` to the site
+ * (`kernel`, `call`). Both strings must outlive the program, e.g. literals.
+ */
+void count_bits_perf_end(count_bits_perf_span_t *span, const char *kernel,
+        const char *call, uint64_t bytes);
+
+/**
+ * @brief Copy the totals of a site.
+ *
+ * @return 0 on success, -1 if the site has not been measured.
+ */
+int count_bits_perf_get(const char *kernel, const char *call,
+        count_bits_perf_t *perf);
+
+/**
+ * @brief A bit per event that could be opened, `1 << COUNT_BITS_PERF_*`.
+ * Events the kernel or the (virtual) machine does not provide stay 0.
+ */
+unsigned count_bits_perf_events(void);
+
+/**
+ * @brief Print a table of every site: calls, cycles and nanoseconds per
+ * call, cycles per byte, IPC, branch miss rate and cache misses per call.
+ */
+void count_bits_perf_report(FILE *stream);
+
+/**
+ * @brief Clear the totals of every site.
+ */
+void count_bits_perf_reset(void);
+
+#define COUNT_BITS_PERF_BEGIN(span) \
+    count_bits_perf_span_t span; \
+    count_bits_perf_begin(&span)
+#define COUNT_BITS_PERF_END(span, kernel, call, bytes) \
+    count_bits_perf_end(&span, kernel, call, bytes)
+#define COUNT_BITS_PERF_REPORT(stream)  count_bits_perf_report(stream)
+
+#else
+
+#define COUNT_BITS_PERF_BEGIN(span)
+#define COUNT_BITS_PERF_END(span, kernel, call, bytes)
+#define COUNT_BITS_PERF_REPORT(stream)
+
+#endif // COUNT_BITS_PERF
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // COUNT_BITS_PERF_H
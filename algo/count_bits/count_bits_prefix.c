@@ -0,0 +1,213 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "count_bits.h"
+
+// Words per chunk (8 MiB), rounded down to whole blocks.
+#define PREFIX_CHUNK    (1 << 20)
+
+// One thread's state, padded to its own cache line.
+typedef struct {
+    _Alignas(64) const uint8_t  *bitmap;
+    size_t                      wordCount;
+    size_t                      blockWords;
+    size_t                      chunkWords;
+    uint64_t                    *ranks;
+    uint64_t                    *chunkTotals;   ///< Offsets in pass 2.
+    int                         pass;
+    atomic_size_t               *nextChunk;
+} prefix_task_t;
+
+#ifndef COUNT_BITS_PREFIX_NO_MAIN
+#define BENCH_REPEAT    3
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char *argv[]) {
+    // Usage: count_bits_prefix [MiB] [block words] [threads]
+    size_t mebibytes = argc > 1 ? strtoul(argv[1], NULL, 10) : 1024;
+    size_t blockWords = argc > 2 ? strtoul(argv[2], NULL, 10) : 1;
+    unsigned threadCount = argc > 3 ? strtoul(argv[3], NULL, 10) : 0;
+    size_t wordCount = mebibytes << 17;
+    if (0 == blockWords)
+        blockWords = 1;
+    size_t rankCount = (wordCount + blockWords - 1) / blockWords;
+
+    uint64_t *bitmap = aligned_alloc(64, wordCount * sizeof(uint64_t));
+    uint64_t *ranks = aligned_alloc(64, (rankCount + 7) / 8 * 64);
+    if (NULL == bitmap || NULL == ranks) {
+        fprintf(stderr, "Cannot allocate %zu MiB\n", mebibytes);
+        return 1;
+    }
+
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    for (size_t idx = 0; idx < wordCount; ++idx) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        bitmap[idx] = state;
+    }
+    // Touch the ranks once, page faults are not part of the measurement.
+    memset(ranks, 0, rankCount * sizeof(uint64_t));
+
+    double bestCount = 1e30, bestPrefix = 1e30;
+    uint64_t count = 0, total = 0;
+    for (int rep = 0; rep < BENCH_REPEAT; ++rep) {
+        double start = now_seconds();
+        count = count_bits_buffer(bitmap, wordCount * sizeof(uint64_t));
+        double mid = now_seconds();
+        if (0 != count_bits_prefix_parallel(bitmap, wordCount, blockWords,
+                    ranks, threadCount, &total)) {
+            fprintf(stderr, "Cannot start the threads\n");
+            return 1;
+        }
+        double end = now_seconds();
+
+        if (mid - start < bestCount)
+            bestCount = mid - start;
+        if (end - mid < bestPrefix)
+            bestPrefix = end - mid;
+    }
+
+    // Every rank is the previous one plus the popcount of its block.
+    for (size_t idx = 0; idx < rankCount; ++idx) {
+        size_t words = wordCount - idx * blockWords < blockWords
+            ? wordCount - idx * blockWords : blockWords;
+        uint64_t next = idx + 1 < rankCount ? ranks[idx + 1] : total;
+        if (next - ranks[idx] != count_bits_buffer(bitmap + idx * blockWords,
+                    words * sizeof(uint64_t)) || (0 == idx && 0 != ranks[0])) {
+            fprintf(stderr, "Rank %zu is wrong\n", idx);
+            return 1;
+        }
+    }
+    if (count != total) {
+        fprintf(stderr, "Mismatch: total %llu, buffer %llu\n",
+                (unsigned long long)total, (unsigned long long)count);
+        return 1;
+    }
+
+    size_t bytes = wordCount * sizeof(uint64_t);
+    printf("%zu MiB, %zu ranks of %zu words (kernel: %s)\n", mebibytes,
+            rankCount, blockWords, count_bits_kernel());
+    printf("count_bits_buffer, 1 thread: %8.3f GB/s\n",
+            bytes / bestCount * 1e-9);
+    printf("count_bits_prefix_parallel:  %8.3f GB/s of bitmap, "
+            "%.3f GB/s of ranks\n", bytes / bestPrefix * 1e-9,
+            rankCount * sizeof(uint64_t) / bestPrefix * 1e-9);
+
+    free(ranks);
+    free(bitmap);
+
+    return 0;
+}
+#endif
+
+static void *prefix_worker(void *arg) {
+    prefix_task_t *task = arg;
+
+    for (;;) {
+        size_t chunk = atomic_fetch_add_explicit(task->nextChunk, 1,
+                memory_order_relaxed);
+        size_t first = chunk * task->chunkWords;
+        if (first >= task->wordCount)
+            break;
+
+        size_t words = task->wordCount - first < task->chunkWords
+            ? task->wordCount - first : task->chunkWords;
+        const uint8_t *bytes = task->bitmap + first * sizeof(uint64_t);
+        if (1 == task->pass)
+            task->chunkTotals[chunk] = count_bits_buffer(bytes,
+                    words * sizeof(uint64_t));
+        else
+            count_bits_prefix(bytes, words, task->blockWords,
+                    task->chunkTotals[chunk],
+                    task->ranks + first / task->blockWords);
+    }
+
+    return NULL;
+}
+
+// One pass over all chunks, the calling thread is worker 0.
+static void run_pass(prefix_task_t *tasks, pthread_t *threads,
+        unsigned threadCount, int pass, atomic_size_t *nextChunk) {
+    atomic_store(nextChunk, 0);
+    for (unsigned idx = 0; idx < threadCount; ++idx)
+        tasks[idx].pass = pass;
+
+    // A thread that cannot be started leaves its chunks to the others.
+    unsigned started = 1;
+    for (; started < threadCount; ++started)
+        if (0 != pthread_create(&threads[started], NULL, prefix_worker,
+                    &tasks[started]))
+            break;
+    prefix_worker(&tasks[0]);
+    for (unsigned idx = 1; idx < started; ++idx)
+        pthread_join(threads[idx], NULL);
+}
+
+int count_bits_prefix_parallel(const void *bitmap, size_t wordCount,
+        size_t blockWords, uint64_t *ranks, unsigned threadCount,
+        uint64_t *total) {
+    size_t chunkWords = PREFIX_CHUNK / blockWords * blockWords;
+    if (0 == chunkWords)
+        chunkWords = blockWords;
+    size_t chunkCount = (wordCount + chunkWords - 1) / chunkWords;
+
+    if (0 == threadCount)
+        threadCount = (unsigned)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threadCount > chunkCount)
+        threadCount = (unsigned)chunkCount;
+    if (0 == threadCount)
+        threadCount = 1;
+
+    prefix_task_t *tasks = aligned_alloc(64,
+            threadCount * sizeof(prefix_task_t));
+    pthread_t *threads = calloc(threadCount, sizeof(pthread_t));
+    uint64_t *chunkTotals = malloc((chunkCount + 1) * sizeof(uint64_t));
+    if (NULL == tasks || NULL == threads || NULL == chunkTotals) {
+        free(tasks);
+        free(threads);
+        free(chunkTotals);
+        return -1;
+    }
+
+    atomic_size_t nextChunk;
+    for (unsigned idx = 0; idx < threadCount; ++idx) {
+        tasks[idx].bitmap = bitmap;
+        tasks[idx].wordCount = wordCount;
+        tasks[idx].blockWords = blockWords;
+        tasks[idx].chunkWords = chunkWords;
+        tasks[idx].ranks = ranks;
+        tasks[idx].chunkTotals = chunkTotals;
+        tasks[idx].nextChunk = &nextChunk;
+    }
+
+    run_pass(tasks, threads, threadCount, 1, &nextChunk);
+
+    // Exclusive scan of the chunk totals, a few thousand at most.
+    uint64_t offset = 0;
+    for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+        uint64_t count = chunkTotals[chunk];
+        chunkTotals[chunk] = offset;
+        offset += count;
+    }
+    *total = offset;
+
+    run_pass(tasks, threads, threadCount, 2, &nextChunk);
+
+    free(chunkTotals);
+    free(threads);
+    free(tasks);
+
+    return 0;
+}
@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "count_bits.h"
+#include "rank_select.h"
+
+#define BASIC_BITS      512
+#define ENTRY_BITS      2048
+#define ENTRY_WORDS     (ENTRY_BITS / 64)
+#define UPPER_SHIFT     32
+#define ENTRIES_SHIFT   (UPPER_SHIFT - 11)
+
+#ifndef RANK_SELECT_NO_MAIN
+#define QUERY_NUM       (1 << 22)
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t xorshift64(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+int main(int argc, char *argv[]) {
+    // Bitvector size in Mibit, 1 Gibit by default.
+    uint64_t bitCount = (argc > 1 ? strtoull(argv[1], NULL, 10) : 1024) << 20;
+    size_t wordCount = (bitCount + 63) / 64;
+
+    uint64_t *bits = malloc(wordCount * sizeof(uint64_t));
+    uint64_t *positions = malloc(QUERY_NUM * sizeof(uint64_t));
+    if (NULL == bits || NULL == positions) {
+        fprintf(stderr, "Cannot allocate the bitvector\n");
+        return 1;
+    }
+
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    for (size_t idx = 0; idx < wordCount; ++idx)
+        bits[idx] = xorshift64(&state);
+    if (0 != bitCount % 64)
+        bits[wordCount - 1] &= (1ULL << (bitCount % 64)) - 1;
+
+    rank_select_t rs;
+    double start = now_seconds();
+    if (0 != rank_select_build(&rs, bits, bitCount)) {
+        fprintf(stderr, "Cannot build the directory\n");
+        return 1;
+    }
+    double buildTime = now_seconds() - start;
+
+    printf("Bits: %llu, ones: %llu, overhead: %.3f%%\n",
+            (unsigned long long)bitCount, (unsigned long long)rs.oneCount,
+            100.0 * rank_select_size(&rs) / (wordCount * sizeof(uint64_t)));
+    printf("Build:  %8.3f s (%.3f GB/s)\n", buildTime,
+            wordCount * sizeof(uint64_t) / buildTime * 1e-9);
+
+    // Random rank queries, checked against select.
+    for (size_t idx = 0; idx < QUERY_NUM; ++idx)
+        positions[idx] = xorshift64(&state) % (bitCount + 1);
+
+    uint64_t checksum = 0;
+    start = now_seconds();
+    for (size_t idx = 0; idx < QUERY_NUM; ++idx)
+        checksum += rank_select_rank1(&rs, positions[idx]);
+    double rankTime = now_seconds() - start;
+
+    printf("rank1:  %8.2f ns/query\n", rankTime / QUERY_NUM * 1e9);
+
+    // Select needs a set bit, there is none to query in an empty bitvector.
+    if (0 == rs.oneCount) {
+        printf("select1: no set bits (checksum %llu)\n",
+                (unsigned long long)checksum);
+        rank_select_free(&rs);
+        free(positions);
+        free(bits);
+        return 0;
+    }
+
+    for (size_t idx = 0; idx < QUERY_NUM; ++idx)
+        positions[idx] = xorshift64(&state) % rs.oneCount;
+
+    start = now_seconds();
+    for (size_t idx = 0; idx < QUERY_NUM; ++idx)
+        checksum += rank_select_select1(&rs, positions[idx]);
+    double selectTime = now_seconds() - start;
+
+    for (size_t idx = 0; idx < 1024; ++idx) {
+        uint64_t k = positions[idx];
+        uint64_t pos = rank_select_select1(&rs, k);
+        if (rank_select_rank1(&rs, pos) != k
+                || rank_select_rank1(&rs, pos + 1) != k + 1) {
+            fprintf(stderr, "Mismatch at select1(%llu) = %llu\n",
+                    (unsigned long long)k, (unsigned long long)pos);
+            return 1;
+        }
+    }
+
+    printf("select1:%8.2f ns/query (checksum %llu)\n",
+            selectTime / QUERY_NUM * 1e9, (unsigned long long)checksum);
+
+    rank_select_free(&rs);
+    free(positions);
+    free(bits);
+
+    return 0;
+}
+#endif
+
+// Ones before lower block `entry`, from the beginning of the bitvector.
+static inline uint64_t entry_rank(const rank_select_t *rs, size_t entry) {
+    return rs->upper[entry >> ENTRIES_SHIFT] + (uint32_t)rs->entries[entry];
+}
+
+// Popcount of basic block `block` (0 to 2) stored in `entry`.
+static inline uint64_t basic_count(uint64_t entry, unsigned block) {
+    return (entry >> (32 + 10 * block)) & 0x3FF;
+}
+
+// Popcount of the 8 words of the basic block from word `first`, inline:
+// one `count_bits_buffer` call per block would cost more than its counting.
+static inline uint64_t basic_block_count(const uint64_t *bits, size_t first,
+        size_t wordCount) {
+    if (first + 8 <= wordCount) {
+        const uint64_t *word = bits + first;
+        return (uint64_t)(count_bits_word(word[0]) + count_bits_word(word[1]))
+            + (count_bits_word(word[2]) + count_bits_word(word[3]))
+            + (count_bits_word(word[4]) + count_bits_word(word[5]))
+            + (count_bits_word(word[6]) + count_bits_word(word[7]));
+    }
+
+    uint64_t count = 0;
+    for (size_t idx = first; idx < wordCount; ++idx)
+        count += count_bits_word(bits[idx]);
+    return count;
+}
+
+int rank_select_build(rank_select_t *rs, const uint64_t *bits,
+        uint64_t bitCount) {
+    size_t wordCount = (bitCount + 63) / 64;
+
+    rs->bits = bits;
+    rs->bitCount = bitCount;
+    rs->upperCount = (bitCount >> UPPER_SHIFT) + 1;
+    rs->entryCount = bitCount / ENTRY_BITS + 1;
+    rs->upper = malloc(rs->upperCount * sizeof(uint64_t));
+    rs->entries = malloc(rs->entryCount * sizeof(uint64_t));
+    rs->samples = NULL;
+    if (NULL == rs->upper || NULL == rs->entries) {
+        rank_select_free(rs);
+        return -1;
+    }
+
+    // Lower block entries, one count per basic block.
+    uint64_t total = 0;
+    for (size_t entry = 0; entry < rs->entryCount; ++entry) {
+        if (0 == (entry & ((1ULL << ENTRIES_SHIFT) - 1)))
+            rs->upper[entry >> ENTRIES_SHIFT] = total;
+
+        uint64_t value = total - rs->upper[entry >> ENTRIES_SHIFT];
+        for (unsigned block = 0; block < ENTRY_BITS / BASIC_BITS; ++block) {
+            size_t first = entry * ENTRY_WORDS + block * 8;
+            uint64_t count = basic_block_count(bits, first, wordCount);
+
+            if (block < 3)
+                value |= count << (32 + 10 * block);
+            total += count;
+        }
+        rs->entries[entry] = value;
+    }
+    rs->oneCount = total;
+
+    // Select samples, the entry of every `RANK_SELECT_SAMPLE`-th one.
+    rs->sampleCount = (total + RANK_SELECT_SAMPLE - 1) / RANK_SELECT_SAMPLE;
+    rs->samples = malloc((rs->sampleCount + 1) * sizeof(uint32_t));
+    if (NULL == rs->samples) {
+        rank_select_free(rs);
+        return -1;
+    }
+
+    size_t sample = 0;
+    for (size_t entry = 0; entry + 1 < rs->entryCount; ++entry)
+        while (sample < rs->sampleCount
+                && entry_rank(rs, entry + 1) > sample * RANK_SELECT_SAMPLE)
+            rs->samples[sample++] = (uint32_t)entry;
+    while (sample < rs->sampleCount)
+        rs->samples[sample++] = (uint32_t)(rs->entryCount - 1);
+
+    return 0;
+}
+
+void rank_select_free(rank_select_t *rs) {
+    free(rs->upper);
+    free(rs->entries);
+    free(rs->samples);
+    rs->upper = NULL;
+    rs->entries = NULL;
+    rs->samples = NULL;
+}
+
+uint64_t rank_select_rank1(const rank_select_t *rs, uint64_t pos) {
+    size_t entryIdx = pos / ENTRY_BITS;
+    uint64_t entry = rs->entries[entryIdx];
+    uint64_t rank = entry_rank(rs, entryIdx);
+
+    unsigned block = (pos / BASIC_BITS) % 4;
+    for (unsigned idx = 0; idx < block; ++idx)
+        rank += basic_count(entry, idx);
+
+    // Whole words and the partial word inside the basic block.
+    const uint64_t *word = rs->bits + pos / BASIC_BITS * 8;
+    const uint64_t *end = rs->bits + pos / 64;
+    for (; word < end; ++word)
+        rank += count_bits_word(*word);
+    if (0 != pos % 64)
+        rank += count_bits_word(*word & ((1ULL << (pos % 64)) - 1));
+
+    return rank;
+}
+
+uint64_t rank_select_select1(const rank_select_t *rs, uint64_t k) {
+    // The last entry with `entry_rank <= k`, between two samples.
+    size_t sample = k / RANK_SELECT_SAMPLE;
+    size_t lo = rs->samples[sample];
+    size_t hi = sample + 1 < rs->sampleCount
+        ? rs->samples[sample + 1] : rs->entryCount - 1;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo + 1) / 2;
+        if (entry_rank(rs, mid) <= k)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    k -= entry_rank(rs, lo);
+    uint64_t entry = rs->entries[lo];
+    unsigned block = 0;
+    for (; block < 3 && k >= basic_count(entry, block); ++block)
+        k -= basic_count(entry, block);
+
+    size_t word = lo * ENTRY_WORDS + block * 8;
+    for (uint64_t count; k >= (count = count_bits_word(rs->bits[word]));
+            ++word)
+        k -= count;
+
+    return word * 64 + count_bits_select_word(rs->bits[word], (uint32_t)k);
+}
+
+size_t rank_select_size(const rank_select_t *rs) {
+    return rs->upperCount * sizeof(uint64_t)
+        + rs->entryCount * sizeof(uint64_t)
+        + rs->sampleCount * sizeof(uint32_t);
+}
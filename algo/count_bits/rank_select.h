@@ -0,0 +1,75 @@
+#ifndef RANK_SELECT_H
+#define RANK_SELECT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Rank/select directory over a borrowed bitvector (poppy layout).
+ *
+ * @details The bits are split into 512-bit basic blocks (one cache line).
+ * Four basic blocks form a lower block, described by one interleaved 64-bit
+ * entry: the low 32 bits are the number of ones before the lower block within
+ * its 2^32-bit upper block, the next three 10-bit fields are the popcounts of
+ * the first three basic blocks. Upper blocks store absolute 64-bit counts. The
+ * space overhead is 64 / 2048 = 3.125% plus a select sample every
+ * `RANK_SELECT_SAMPLE` ones.
+ */
+typedef struct {
+    const uint64_t  *bits;          ///< The bitvector, not owned.
+    uint64_t        bitCount;       ///< Number of valid bits.
+    uint64_t        oneCount;       ///< Number of set bits.
+    uint64_t        *upper;         ///< Ones before every 2^32-bit block.
+    size_t          upperCount;
+    uint64_t        *entries;       ///< Interleaved L1/L2 entries.
+    size_t          entryCount;
+    uint32_t        *samples;       ///< Entry of every sampled one.
+    size_t          sampleCount;
+} rank_select_t;
+
+// A select sample is taken every `RANK_SELECT_SAMPLE` ones.
+#define RANK_SELECT_SAMPLE  8192
+
+/**
+ * @brief Build the directory.
+ *
+ * @param[out]  rs              The directory to initialize.
+ * @param[in]   bits            The bitvector, bit `i` is bit `i % 64` of word
+ * `i / 64`. It must outlive the directory, bits past `bitCount` in the last
+ * word must be zero.
+ * @param[in]   bitCount        The number of bits.
+ *
+ * @return 0 on success, -1 if memory could not be allocated.
+ */
+int rank_select_build(rank_select_t *rs, const uint64_t *bits,
+        uint64_t bitCount);
+
+/**
+ * @brief Release the memory of the directory (not the bits).
+ */
+void rank_select_free(rank_select_t *rs);
+
+/**
+ * @brief The number of ones in `[0, pos)`, `pos <= bitCount`.
+ */
+uint64_t rank_select_rank1(const rank_select_t *rs, uint64_t pos);
+
+/**
+ * @brief The position of the `k`-th one (counting from 0), `k < oneCount`.
+ */
+uint64_t rank_select_select1(const rank_select_t *rs, uint64_t k);
+
+/**
+ * @brief The size of the directory in bytes, without the bits.
+ */
+size_t rank_select_size(const rank_select_t *rs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RANK_SELECT_H
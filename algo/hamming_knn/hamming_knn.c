@@ -0,0 +1,241 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../count_bits/count_bits.h"
+#include "hamming_knn.h"
+
+// Codes per call of the distance kernel, the distances of a block stay in L1.
+#define KNN_BLOCK       1024
+
+// One thread's share of the codes and its top-k max-heap.
+typedef struct {
+    const uint64_t  *codes;
+    size_t          codeWords;
+    size_t          first;
+    size_t          last;
+    const uint64_t  *query;
+    size_t          k;
+    hamming_hit_t   *heap;
+    size_t          heapSize;
+} knn_task_t;
+
+#ifndef HAMMING_KNN_NO_MAIN
+#define BENCH_REPEAT    5
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t xorshift64(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+int main(int argc, char *argv[]) {
+    // Usage: hamming_knn [codes] [bits] [k] [threads]
+    size_t codeCount = argc > 1 ? strtoul(argv[1], NULL, 10) : 1 << 21;
+    unsigned codeBits = argc > 2 ? strtoul(argv[2], NULL, 10) : 512;
+    size_t k = argc > 3 ? strtoul(argv[3], NULL, 10) : 10;
+    unsigned threadCount = argc > 4 ? strtoul(argv[4], NULL, 10) : 0;
+    size_t codeWords = codeBits / 64;
+
+    uint64_t *codes = malloc(codeCount * codeWords * sizeof(uint64_t));
+    uint64_t *query = malloc(codeWords * sizeof(uint64_t));
+    hamming_hit_t *hits = malloc(k * sizeof(hamming_hit_t));
+    if (NULL == codes || NULL == query || NULL == hits || 0 == codeWords) {
+        fprintf(stderr, "Cannot allocate %zu codes of %u bits\n", codeCount,
+                codeBits);
+        return 1;
+    }
+
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    for (size_t idx = 0; idx < codeCount * codeWords; ++idx)
+        codes[idx] = xorshift64(&state);
+
+    // The query is a copy of a random code with a few bits flipped.
+    size_t planted = xorshift64(&state) % codeCount;
+    for (size_t word = 0; word < codeWords; ++word)
+        query[word] = codes[planted * codeWords + word];
+    query[0] ^= 0x8001;
+    query[codeWords - 1] ^= 1ULL << 63;
+
+    long hitCount = 0;
+    double best = 1e30;
+    for (int rep = 0; rep < BENCH_REPEAT; ++rep) {
+        double start = now_seconds();
+        hitCount = hamming_knn(codes, codeCount, codeBits, query, k,
+                threadCount, hits);
+        double elapsed = now_seconds() - start;
+        if (elapsed < best)
+            best = elapsed;
+    }
+
+    if (hitCount < 1 || planted != hits[0].index || 3 != hits[0].distance) {
+        fprintf(stderr, "The planted code %zu was not found\n", planted);
+        return 1;
+    }
+
+    // Brute force check of the k-th distance.
+    size_t closer = 0;
+    for (size_t idx = 0; idx < codeCount; ++idx)
+        closer += count_bits_xor(query, codes + idx * codeWords,
+                codeWords * 8) < hits[hitCount - 1].distance;
+    if (closer > (size_t)hitCount) {
+        fprintf(stderr, "%zu codes are closer than the last hit\n", closer);
+        return 1;
+    }
+
+    printf("%zu codes of %u bits, k = %zu (kernel: %s)\n", codeCount, codeBits,
+            k, count_bits_kernel());
+    printf("Query: %8.3f ms, %.1f Mcodes/s, %.2f GB/s\n", best * 1e3,
+            codeCount / best * 1e-6,
+            codeCount * codeWords * sizeof(uint64_t) / best * 1e-9);
+    for (long idx = 0; idx < hitCount; ++idx)
+        printf("  #%ld: code %u, distance %u\n", idx, hits[idx].index,
+                hits[idx].distance);
+
+    free(hits);
+    free(query);
+    free(codes);
+
+    return 0;
+}
+#endif
+
+static inline int hit_less(hamming_hit_t l, hamming_hit_t r) {
+    return l.distance < r.distance
+        || (l.distance == r.distance && l.index < r.index);
+}
+
+static int hit_compare(const void *l, const void *r) {
+    return hit_less(*(const hamming_hit_t *)l, *(const hamming_hit_t *)r)
+        ? -1 : hit_less(*(const hamming_hit_t *)r, *(const hamming_hit_t *)l);
+}
+
+// Max-heap on `hit_less`, the worst kept hit is at the root.
+static void heap_sift_down(hamming_hit_t *heap, size_t size, size_t idx) {
+    hamming_hit_t hit = heap[idx];
+    for (size_t child; (child = 2 * idx + 1) < size; idx = child) {
+        if (child + 1 < size && hit_less(heap[child], heap[child + 1]))
+            ++child;
+        if (!hit_less(hit, heap[child]))
+            break;
+        heap[idx] = heap[child];
+    }
+    heap[idx] = hit;
+}
+
+static void heap_push(hamming_hit_t *heap, size_t *size, hamming_hit_t hit) {
+    size_t idx = (*size)++;
+    for (size_t parent; idx > 0 && hit_less(heap[parent = (idx - 1) / 2], hit);
+            idx = parent)
+        heap[idx] = heap[parent];
+    heap[idx] = hit;
+}
+
+static void *knn_worker(void *arg) {
+    knn_task_t *task = arg;
+    uint32_t distances[KNN_BLOCK];
+
+    for (size_t block = task->first; block < task->last; block += KNN_BLOCK) {
+        size_t count = task->last - block < KNN_BLOCK
+            ? task->last - block : KNN_BLOCK;
+        count_bits_xor_batch(task->query,
+                task->codes + block * task->codeWords,
+                task->codeWords * sizeof(uint64_t), count, distances);
+
+        // Once the heap is full, most codes fail the first comparison.
+        for (size_t idx = 0; idx < count; ++idx) {
+            hamming_hit_t hit = { distances[idx], (uint32_t)(block + idx) };
+            if (task->heapSize < task->k) {
+                heap_push(task->heap, &task->heapSize, hit);
+            }
+            else if (hit_less(hit, task->heap[0])) {
+                task->heap[0] = hit;
+                heap_sift_down(task->heap, task->heapSize, 0);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+long hamming_knn(const uint64_t *codes, size_t codeCount, unsigned codeBits,
+        const uint64_t *query, size_t k, unsigned threadCount,
+        hamming_hit_t *hits) {
+    if (0 == codeBits || 0 != codeBits % 64 || codeCount > UINT32_MAX)
+        return -1;
+    if (0 == k || 0 == codeCount)
+        return 0;
+
+    // At least one block per thread.
+    if (0 == threadCount)
+        threadCount = (unsigned)sysconf(_SC_NPROCESSORS_ONLN);
+    size_t maxThreads = (codeCount + KNN_BLOCK - 1) / KNN_BLOCK;
+    if (threadCount > maxThreads)
+        threadCount = (unsigned)maxThreads;
+    if (0 == threadCount)
+        threadCount = 1;
+
+    knn_task_t *tasks = calloc(threadCount, sizeof(knn_task_t));
+    pthread_t *threads = calloc(threadCount, sizeof(pthread_t));
+    hamming_hit_t *heaps = malloc(threadCount * k * sizeof(hamming_hit_t));
+    if (NULL == tasks || NULL == threads || NULL == heaps) {
+        free(tasks);
+        free(threads);
+        free(heaps);
+        return -1;
+    }
+
+    // Thread ranges are whole blocks, the last thread takes the remainder.
+    size_t blocksPerThread = maxThreads / threadCount;
+    for (unsigned idx = 0; idx < threadCount; ++idx) {
+        tasks[idx].codes = codes;
+        tasks[idx].codeWords = codeBits / 64;
+        tasks[idx].first = idx * blocksPerThread * KNN_BLOCK;
+        tasks[idx].last = idx + 1 == threadCount
+            ? codeCount : (idx + 1) * blocksPerThread * KNN_BLOCK;
+        tasks[idx].query = query;
+        tasks[idx].k = k;
+        tasks[idx].heap = heaps + idx * k;
+        tasks[idx].heapSize = 0;
+    }
+
+    // The calling thread takes the first range.
+    unsigned started = 1;
+    for (; started < threadCount; ++started)
+        if (0 != pthread_create(&threads[started], NULL, knn_worker,
+                    &tasks[started]))
+            break;
+    knn_worker(&tasks[0]);
+    for (unsigned idx = 1; idx < started; ++idx)
+        pthread_join(threads[idx], NULL);
+    // Ranges of threads that could not be started run here.
+    for (unsigned idx = started; idx < threadCount; ++idx)
+        knn_worker(&tasks[idx]);
+
+    // Merge the per-thread heaps.
+    size_t total = 0;
+    for (unsigned idx = 0; idx < threadCount; ++idx)
+        for (size_t hit = 0; hit < tasks[idx].heapSize; ++hit)
+            heaps[total++] = tasks[idx].heap[hit];
+    qsort(heaps, total, sizeof(hamming_hit_t), hit_compare);
+
+    size_t hitCount = total < k ? total : k;
+    for (size_t idx = 0; idx < hitCount; ++idx)
+        hits[idx] = heaps[idx];
+
+    free(heaps);
+    free(threads);
+    free(tasks);
+
+    return (long)hitCount;
+}
@@ -0,0 +1,48 @@
+#ifndef HAMMING_KNN_H
+#define HAMMING_KNN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief One neighbour: the Hamming distance and the index of the code.
+ */
+typedef struct {
+    uint32_t        distance;
+    uint32_t        index;
+} hamming_hit_t;
+
+/**
+ * @brief Find the `k` codes nearest to `query` in Hamming distance.
+ *
+ * @details The codes are split into one contiguous range per thread. Every
+ * thread computes the distances of a block of codes at a time with the SIMD
+ * `count_bits_xor_batch` kernel and keeps its own top-`k` max-heap, the heaps
+ * are merged once all threads are done.
+ *
+ * @param[in]   codes           `codeCount` codes of `codeBits` bits each,
+ * stored one after the other.
+ * @param[in]   codeCount       The number of codes, at most `UINT32_MAX`.
+ * @param[in]   codeBits        The code width, a multiple of 64 (usually 256,
+ * 512 or 1024).
+ * @param[in]   query           The query code, `codeBits` wide.
+ * @param[in]   k               The number of neighbours.
+ * @param[in]   threadCount     The number of threads, 0 for one per CPU.
+ * @param[out]  hits            At least `k` hits, sorted by distance and then
+ * index.
+ *
+ * @return The number of hits written, `min(k, codeCount)`, or -1 on failure.
+ */
+long hamming_knn(const uint64_t *codes, size_t codeCount, unsigned codeBits,
+        const uint64_t *query, size_t k, unsigned threadCount,
+        hamming_hit_t *hits);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HAMMING_KNN_H
@@ -0,0 +1,382 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define MORTON_X86
+#define MORTON_TARGET(isa)  __attribute__((target(isa)))
+#else
+#define MORTON_TARGET(isa)
+#endif
+
+#include "morton.h"
+
+#ifndef MORTON_NO_MAIN
+int main(int argc, char *argv[]) {
+    // Usage: morton [x y z]
+    uint32_t x = argc > 1 ? strtoul(argv[1], NULL, 0) : 5;
+    uint32_t y = argc > 2 ? strtoul(argv[2], NULL, 0) : 9;
+    uint32_t z = argc > 3 ? strtoul(argv[3], NULL, 0) : 3;
+
+    uint32_t dx, dy, dz;
+    uint64_t code2 = morton_encode2(x, y), code3 = morton_encode3(x, y, z);
+    morton_decode2(code2, &dx, &dy);
+    printf("2D (%u, %u): 0x%016llx -> (%u, %u)\n", x, y,
+            (unsigned long long)code2, dx, dy);
+    morton_decode3(code3, &dx, &dy, &dz);
+    printf("3D (%u, %u, %u): 0x%016llx -> (%u, %u, %u) (kernel: %s)\n", x, y,
+            z, (unsigned long long)code3, dx, dy, dz, morton_kernel());
+
+    return 0;
+}
+#endif
+
+static void swar_encode2(const uint32_t *x, const uint32_t *y, size_t count,
+        uint64_t *codes) {
+    for (size_t idx = 0; idx < count; ++idx)
+        codes[idx] = morton_spread2(x[idx]) | morton_spread2(y[idx]) << 1;
+}
+
+static void swar_decode2(const uint64_t *codes, size_t count, uint32_t *x,
+        uint32_t *y) {
+    for (size_t idx = 0; idx < count; ++idx) {
+        x[idx] = morton_compact2(codes[idx]);
+        y[idx] = morton_compact2(codes[idx] >> 1);
+    }
+}
+
+static void swar_encode3(const uint32_t *x, const uint32_t *y,
+        const uint32_t *z, size_t count, uint64_t *codes) {
+    for (size_t idx = 0; idx < count; ++idx)
+        codes[idx] = morton_spread3(x[idx]) | morton_spread3(y[idx]) << 1
+            | morton_spread3(z[idx]) << 2;
+}
+
+static void swar_decode3(const uint64_t *codes, size_t count, uint32_t *x,
+        uint32_t *y, uint32_t *z) {
+    for (size_t idx = 0; idx < count; ++idx) {
+        x[idx] = morton_compact3(codes[idx]);
+        y[idx] = morton_compact3(codes[idx] >> 1);
+        z[idx] = morton_compact3(codes[idx] >> 2);
+    }
+}
+
+#ifdef MORTON_X86
+MORTON_TARGET("bmi2")
+static void bmi2_encode2(const uint32_t *x, const uint32_t *y, size_t count,
+        uint64_t *codes) {
+    for (size_t idx = 0; idx < count; ++idx)
+        codes[idx] = _pdep_u64(x[idx], MORTON2_X)
+            | _pdep_u64(y[idx], MORTON2_X << 1);
+}
+
+MORTON_TARGET("bmi2")
+static void bmi2_decode2(const uint64_t *codes, size_t count, uint32_t *x,
+        uint32_t *y) {
+    for (size_t idx = 0; idx < count; ++idx) {
+        x[idx] = (uint32_t)_pext_u64(codes[idx], MORTON2_X);
+        y[idx] = (uint32_t)_pext_u64(codes[idx], MORTON2_X << 1);
+    }
+}
+
+MORTON_TARGET("bmi2")
+static void bmi2_encode3(const uint32_t *x, const uint32_t *y,
+        const uint32_t *z, size_t count, uint64_t *codes) {
+    for (size_t idx = 0; idx < count; ++idx)
+        codes[idx] = _pdep_u64(x[idx], MORTON3_X)
+            | _pdep_u64(y[idx], MORTON3_X << 1)
+            | _pdep_u64(z[idx], MORTON3_X << 2);
+}
+
+MORTON_TARGET("bmi2")
+static void bmi2_decode3(const uint64_t *codes, size_t count, uint32_t *x,
+        uint32_t *y, uint32_t *z) {
+    for (size_t idx = 0; idx < count; ++idx) {
+        x[idx] = (uint32_t)_pext_u64(codes[idx], MORTON3_X);
+        y[idx] = (uint32_t)_pext_u64(codes[idx], MORTON3_X << 1);
+        z[idx] = (uint32_t)_pext_u64(codes[idx], MORTON3_X << 2);
+    }
+}
+
+/*
+ * AVX2 3D: the SWAR steps of `morton.h` on four 64-bit lanes. The
+ * coordinates are zero-extended from 32 to 64 bits on load, decoded
+ * coordinates are packed back from the low half of every lane by one
+ * `vpermd`.
+ */
+
+// `(v | v << shift) & mask`, one SWAR step.
+#define SPREAD_STEP(v, shift, mask) \
+    _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi64(v, shift)), \
+            _mm256_set1_epi64x((long long)(mask)))
+#define COMPACT_STEP(v, shift, mask) \
+    _mm256_and_si256(_mm256_or_si256(v, _mm256_srli_epi64(v, shift)), \
+            _mm256_set1_epi64x((long long)(mask)))
+
+MORTON_TARGET("avx2")
+static inline __m256i load_lanes(const uint32_t *values) {
+    return _mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i *)values));
+}
+
+MORTON_TARGET("avx2")
+static inline __m256i spread3_256(__m256i v) {
+    v = _mm256_and_si256(v, _mm256_set1_epi64x(0x1FFFFF));
+    v = SPREAD_STEP(v, 32, 0x001F00000000FFFFULL);
+    v = SPREAD_STEP(v, 16, 0x001F0000FF0000FFULL);
+    v = SPREAD_STEP(v, 8, 0x100F00F00F00F00FULL);
+    v = SPREAD_STEP(v, 4, 0x10C30C30C30C30C3ULL);
+    return SPREAD_STEP(v, 2, MORTON3_X);
+}
+
+MORTON_TARGET("avx2")
+static inline __m256i compact3_256(__m256i v) {
+    v = _mm256_and_si256(v, _mm256_set1_epi64x((long long)MORTON3_X));
+    v = COMPACT_STEP(v, 2, 0x10C30C30C30C30C3ULL);
+    v = COMPACT_STEP(v, 4, 0x100F00F00F00F00FULL);
+    v = COMPACT_STEP(v, 8, 0x001F0000FF0000FFULL);
+    v = COMPACT_STEP(v, 16, 0x001F00000000FFFFULL);
+    return COMPACT_STEP(v, 32, 0x1FFFFF);
+}
+
+// The low dwords of the lanes of `low` then of `high`, i.e. four 32-bit
+// results each.
+MORTON_TARGET("avx2")
+static inline __m256i pack_lanes(__m256i low, __m256i high) {
+    return _mm256_permutevar8x32_epi32(
+            _mm256_blend_epi32(low, _mm256_slli_epi64(high, 32), 0xAA),
+            _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7));
+}
+
+/*
+ * 2D with `pshufb`: the bytes of `x` and `y` are interleaved first, so every
+ * 16-bit lane holds byte `i` of both and becomes bits `16i..16i+15` of the
+ * code. The four bits of every nibble are spread (or gathered) by a 16-entry
+ * table, which takes fewer instructions than the five SWAR steps.
+ */
+
+// The bits of a nibble on the even bits of a byte.
+MORTON_TARGET("avx2")
+static inline __m256i spread_table(void) {
+    return _mm256_setr_epi8(
+            0x00, 0x01, 0x04, 0x05, 0x10, 0x11, 0x14, 0x15,
+            0x40, 0x41, 0x44, 0x45, 0x50, 0x51, 0x54, 0x55,
+            0x00, 0x01, 0x04, 0x05, 0x10, 0x11, 0x14, 0x15,
+            0x40, 0x41, 0x44, 0x45, 0x50, 0x51, 0x54, 0x55);
+}
+
+// Every 16-bit lane `x | y << 8` of bytes to their 16-bit Morton code.
+MORTON_TARGET("avx2")
+static inline __m256i interleave_bytes(__m256i v, __m256i table) {
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i low = _mm256_set1_epi16(0x00FF);
+    // Bytes `spread(x), spread(y)` of the low and the high nibbles.
+    __m256i a = _mm256_shuffle_epi8(table, _mm256_and_si256(v, nibble));
+    __m256i b = _mm256_shuffle_epi8(table,
+            _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+    // The spread bits are at most 0x55, so the shifts do not carry over.
+    __m256i lo = _mm256_or_si256(a, _mm256_srli_epi16(a, 7));
+    __m256i hi = _mm256_or_si256(_mm256_slli_epi16(b, 8),
+            _mm256_slli_epi16(b, 1));
+    return _mm256_blendv_epi8(hi, lo, low);
+}
+
+MORTON_TARGET("avx2")
+static void avx2_encode2(const uint32_t *x, const uint32_t *y, size_t count,
+        uint64_t *codes) {
+    const __m256i table = spread_table();
+    size_t idx = 0;
+    for (; idx + 8 <= count; idx += 8) {
+        __m256i vx = _mm256_loadu_si256((const __m256i *)(x + idx));
+        __m256i vy = _mm256_loadu_si256((const __m256i *)(y + idx));
+        // Points 0, 1, 4, 5 and 2, 3, 6, 7 (unpack is per 128-bit lane).
+        __m256i c0 = interleave_bytes(_mm256_unpacklo_epi8(vx, vy), table);
+        __m256i c1 = interleave_bytes(_mm256_unpackhi_epi8(vx, vy), table);
+        _mm256_storeu_si256((__m256i *)(codes + idx),
+                _mm256_permute2x128_si256(c0, c1, 0x20));
+        _mm256_storeu_si256((__m256i *)(codes + idx + 4),
+                _mm256_permute2x128_si256(c0, c1, 0x31));
+    }
+    swar_encode2(x + idx, y + idx, count - idx, codes + idx);
+}
+
+MORTON_TARGET("avx2")
+static void avx2_decode2(const uint64_t *codes, size_t count, uint32_t *x,
+        uint32_t *y) {
+    // The even bits of a nibble in bits 0-1, the odd ones in bits 4-5, and
+    // the same two bits higher for the high nibble.
+    const __m256i lowTable = _mm256_setr_epi8(
+            0x00, 0x01, 0x10, 0x11, 0x02, 0x03, 0x12, 0x13,
+            0x20, 0x21, 0x30, 0x31, 0x22, 0x23, 0x32, 0x33,
+            0x00, 0x01, 0x10, 0x11, 0x02, 0x03, 0x12, 0x13,
+            0x20, 0x21, 0x30, 0x31, 0x22, 0x23, 0x32, 0x33);
+    const __m256i highTable = _mm256_slli_epi16(lowTable, 2);
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i lowNibbles = _mm256_set1_epi16(0x000F);
+    const __m256i highNibbles = _mm256_set1_epi16(0x00F0);
+    // The bytes of `x` of both points of a 128-bit lane, then those of `y`.
+    const __m256i gather = _mm256_setr_epi8(
+            0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15,
+            0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+    size_t idx = 0;
+    for (; idx + 4 <= count; idx += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(codes + idx));
+        // Byte `k` becomes 4 bits of `x` and 4 bits of `y` above them.
+        __m256i r = _mm256_or_si256(
+                _mm256_shuffle_epi8(lowTable, _mm256_and_si256(v, nibble)),
+                _mm256_shuffle_epi8(highTable,
+                    _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble)));
+        // The two bytes of a 16-bit lane to one byte of `x` and one of `y`.
+        __m256i r4 = _mm256_srli_epi16(r, 4);
+        __m256i bx = _mm256_or_si256(_mm256_and_si256(r, lowNibbles),
+                _mm256_and_si256(r4, highNibbles));
+        __m256i by = _mm256_or_si256(_mm256_and_si256(r4, lowNibbles),
+                _mm256_and_si256(_mm256_srli_epi16(r, 8), highNibbles));
+        __m256i xy = _mm256_shuffle_epi8(
+                _mm256_or_si256(bx, _mm256_slli_epi16(by, 8)), gather);
+        xy = _mm256_permute4x64_epi64(xy, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128((__m128i *)(x + idx), _mm256_castsi256_si128(xy));
+        _mm_storeu_si128((__m128i *)(y + idx),
+                _mm256_extracti128_si256(xy, 1));
+    }
+    swar_decode2(codes + idx, count - idx, x + idx, y + idx);
+}
+
+MORTON_TARGET("avx2")
+static void avx2_encode3(const uint32_t *x, const uint32_t *y,
+        const uint32_t *z, size_t count, uint64_t *codes) {
+    size_t idx = 0;
+    for (; idx + 4 <= count; idx += 4) {
+        __m256i c = _mm256_or_si256(spread3_256(load_lanes(x + idx)),
+                _mm256_slli_epi64(spread3_256(load_lanes(y + idx)), 1));
+        c = _mm256_or_si256(c,
+                _mm256_slli_epi64(spread3_256(load_lanes(z + idx)), 2));
+        _mm256_storeu_si256((__m256i *)(codes + idx), c);
+    }
+    swar_encode3(x + idx, y + idx, z + idx, count - idx, codes + idx);
+}
+
+MORTON_TARGET("avx2")
+static void avx2_decode3(const uint64_t *codes, size_t count, uint32_t *x,
+        uint32_t *y, uint32_t *z) {
+    size_t idx = 0;
+    for (; idx + 4 <= count; idx += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(codes + idx));
+        __m256i xy = pack_lanes(compact3_256(v),
+                compact3_256(_mm256_srli_epi64(v, 1)));
+        __m256i zz = pack_lanes(compact3_256(_mm256_srli_epi64(v, 2)), v);
+        _mm_storeu_si128((__m128i *)(x + idx), _mm256_castsi256_si128(xy));
+        _mm_storeu_si128((__m128i *)(y + idx),
+                _mm256_extracti128_si256(xy, 1));
+        _mm_storeu_si128((__m128i *)(z + idx), _mm256_castsi256_si128(zz));
+    }
+    swar_decode3(codes + idx, count - idx, x + idx, y + idx, z + idx);
+}
+#endif
+
+typedef struct {
+    const char      *name;
+    const char      *isa;           ///< CPU feature, NULL for portable code.
+    void            (*encode2)(const uint32_t *, const uint32_t *, size_t,
+            uint64_t *);
+    void            (*decode2)(const uint64_t *, size_t, uint32_t *,
+            uint32_t *);
+    void            (*encode3)(const uint32_t *, const uint32_t *,
+            const uint32_t *, size_t, uint64_t *);
+    void            (*decode3)(const uint64_t *, size_t, uint32_t *,
+            uint32_t *, uint32_t *);
+} morton_kernel_t;
+
+#define MORTON_KERNEL_ENTRY(name, isa, level) \
+    { name, isa, level##_encode2, level##_decode2, level##_encode3, \
+        level##_decode3 }
+
+// All kernels, from the slowest to the fastest. The last one takes the
+// faster routines of both: one `PDEP` per coordinate beats four lanes of
+// SWAR steps on 3D codes, the `pshufb` tables win on 2D codes.
+static const morton_kernel_t kernelTable[] = {
+    MORTON_KERNEL_ENTRY("swar", NULL, swar),
+#ifdef MORTON_X86
+    MORTON_KERNEL_ENTRY("bmi2", "bmi2", bmi2),
+    MORTON_KERNEL_ENTRY("avx2", "avx2", avx2),
+    { "avx2+bmi2", "avx2+bmi2", avx2_encode2, avx2_decode2, bmi2_encode3,
+        bmi2_decode3 },
+#endif
+};
+
+#define KERNEL_NUM  (sizeof(kernelTable) / sizeof(kernelTable[0]))
+
+static int kernel_supported(const morton_kernel_t *kernel) {
+#ifdef MORTON_X86
+    if (NULL != kernel->isa && 0 == strcmp("bmi2", kernel->isa))
+        return __builtin_cpu_supports("bmi2");
+    if (NULL != kernel->isa && 0 == strcmp("avx2", kernel->isa))
+        return __builtin_cpu_supports("avx2");
+    if (NULL != kernel->isa && 0 == strcmp("avx2+bmi2", kernel->isa))
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2");
+#endif
+    return NULL == kernel->isa;
+}
+
+static const morton_kernel_t *selectedKernel = &kernelTable[0];
+
+/**
+ * @brief Pick the fastest supported kernel: AVX2 with `PDEP`/`PEXT` for 3D
+ * codes, else AVX2 alone where they are microcoded (AMD families 15h and
+ * 17h), else `PDEP`/`PEXT`, else SWAR.
+ */
+__attribute__((constructor))
+static void select_kernel(void) {
+#ifdef MORTON_X86
+    __builtin_cpu_init();
+#endif
+    for (size_t idx = 0; idx < KERNEL_NUM; ++idx) {
+        const morton_kernel_t *kernel = &kernelTable[idx];
+        if (!kernel_supported(kernel))
+            continue;
+#ifdef MORTON_X86
+        if (NULL != kernel->isa && NULL != strstr(kernel->isa, "bmi2")
+                && (__builtin_cpu_is("amdfam15h")
+                    || __builtin_cpu_is("amdfam17h")))
+            continue;
+#endif
+        selectedKernel = kernel;
+    }
+}
+
+const char *morton_kernel(void) {
+    return selectedKernel->name;
+}
+
+int morton_set_kernel(const char *name) {
+    for (size_t idx = 0; idx < KERNEL_NUM; ++idx) {
+        if (0 == strcmp(name, kernelTable[idx].name)
+                && kernel_supported(&kernelTable[idx])) {
+            selectedKernel = &kernelTable[idx];
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+void morton_encode2_batch(const uint32_t *x, const uint32_t *y, size_t count,
+        uint64_t *codes) {
+    selectedKernel->encode2(x, y, count, codes);
+}
+
+void morton_decode2_batch(const uint64_t *codes, size_t count, uint32_t *x,
+        uint32_t *y) {
+    selectedKernel->decode2(codes, count, x, y);
+}
+
+void morton_encode3_batch(const uint32_t *x, const uint32_t *y,
+        const uint32_t *z, size_t count, uint64_t *codes) {
+    selectedKernel->encode3(x, y, z, count, codes);
+}
+
+void morton_decode3_batch(const uint64_t *codes, size_t count, uint32_t *x,
+        uint32_t *y, uint32_t *z) {
+    selectedKernel->decode3(codes, count, x, y, z);
+}
@@ -0,0 +1,161 @@
+#ifndef MORTON_H
+#define MORTON_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Morton (Z-order) codes: the bits of the coordinates interleaved, bit `i`
+ * of `x` goes to bit `2i` (2D) or `3i` (3D) of the code, `y` and `z` follow
+ * one and two bits above it. Sorting by the code keeps points that are close
+ * in space close in memory.
+ *
+ * 2D codes take two 32-bit coordinates into 64 bits, 3D codes the low 21
+ * bits of three coordinates into 63 bits, higher bits are ignored.
+ */
+
+// The bits of `x`, `y` and `z` in a code.
+#define MORTON2_X   0x5555555555555555ULL
+#define MORTON3_X   0x1249249249249249ULL
+
+/**
+ * @brief Spread the 32 bits of `x` to the even bits of a 64-bit word.
+ *
+ * @details Magic-number SWAR: five steps of shift, OR and mask, each one
+ * halves the size of the groups of bits that move together.
+ */
+static inline uint64_t morton_spread2(uint32_t x) {
+    uint64_t v = x;
+    v = (v | v << 16) & 0x0000FFFF0000FFFFULL;
+    v = (v | v << 8) & 0x00FF00FF00FF00FFULL;
+    v = (v | v << 4) & 0x0F0F0F0F0F0F0F0FULL;
+    v = (v | v << 2) & 0x3333333333333333ULL;
+    return (v | v << 1) & MORTON2_X;
+}
+
+/**
+ * @brief The inverse of `morton_spread2`, the even bits of `v` packed.
+ */
+static inline uint32_t morton_compact2(uint64_t v) {
+    v &= MORTON2_X;
+    v = (v | v >> 1) & 0x3333333333333333ULL;
+    v = (v | v >> 2) & 0x0F0F0F0F0F0F0F0FULL;
+    v = (v | v >> 4) & 0x00FF00FF00FF00FFULL;
+    v = (v | v >> 8) & 0x0000FFFF0000FFFFULL;
+    return (uint32_t)(v | v >> 16);
+}
+
+/**
+ * @brief Spread the low 21 bits of `x` to every third bit.
+ */
+static inline uint64_t morton_spread3(uint32_t x) {
+    uint64_t v = x & 0x1FFFFF;
+    v = (v | v << 32) & 0x001F00000000FFFFULL;
+    v = (v | v << 16) & 0x001F0000FF0000FFULL;
+    v = (v | v << 8) & 0x100F00F00F00F00FULL;
+    v = (v | v << 4) & 0x10C30C30C30C30C3ULL;
+    return (v | v << 2) & MORTON3_X;
+}
+
+static inline uint32_t morton_compact3(uint64_t v) {
+    v &= MORTON3_X;
+    v = (v | v >> 2) & 0x10C30C30C30C30C3ULL;
+    v = (v | v >> 4) & 0x100F00F00F00F00FULL;
+    v = (v | v >> 8) & 0x001F0000FF0000FFULL;
+    v = (v | v >> 16) & 0x001F00000000FFFFULL;
+    return (uint32_t)((v | v >> 32) & 0x1FFFFF);
+}
+
+/**
+ * @brief One code, inlined for latency-bound paths.
+ *
+ * @details With `-mbmi2` the bits are moved by `PDEP`/`PEXT` (one
+ * instruction per coordinate), otherwise by the SWAR functions above.
+ * `PDEP` and `PEXT` are microcoded on AMD before Zen 3, define
+ * `MORTON_SLOW_PDEP` there.
+ */
+static inline uint64_t morton_encode2(uint32_t x, uint32_t y) {
+#if defined(__BMI2__) && defined(__x86_64__) && !defined(MORTON_SLOW_PDEP)
+    return __builtin_ia32_pdep_di(x, MORTON2_X)
+        | __builtin_ia32_pdep_di(y, MORTON2_X << 1);
+#else
+    return morton_spread2(x) | morton_spread2(y) << 1;
+#endif
+}
+
+static inline void morton_decode2(uint64_t code, uint32_t *x, uint32_t *y) {
+#if defined(__BMI2__) && defined(__x86_64__) && !defined(MORTON_SLOW_PDEP)
+    *x = (uint32_t)__builtin_ia32_pext_di(code, MORTON2_X);
+    *y = (uint32_t)__builtin_ia32_pext_di(code, MORTON2_X << 1);
+#else
+    *x = morton_compact2(code);
+    *y = morton_compact2(code >> 1);
+#endif
+}
+
+static inline uint64_t morton_encode3(uint32_t x, uint32_t y, uint32_t z) {
+#if defined(__BMI2__) && defined(__x86_64__) && !defined(MORTON_SLOW_PDEP)
+    return __builtin_ia32_pdep_di(x, MORTON3_X)
+        | __builtin_ia32_pdep_di(y, MORTON3_X << 1)
+        | __builtin_ia32_pdep_di(z, MORTON3_X << 2);
+#else
+    return morton_spread3(x) | morton_spread3(y) << 1
+        | morton_spread3(z) << 2;
+#endif
+}
+
+static inline void morton_decode3(uint64_t code, uint32_t *x, uint32_t *y,
+        uint32_t *z) {
+#if defined(__BMI2__) && defined(__x86_64__) && !defined(MORTON_SLOW_PDEP)
+    *x = (uint32_t)__builtin_ia32_pext_di(code, MORTON3_X);
+    *y = (uint32_t)__builtin_ia32_pext_di(code, MORTON3_X << 1);
+    *z = (uint32_t)__builtin_ia32_pext_di(code, MORTON3_X << 2);
+#else
+    *x = morton_compact3(code);
+    *y = morton_compact3(code >> 1);
+    *z = morton_compact3(code >> 2);
+#endif
+}
+
+/**
+ * @brief Encode or decode `count` points given as separate coordinate
+ * arrays, with the kernel selected at program start.
+ *
+ * @details `avx2` interleaves 2D codes by `pshufb` nibble tables, eight
+ * points per iteration, and runs the SWAR steps of 3D codes on four 64-bit
+ * lanes. `bmi2` uses `PDEP`/`PEXT` per coordinate, `avx2+bmi2` the AVX2
+ * routines for 2D and `PDEP`/`PEXT` for 3D codes (neither is picked on CPUs
+ * where they are microcoded), `swar` is the portable fallback.
+ * All give the same codes as `morton_encode2` and `morton_encode3`.
+ */
+void morton_encode2_batch(const uint32_t *x, const uint32_t *y, size_t count,
+        uint64_t *codes);
+void morton_decode2_batch(const uint64_t *codes, size_t count, uint32_t *x,
+        uint32_t *y);
+void morton_encode3_batch(const uint32_t *x, const uint32_t *y,
+        const uint32_t *z, size_t count, uint64_t *codes);
+void morton_decode3_batch(const uint64_t *codes, size_t count, uint32_t *x,
+        uint32_t *y, uint32_t *z);
+
+/**
+ * @brief The name of the batch kernel: `swar`, `bmi2`, `avx2` or
+ * `avx2+bmi2`.
+ */
+const char *morton_kernel(void);
+
+/**
+ * @brief Switch the batch routines to the kernel called `name`.
+ *
+ * @return 0 on success, -1 if the kernel is unknown or not supported.
+ */
+int morton_set_kernel(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MORTON_H
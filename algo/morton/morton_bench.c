@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "morton.h"
+
+#define BENCH_REPEAT    5
+
+static const char *kernels[] = { "swar", "bmi2", "avx2", "avx2+bmi2" };
+
+#define KERNEL_NUM      (sizeof(kernels) / sizeof(kernels[0]))
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t xorshift64(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+typedef struct {
+    uint32_t        *x, *y, *z;     ///< The input coordinates.
+    uint32_t        *dx, *dy, *dz;  ///< Decoded coordinates.
+    uint64_t        *codes;
+    size_t          count;
+} points_t;
+
+// The four batch routines, by index.
+static void run(const points_t *p, int routine) {
+    switch (routine) {
+    case 0:
+        morton_encode2_batch(p->x, p->y, p->count, p->codes);
+        break;
+    case 1:
+        morton_decode2_batch(p->codes, p->count, p->dx, p->dy);
+        break;
+    case 2:
+        morton_encode3_batch(p->x, p->y, p->z, p->count, p->codes);
+        break;
+    default:
+        morton_decode3_batch(p->codes, p->count, p->dx, p->dy, p->dz);
+        break;
+    }
+}
+
+static const char *routineNames[] = {
+    "encode2", "decode2", "encode3", "decode3"
+};
+
+// The codes and coordinates of the last run against the inlined functions.
+static int verify(const points_t *p, int routine) {
+    for (size_t idx = 0; idx < p->count; ++idx) {
+        uint32_t x, y, z;
+        switch (routine) {
+        case 0:
+            if (p->codes[idx] != morton_encode2(p->x[idx], p->y[idx]))
+                return -1;
+            break;
+        case 1:
+            morton_decode2(p->codes[idx], &x, &y);
+            if (x != p->dx[idx] || y != p->dy[idx] || x != p->x[idx])
+                return -1;
+            break;
+        case 2:
+            if (p->codes[idx]
+                    != morton_encode3(p->x[idx], p->y[idx], p->z[idx]))
+                return -1;
+            break;
+        default:
+            morton_decode3(p->codes[idx], &x, &y, &z);
+            if (x != p->dx[idx] || y != p->dy[idx] || z != p->dz[idx]
+                    || x != (p->x[idx] & 0x1FFFFF))
+                return -1;
+            break;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    // Usage: morton_bench [points]
+    size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 1 << 22;
+
+    points_t p = { .count = count };
+    p.x = malloc(count * sizeof(uint32_t));
+    p.y = malloc(count * sizeof(uint32_t));
+    p.z = malloc(count * sizeof(uint32_t));
+    p.dx = malloc(count * sizeof(uint32_t));
+    p.dy = malloc(count * sizeof(uint32_t));
+    p.dz = malloc(count * sizeof(uint32_t));
+    p.codes = malloc(count * sizeof(uint64_t));
+    if (NULL == p.x || NULL == p.y || NULL == p.z || NULL == p.dx
+            || NULL == p.dy || NULL == p.dz || NULL == p.codes) {
+        fprintf(stderr, "Cannot allocate %zu points\n", count);
+        return 1;
+    }
+
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    for (size_t idx = 0; idx < count; ++idx) {
+        uint64_t bits = xorshift64(&state);
+        p.x[idx] = (uint32_t)bits;
+        p.y[idx] = (uint32_t)(bits >> 32);
+        p.z[idx] = (uint32_t)xorshift64(&state);
+    }
+    // Touch the outputs once, page faults are not part of the measurement.
+    memset(p.dx, 0, count * sizeof(uint32_t));
+    memset(p.dy, 0, count * sizeof(uint32_t));
+    memset(p.dz, 0, count * sizeof(uint32_t));
+    memset(p.codes, 0, count * sizeof(uint64_t));
+
+    const char *defaultKernel = morton_kernel();
+    printf("%zu points, default kernel: %s, million points per ms\n", count,
+            defaultKernel);
+    printf("%-10s %10s %10s %10s %10s\n", "kernel", routineNames[0],
+            routineNames[1], routineNames[2], routineNames[3]);
+    for (size_t k = 0; k < KERNEL_NUM; ++k) {
+        // Kernels this CPU does not support are left out.
+        if (0 != morton_set_kernel(kernels[k]))
+            continue;
+
+        printf("%-10s", kernels[k]);
+        for (int routine = 0; routine < 4; ++routine) {
+            double best = 1e30;
+            for (int rep = 0; rep < BENCH_REPEAT; ++rep) {
+                double start = now_seconds();
+                run(&p, routine);
+                double elapsed = now_seconds() - start;
+                if (elapsed < best)
+                    best = elapsed;
+            }
+            if (0 != verify(&p, routine)) {
+                fprintf(stderr, "\nMismatch: %s %s\n", kernels[k],
+                        routineNames[routine]);
+                return 1;
+            }
+            printf(" %10.2f", count / best * 1e-9);
+        }
+        printf("\n");
+    }
+    morton_set_kernel(defaultKernel);
+
+    free(p.codes);
+    free(p.dz);
+    free(p.dy);
+    free(p.dx);
+    free(p.z);
+    free(p.y);
+    free(p.x);
+
+    return 0;
+}
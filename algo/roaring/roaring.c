@@ -0,0 +1,1113 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ROARING_X86
+#endif
+
+#include "../count_bits/count_bits.h"
+#include "roaring.h"
+
+// An array container holds at most this many values, a bitmap more.
+#define ARRAY_MAX       4096
+#define BITMAP_WORDS    1024
+#define BITMAP_BYTES    (BITMAP_WORDS * 8)
+
+// The vector intersection stores whole vectors, so array buffers have room
+// for this many values past their capacity.
+#define ARRAY_SLACK     8
+
+// Arrays this many times longer than the other one are galloped through.
+#define GALLOP_RATIO    64
+
+#ifndef ROARING_NO_MAIN
+#define BENCH_REPEAT    20
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t xorshift64(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// Universe of the benchmark sets, a dense bitmap of it is the reference.
+#define UNIVERSE_BITS   (1U << 26)
+
+/*
+ * Fill `r` and the dense reference `bits` with one of three distributions:
+ * 0: sparse (1 value per 256 on average), 1: dense (50%), 2: runs of 1000
+ * values every 3000.
+ */
+static int fill_set(roaring_bitmap_t *r, uint64_t *bits, int kind,
+        uint64_t *state) {
+    memset(bits, 0, UNIVERSE_BITS / 8);
+    for (uint32_t value = 0; value < UNIVERSE_BITS; ) {
+        uint32_t next;
+        if (0 == kind) {
+            next = value + 1 + xorshift64(state) % 512;
+        }
+        else if (1 == kind) {
+            next = value + 1;
+            if (0 == (xorshift64(state) & 1)) {
+                value = next;
+                continue;
+            }
+        }
+        else {
+            next = value + 1;
+            if (value % 3000 >= 1000) {
+                value = value + 3000 - value % 3000;
+                continue;
+            }
+        }
+
+        if (value < UNIVERSE_BITS) {
+            if (roaring_add(r, value) < 0)
+                return -1;
+            bits[value / 64] |= 1ULL << (value % 64);
+        }
+        value = next;
+    }
+
+    return roaring_run_optimize(r);
+}
+
+int main(int argc, char *argv[]) {
+    static const char *kindNames[] = { "sparse", "dense", "runs" };
+    uint64_t *bitsA = malloc(UNIVERSE_BITS / 8);
+    uint64_t *bitsB = malloc(UNIVERSE_BITS / 8);
+    if (NULL == bitsA || NULL == bitsB) {
+        fprintf(stderr, "Cannot allocate the reference bitmaps\n");
+        return 1;
+    }
+
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    for (int kind = 0; kind < 3; ++kind) {
+        roaring_bitmap_t a, b, out;
+        roaring_init(&a);
+        roaring_init(&b);
+        roaring_init(&out);
+        if (0 != fill_set(&a, bitsA, kind, &state)
+                || 0 != fill_set(&b, bitsB, kind, &state)) {
+            fprintf(stderr, "Cannot build the %s sets\n", kindNames[kind]);
+            return 1;
+        }
+
+        double andTime = 1e30, orTime = 1e30, cardTime = 1e30;
+        uint64_t andCard = 0, orCard = 0, countCard = 0;
+        for (int rep = 0; rep < BENCH_REPEAT; ++rep) {
+            double start = now_seconds();
+            roaring_and(&out, &a, &b);
+            double mid = now_seconds();
+            andCard = roaring_cardinality(&out);
+            roaring_or(&out, &a, &b);
+            double end = now_seconds();
+            orCard = roaring_cardinality(&out);
+            countCard = roaring_and_cardinality(&a, &b);
+            double last = now_seconds();
+
+            andTime = mid - start < andTime ? mid - start : andTime;
+            orTime = end - mid < orTime ? end - mid : orTime;
+            cardTime = last - end < cardTime ? last - end : cardTime;
+        }
+
+        if (andCard != count_bits_and(bitsA, bitsB, UNIVERSE_BITS / 8)
+                || orCard != count_bits_or(bitsA, bitsB, UNIVERSE_BITS / 8)
+                || countCard != andCard
+                || roaring_cardinality(&a)
+                    != count_bits_buffer(bitsA, UNIVERSE_BITS / 8)) {
+            fprintf(stderr, "Mismatch in the %s sets\n", kindNames[kind]);
+            return 1;
+        }
+
+        printf("%-6s |A| = %9llu, %7.2f MiB (dense %.0f MiB), "
+                "and %7.3f ms, or %7.3f ms, |A & B| %7.3f ms\n",
+                kindNames[kind], (unsigned long long)roaring_cardinality(&a),
+                roaring_size(&a) / 1048576.0, UNIVERSE_BITS / 8 / 1048576.0,
+                andTime * 1e3, orTime * 1e3, cardTime * 1e3);
+
+        roaring_free(&out);
+        roaring_free(&b);
+        roaring_free(&a);
+    }
+
+    free(bitsB);
+    free(bitsA);
+
+    return 0;
+}
+#endif
+
+/*
+ * Sorted array helpers.
+ */
+
+// Index of the first value `>= value`.
+static inline int32_t lower_bound(const uint16_t *values, int32_t count,
+        uint16_t value) {
+    int32_t lo = 0, hi = count;
+    while (lo < hi) {
+        int32_t mid = (lo + hi) / 2;
+        if (values[mid] < value)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+static int32_t intersect_scalar(const uint16_t *a, int32_t na,
+        const uint16_t *b, int32_t nb, uint16_t *out) {
+    int32_t i = 0, j = 0, count = 0;
+    while (i < na && j < nb) {
+        if (a[i] < b[j]) {
+            ++i;
+        }
+        else if (a[i] > b[j]) {
+            ++j;
+        }
+        else {
+            out[count++] = a[i];
+            ++i;
+            ++j;
+        }
+    }
+
+    return count;
+}
+
+// `small` is much shorter than `large`: exponential, then binary search.
+static int32_t intersect_gallop(const uint16_t *small, int32_t ns,
+        const uint16_t *large, int32_t nl, uint16_t *out) {
+    int32_t count = 0, pos = 0;
+    for (int32_t idx = 0; idx < ns && pos < nl; ++idx) {
+        uint16_t value = small[idx];
+        int32_t step = 1;
+        while (pos + step < nl && large[pos + step] < value)
+            step *= 2;
+        int32_t hi = pos + step < nl ? pos + step + 1 : nl;
+        pos += lower_bound(large + pos, hi - pos, value);
+        if (pos < nl && large[pos] == value)
+            out[count++] = value;
+    }
+
+    return count;
+}
+
+#ifdef ROARING_X86
+// For every 8-bit lane mask, the `pshufb` control packing those 16-bit lanes
+// to the front.
+static uint8_t packTable[256][16];
+
+__attribute__((constructor))
+static void init_pack_table(void) {
+    for (int mask = 0; mask < 256; ++mask) {
+        int out = 0;
+        memset(packTable[mask], 0x80, 16);
+        for (int lane = 0; lane < 8; ++lane) {
+            if (mask & (1 << lane)) {
+                packTable[mask][2 * out] = (uint8_t)(2 * lane);
+                packTable[mask][2 * out + 1] = (uint8_t)(2 * lane + 1);
+                ++out;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Vector intersection of two sorted arrays, 8 x 8 values at a time.
+ *
+ * @details Every value of a block of `a` is compared with all 8 values of a
+ * block of `b` (the `b` block is rotated 7 times), the matches are packed
+ * with `pshufb` and stored as a whole vector, so `out` needs `ARRAY_SLACK`
+ * spare values. The block with the smaller maximum is replaced next, the
+ * remainders are merged by `intersect_scalar`.
+ */
+__attribute__((target("ssse3")))
+static int32_t intersect_vector(const uint16_t *a, int32_t na,
+        const uint16_t *b, int32_t nb, uint16_t *out) {
+    int32_t i = 0, j = 0, count = 0;
+    const int32_t endA = na / 8 * 8, endB = nb / 8 * 8;
+
+    if (i < endA && j < endB) {
+        __m128i va = _mm_loadu_si128((const __m128i *)a);
+        __m128i vb = _mm_loadu_si128((const __m128i *)b);
+        for (;;) {
+            __m128i eq = _mm_cmpeq_epi16(va, vb);
+            eq = _mm_or_si128(eq, _mm_cmpeq_epi16(va,
+                        _mm_alignr_epi8(vb, vb, 2)));
+            eq = _mm_or_si128(eq, _mm_cmpeq_epi16(va,
+                        _mm_alignr_epi8(vb, vb, 4)));
+            eq = _mm_or_si128(eq, _mm_cmpeq_epi16(va,
+                        _mm_alignr_epi8(vb, vb, 6)));
+            eq = _mm_or_si128(eq, _mm_cmpeq_epi16(va,
+                        _mm_alignr_epi8(vb, vb, 8)));
+            eq = _mm_or_si128(eq, _mm_cmpeq_epi16(va,
+                        _mm_alignr_epi8(vb, vb, 10)));
+            eq = _mm_or_si128(eq, _mm_cmpeq_epi16(va,
+                        _mm_alignr_epi8(vb, vb, 12)));
+            eq = _mm_or_si128(eq, _mm_cmpeq_epi16(va,
+                        _mm_alignr_epi8(vb, vb, 14)));
+
+            int mask = _mm_movemask_epi8(_mm_packs_epi16(eq,
+                        _mm_setzero_si128()));
+            _mm_storeu_si128((__m128i *)(out + count), _mm_shuffle_epi8(va,
+                        _mm_loadu_si128((const __m128i *)packTable[mask])));
+            count += count_bits_word((uint64_t)mask);
+
+            uint16_t maxA = a[i + 7], maxB = b[j + 7];
+            if (maxA <= maxB) {
+                i += 8;
+                if (i == endA)
+                    break;
+                va = _mm_loadu_si128((const __m128i *)(a + i));
+            }
+            if (maxB <= maxA) {
+                j += 8;
+                if (j == endB)
+                    break;
+                vb = _mm_loadu_si128((const __m128i *)(b + j));
+            }
+        }
+    }
+
+    return count + intersect_scalar(a + i, na - i, b + j, nb - j,
+            out + count);
+}
+#endif
+
+static int32_t intersect_arrays(const uint16_t *a, int32_t na,
+        const uint16_t *b, int32_t nb, uint16_t *out) {
+    if ((int64_t)na * GALLOP_RATIO < nb)
+        return intersect_gallop(a, na, b, nb, out);
+    if ((int64_t)nb * GALLOP_RATIO < na)
+        return intersect_gallop(b, nb, a, na, out);
+#ifdef ROARING_X86
+    if (__builtin_cpu_supports("ssse3"))
+        return intersect_vector(a, na, b, nb, out);
+#endif
+    return intersect_scalar(a, na, b, nb, out);
+}
+
+static int32_t union_scalar(const uint16_t *a, int32_t na,
+        const uint16_t *b, int32_t nb, uint16_t *out) {
+    int32_t i = 0, j = 0, count = 0;
+    while (i < na && j < nb) {
+        if (a[i] < b[j])
+            out[count++] = a[i++];
+        else if (a[i] > b[j])
+            out[count++] = b[j++];
+        else
+            out[count++] = a[i++], ++j;
+    }
+    while (i < na)
+        out[count++] = a[i++];
+    while (j < nb)
+        out[count++] = b[j++];
+
+    return count;
+}
+
+#ifdef ROARING_X86
+/**
+ * @brief Merge two sorted vectors of 8 values: `lo` gets the 8 smallest,
+ * `hi` the 8 largest, both sorted.
+ *
+ * @details A merge network of `min`/`max` steps: after the first step the
+ * minima are rotated by one lane and compared with the maxima again, 7
+ * times, so every value moves past all values of the other vector.
+ */
+__attribute__((target("sse4.2,popcnt")))
+static inline void merge_vectors(__m128i a, __m128i b, __m128i *lo,
+        __m128i *hi) {
+    __m128i min = _mm_min_epu16(a, b);
+    __m128i max = _mm_max_epu16(a, b), next;
+#define MERGE_STEP \
+    min = _mm_alignr_epi8(min, min, 2); \
+    next = _mm_min_epu16(min, max); \
+    max = _mm_max_epu16(min, max); \
+    min = next;
+    MERGE_STEP MERGE_STEP MERGE_STEP MERGE_STEP
+    MERGE_STEP MERGE_STEP MERGE_STEP
+#undef MERGE_STEP
+    *lo = _mm_alignr_epi8(min, min, 2);
+    *hi = max;
+}
+
+// Store the values of sorted `values` that differ from the lane before
+// them (the last lane of `prev` for the first one), packed to the front.
+__attribute__((target("sse4.2,popcnt")))
+static inline int32_t store_unique(__m128i prev, __m128i values,
+        uint16_t *out) {
+    __m128i before = _mm_alignr_epi8(values, prev, 14);
+    int mask = _mm_movemask_epi8(_mm_packs_epi16(
+                _mm_cmpeq_epi16(before, values), _mm_setzero_si128()));
+    int unique = ~mask & 0xFF;
+    _mm_storeu_si128((__m128i *)out, _mm_shuffle_epi8(values,
+                _mm_loadu_si128((const __m128i *)packTable[unique])));
+
+    return __builtin_popcount((unsigned)unique);
+}
+
+/**
+ * @brief Vector union of two sorted arrays, 8 values at a time.
+ *
+ * @details The block of the array with the smaller next value is merged
+ * with the 8 largest values so far by `merge_vectors`, the 8 smallest of
+ * the 16 are final and are stored without the values equal to their
+ * predecessor, a whole vector at a time, so `out` needs `ARRAY_SLACK` spare
+ * values. The pending largest values and the remainders, one of them
+ * shorter than a block, are merged by `union_scalar`.
+ */
+__attribute__((target("sse4.2,popcnt")))
+static int32_t union_vector(const uint16_t *a, int32_t na,
+        const uint16_t *b, int32_t nb, uint16_t *out) {
+    const int32_t endA = na / 8 * 8, endB = nb / 8 * 8;
+    if (0 == endA || 0 == endB)
+        return union_scalar(a, na, b, nb, out);
+
+    __m128i lo, hi;
+    merge_vectors(_mm_loadu_si128((const __m128i *)a),
+            _mm_loadu_si128((const __m128i *)b), &lo, &hi);
+    // No value is equal to a lane of all ones before the first one.
+    int32_t count = store_unique(_mm_set1_epi16(-1), lo, out);
+    __m128i last = lo;
+    int32_t i = 8, j = 8;
+    while (i < endA && j < endB) {
+        // Without a branch, which would be mispredicted half of the time.
+        const int takeA = a[i] <= b[j];
+        const uint16_t *block = takeA ? a + i : b + j;
+        i += takeA ? 8 : 0;
+        j += takeA ? 0 : 8;
+        merge_vectors(_mm_loadu_si128((const __m128i *)block), hi, &lo, &hi);
+        count += store_unique(last, lo, out + count);
+        last = lo;
+    }
+
+    // The pending values, then the remainders of both arrays.
+    uint16_t pending[8 + ARRAY_SLACK], merged[16 + ARRAY_SLACK];
+    int32_t pendingCount = store_unique(last, hi, pending);
+    const uint16_t *rest = i < na ? a + i : b + j;
+    int32_t restCount = i < na ? na - i : nb - j;
+    if (i < na && j < nb) {
+        // The side whose blocks ran out has fewer than 8 values left.
+        const int shortA = i == endA;
+        int32_t mergedCount = union_scalar(pending, pendingCount,
+                shortA ? a + i : b + j, shortA ? na - i : nb - j, merged);
+        memcpy(pending, merged, mergedCount * sizeof(uint16_t));
+        pendingCount = mergedCount;
+        rest = shortA ? b + j : a + i;
+        restCount = shortA ? nb - j : na - i;
+    }
+
+    // Only the first value of the tail can equal the last value stored.
+    int32_t first = count;
+    count += union_scalar(pending, pendingCount, rest, restCount,
+            out + count);
+    if (first > 0 && count > first && out[first] == out[first - 1]) {
+        memmove(out + first, out + first + 1,
+                (count - first - 1) * sizeof(uint16_t));
+        --count;
+    }
+
+    return count;
+}
+#endif
+
+static int32_t union_arrays(const uint16_t *a, int32_t na,
+        const uint16_t *b, int32_t nb, uint16_t *out) {
+#ifdef ROARING_X86
+    if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt"))
+        return union_vector(a, na, b, nb, out);
+#endif
+    return union_scalar(a, na, b, nb, out);
+}
+
+/*
+ * Word helpers.
+ */
+
+// Set the bits `[first, last]` of a bitmap container.
+static void set_range(uint64_t *words, uint32_t first, uint32_t last) {
+    uint32_t firstWord = first / 64, lastWord = last / 64;
+    uint64_t firstMask = ~0ULL << (first % 64);
+    uint64_t lastMask = ~0ULL >> (63 - last % 64);
+    if (firstWord == lastWord) {
+        words[firstWord] |= firstMask & lastMask;
+        return;
+    }
+
+    words[firstWord] |= firstMask;
+    for (uint32_t word = firstWord + 1; word < lastWord; ++word)
+        words[word] = ~0ULL;
+    words[lastWord] |= lastMask;
+}
+
+// Write the set bits of `words` as sorted values, return their number.
+static int32_t extract_values(const uint64_t *words, uint16_t *values) {
+    int32_t count = 0;
+    for (uint32_t word = 0; word < BITMAP_WORDS; ++word)
+        for (uint64_t bits = words[word]; 0 != bits; bits &= bits - 1)
+            values[count++] = (uint16_t)(word * 64 + __builtin_ctzll(bits));
+
+    return count;
+}
+
+// The number of runs of ones in a bitmap container.
+static int32_t count_runs(const uint64_t *words) {
+    int32_t runs = 0;
+    uint64_t carry = 0;
+    for (uint32_t word = 0; word < BITMAP_WORDS; ++word) {
+        runs += count_bits_word(words[word] & ~((words[word] << 1) | carry));
+        carry = words[word] >> 63;
+    }
+
+    return runs;
+}
+
+/*
+ * Containers.
+ */
+
+static int container_alloc(roaring_container_t *c, uint8_t type,
+        int32_t capacity) {
+    size_t bytes = ROARING_BITMAP == type ? BITMAP_BYTES
+        : ROARING_ARRAY == type ? (capacity + ARRAY_SLACK) * sizeof(uint16_t)
+        : capacity * 2 * sizeof(uint16_t);
+
+    c->data = ROARING_BITMAP == type ? calloc(1, bytes) : malloc(bytes);
+    c->type = type;
+    c->capacity = capacity;
+    c->count = 0;
+    c->cardinality = 0;
+
+    return NULL == c->data ? -1 : 0;
+}
+
+static void container_release(roaring_container_t *c) {
+    free(c->data);
+    c->data = NULL;
+}
+
+static size_t container_size(const roaring_container_t *c) {
+    return ROARING_BITMAP == c->type ? BITMAP_BYTES
+        : ROARING_ARRAY == c->type
+        ? (c->capacity + ARRAY_SLACK) * sizeof(uint16_t)
+        : c->capacity * 2 * sizeof(uint16_t);
+}
+
+static int container_clone(roaring_container_t *out,
+        const roaring_container_t *c) {
+    int32_t capacity = ROARING_BITMAP == c->type ? 0 : c->count;
+    if (0 != container_alloc(out, c->type, capacity))
+        return -1;
+
+    memcpy(out->data, c->data, ROARING_BITMAP == c->type ? BITMAP_BYTES
+            : ROARING_ARRAY == c->type ? c->count * sizeof(uint16_t)
+            : c->count * 2 * sizeof(uint16_t));
+    out->count = c->count;
+    out->cardinality = c->cardinality;
+
+    return 0;
+}
+
+// The container as bitmap words, `scratch` is used unless it is a bitmap.
+static const uint64_t *container_words(const roaring_container_t *c,
+        uint64_t *scratch) {
+    if (ROARING_BITMAP == c->type)
+        return c->data;
+
+    memset(scratch, 0, BITMAP_BYTES);
+    const uint16_t *data = c->data;
+    if (ROARING_ARRAY == c->type) {
+        for (int32_t idx = 0; idx < c->count; ++idx)
+            scratch[data[idx] / 64] |= 1ULL << (data[idx] % 64);
+    }
+    else {
+        for (int32_t idx = 0; idx < c->count; ++idx)
+            set_range(scratch, data[2 * idx],
+                    (uint32_t)data[2 * idx] + data[2 * idx + 1]);
+    }
+
+    return scratch;
+}
+
+// Replace `c` by the array or bitmap container of the same values.
+static int container_from_words(roaring_container_t *c,
+        const uint64_t *words, int32_t cardinality) {
+    roaring_container_t result;
+    if (cardinality <= ARRAY_MAX) {
+        if (0 != container_alloc(&result, ROARING_ARRAY, cardinality))
+            return -1;
+        result.count = extract_values(words, result.data);
+    }
+    else {
+        if (0 != container_alloc(&result, ROARING_BITMAP, 0))
+            return -1;
+        memcpy(result.data, words, BITMAP_BYTES);
+    }
+    result.cardinality = cardinality;
+
+    container_release(c);
+    *c = result;
+
+    return 0;
+}
+
+// Run containers are decoded before they are modified.
+static int container_unrun(roaring_container_t *c) {
+    uint64_t scratch[BITMAP_WORDS];
+    const uint64_t *words = container_words(c, scratch);
+    return container_from_words(c, words, c->cardinality);
+}
+
+static int container_contains(const roaring_container_t *c, uint16_t low) {
+    const uint16_t *data = c->data;
+    if (ROARING_BITMAP == c->type)
+        return (int)((((const uint64_t *)data)[low / 64] >> (low % 64)) & 1);
+
+    if (ROARING_ARRAY == c->type) {
+        int32_t pos = lower_bound(data, c->count, low);
+        return pos < c->count && data[pos] == low;
+    }
+
+    // The last run starting at or before `low`.
+    int32_t lo = 0, hi = c->count - 1;
+    if (hi < 0 || data[0] > low)
+        return 0;
+    while (lo < hi) {
+        int32_t mid = (lo + hi + 1) / 2;
+        if (data[2 * mid] <= low)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    return low - data[2 * lo] <= data[2 * lo + 1];
+}
+
+// `out = a & b`, `out` may end up empty.
+static int container_and(roaring_container_t *out,
+        const roaring_container_t *a, const roaring_container_t *b) {
+    if (ROARING_ARRAY != a->type && ROARING_ARRAY == b->type) {
+        const roaring_container_t *swap = a;
+        a = b;
+        b = swap;
+    }
+
+    if (ROARING_ARRAY == a->type) {
+        // The result is a subset of the array, filter it.
+        int32_t capacity = a->count < b->cardinality
+            ? a->count : b->cardinality;
+        if (0 != container_alloc(out, ROARING_ARRAY, capacity))
+            return -1;
+
+        const uint16_t *values = a->data;
+        uint16_t *result = out->data;
+        if (ROARING_ARRAY == b->type) {
+            out->count = intersect_arrays(values, a->count, b->data, b->count,
+                    result);
+        }
+        else if (ROARING_BITMAP == b->type) {
+            const uint64_t *words = b->data;
+            int32_t count = 0;
+            for (int32_t idx = 0; idx < a->count; ++idx) {
+                result[count] = values[idx];
+                count += (int32_t)((words[values[idx] / 64]
+                            >> (values[idx] % 64)) & 1);
+            }
+            out->count = count;
+        }
+        else {
+            // Both sorted: walk the runs along the values.
+            const uint16_t *runs = b->data;
+            int32_t count = 0, run = 0;
+            for (int32_t idx = 0; idx < a->count && run < b->count; ++idx) {
+                while (run < b->count && (uint32_t)runs[2 * run]
+                        + runs[2 * run + 1] < values[idx])
+                    ++run;
+                if (run < b->count && runs[2 * run] <= values[idx])
+                    result[count++] = values[idx];
+            }
+            out->count = count;
+        }
+        out->cardinality = out->count;
+
+        return 0;
+    }
+
+    if (ROARING_RUN == a->type && ROARING_RUN == b->type) {
+        if (0 != container_alloc(out, ROARING_RUN, a->count + b->count))
+            return -1;
+
+        const uint16_t *ra = a->data, *rb = b->data;
+        uint16_t *result = out->data;
+        int32_t i = 0, j = 0;
+        while (i < a->count && j < b->count) {
+            uint32_t endA = (uint32_t)ra[2 * i] + ra[2 * i + 1];
+            uint32_t endB = (uint32_t)rb[2 * j] + rb[2 * j + 1];
+            uint32_t first = ra[2 * i] > rb[2 * j] ? ra[2 * i] : rb[2 * j];
+            uint32_t last = endA < endB ? endA : endB;
+            if (first <= last) {
+                result[2 * out->count] = (uint16_t)first;
+                result[2 * out->count + 1] = (uint16_t)(last - first);
+                out->cardinality += (int32_t)(last - first + 1);
+                ++out->count;
+            }
+            if (endA < endB)
+                ++i;
+            else
+                ++j;
+        }
+
+        return 0;
+    }
+
+    // Bitmaps and runs: AND the words, the fused kernel sizes the result.
+    uint64_t scratchA[BITMAP_WORDS], scratchB[BITMAP_WORDS];
+    const uint64_t *wa = container_words(a, scratchA);
+    const uint64_t *wb = container_words(b, scratchB);
+    int32_t cardinality = (int32_t)count_bits_and(wa, wb, BITMAP_BYTES);
+
+    count_bits_and_words(scratchA, wa, wb, BITMAP_WORDS);
+    out->data = NULL;
+
+    return container_from_words(out, scratchA, cardinality);
+}
+
+// `out = a | b`.
+static int container_or(roaring_container_t *out,
+        const roaring_container_t *a, const roaring_container_t *b) {
+    if (ROARING_ARRAY == a->type && ROARING_ARRAY == b->type
+            && a->count + b->count <= ARRAY_MAX) {
+        if (0 != container_alloc(out, ROARING_ARRAY, a->count + b->count))
+            return -1;
+        out->count = union_arrays(a->data, a->count, b->data, b->count,
+                out->data);
+        out->cardinality = out->count;
+
+        return 0;
+    }
+
+    if (ROARING_RUN == a->type && ROARING_RUN == b->type) {
+        if (0 != container_alloc(out, ROARING_RUN, a->count + b->count))
+            return -1;
+
+        // Merge the runs by start, coalescing overlapping and adjacent ones.
+        const uint16_t *ra = a->data, *rb = b->data;
+        uint16_t *result = out->data;
+        int32_t i = 0, j = 0;
+        while (i < a->count || j < b->count) {
+            const uint16_t *run = j >= b->count
+                || (i < a->count && ra[2 * i] <= rb[2 * j])
+                ? &ra[2 * i++] : &rb[2 * j++];
+            uint32_t first = run[0], last = (uint32_t)run[0] + run[1];
+
+            if (0 != out->count) {
+                uint16_t *prev = &result[2 * (out->count - 1)];
+                uint32_t prevLast = (uint32_t)prev[0] + prev[1];
+                if (first <= prevLast + 1) {
+                    if (last > prevLast)
+                        prev[1] = (uint16_t)(last - prev[0]);
+                    continue;
+                }
+            }
+            result[2 * out->count] = (uint16_t)first;
+            result[2 * out->count + 1] = (uint16_t)(last - first);
+            ++out->count;
+        }
+
+        for (int32_t idx = 0; idx < out->count; ++idx)
+            out->cardinality += result[2 * idx + 1] + 1;
+
+        return 0;
+    }
+
+    // Everything else: OR the words, the bulk kernel counts them.
+    uint64_t scratchA[BITMAP_WORDS], scratchB[BITMAP_WORDS];
+    const uint64_t *wa = container_words(a, scratchA);
+    const uint64_t *wb = container_words(b, scratchB);
+    count_bits_or_words(scratchA, wa, wb, BITMAP_WORDS);
+    out->data = NULL;
+
+    return container_from_words(out, scratchA,
+            (int32_t)count_bits_buffer(scratchA, BITMAP_BYTES));
+}
+
+static int32_t container_and_cardinality(const roaring_container_t *a,
+        const roaring_container_t *b) {
+    if (ROARING_ARRAY != a->type && ROARING_ARRAY == b->type) {
+        const roaring_container_t *swap = a;
+        a = b;
+        b = swap;
+    }
+
+    if (ROARING_ARRAY == a->type && ROARING_ARRAY == b->type) {
+        uint16_t scratch[ARRAY_MAX + ARRAY_SLACK];
+        return intersect_arrays(a->data, a->count, b->data, b->count,
+                scratch);
+    }
+
+    if (ROARING_ARRAY == a->type) {
+        const uint16_t *values = a->data;
+        int32_t count = 0;
+        for (int32_t idx = 0; idx < a->count; ++idx)
+            count += container_contains(b, values[idx]);
+
+        return count;
+    }
+
+    uint64_t scratchA[BITMAP_WORDS], scratchB[BITMAP_WORDS];
+    return (int32_t)count_bits_and(container_words(a, scratchA),
+            container_words(b, scratchB), BITMAP_BYTES);
+}
+
+/*
+ * Bitmap.
+ */
+
+// Index of `key`, or `-(insertion point) - 1`.
+static int32_t key_find(const roaring_bitmap_t *r, uint16_t key) {
+    int32_t lo = 0, hi = r->size;
+    while (lo < hi) {
+        int32_t mid = (lo + hi) / 2;
+        if (r->keys[mid] < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo < r->size && r->keys[lo] == key ? lo : -lo - 1;
+}
+
+static int reserve(roaring_bitmap_t *r, int32_t size) {
+    if (size <= r->capacity)
+        return 0;
+
+    int32_t capacity = r->capacity < 4 ? 4 : r->capacity * 2;
+    uint16_t *keys = realloc(r->keys, capacity * sizeof(uint16_t));
+    if (NULL == keys)
+        return -1;
+    r->keys = keys;
+
+    roaring_container_t *containers = realloc(r->containers,
+            capacity * sizeof(roaring_container_t));
+    if (NULL == containers)
+        return -1;
+    r->containers = containers;
+    r->capacity = capacity;
+
+    return 0;
+}
+
+// Move `c` into `r` at `pos`.
+static int insert_container(roaring_bitmap_t *r, int32_t pos, uint16_t key,
+        roaring_container_t *c) {
+    if (0 != reserve(r, r->size + 1))
+        return -1;
+
+    memmove(r->keys + pos + 1, r->keys + pos,
+            (r->size - pos) * sizeof(uint16_t));
+    memmove(r->containers + pos + 1, r->containers + pos,
+            (r->size - pos) * sizeof(roaring_container_t));
+    r->keys[pos] = key;
+    r->containers[pos] = *c;
+    r->cardinality += c->cardinality;
+    ++r->size;
+
+    return 0;
+}
+
+static void erase_container(roaring_bitmap_t *r, int32_t pos) {
+    container_release(&r->containers[pos]);
+    memmove(r->keys + pos, r->keys + pos + 1,
+            (r->size - pos - 1) * sizeof(uint16_t));
+    memmove(r->containers + pos, r->containers + pos + 1,
+            (r->size - pos - 1) * sizeof(roaring_container_t));
+    --r->size;
+}
+
+// Append a result container, empty ones are released.
+static int append_container(roaring_bitmap_t *r, uint16_t key,
+        roaring_container_t *c) {
+    if (0 == c->cardinality) {
+        container_release(c);
+        return 0;
+    }
+    if (0 != insert_container(r, r->size, key, c)) {
+        container_release(c);
+        return -1;
+    }
+
+    return 0;
+}
+
+void roaring_init(roaring_bitmap_t *r) {
+    r->keys = NULL;
+    r->containers = NULL;
+    r->size = 0;
+    r->capacity = 0;
+    r->cardinality = 0;
+}
+
+void roaring_free(roaring_bitmap_t *r) {
+    for (int32_t idx = 0; idx < r->size; ++idx)
+        container_release(&r->containers[idx]);
+    free(r->keys);
+    free(r->containers);
+    roaring_init(r);
+}
+
+int roaring_add(roaring_bitmap_t *r, uint32_t value) {
+    uint16_t key = (uint16_t)(value >> 16), low = (uint16_t)value;
+    int32_t pos = key_find(r, key);
+    if (pos < 0) {
+        roaring_container_t c;
+        if (0 != container_alloc(&c, ROARING_ARRAY, 4))
+            return -1;
+        pos = -pos - 1;
+        if (0 != insert_container(r, pos, key, &c)) {
+            container_release(&c);
+            return -1;
+        }
+    }
+
+    roaring_container_t *c = &r->containers[pos];
+    if (ROARING_RUN == c->type && 0 != container_unrun(c))
+        return -1;
+
+    if (ROARING_ARRAY == c->type) {
+        uint16_t *values = c->data;
+        int32_t at = lower_bound(values, c->count, low);
+        if (at < c->count && values[at] == low)
+            return 0;
+
+        if (ARRAY_MAX == c->count) {
+            uint64_t scratch[BITMAP_WORDS];
+            if (0 != container_from_words(c, container_words(c, scratch),
+                        ARRAY_MAX + 1))
+                return -1;
+            // Counted again below.
+            c->cardinality = ARRAY_MAX;
+        }
+        else {
+            if (c->count == c->capacity) {
+                int32_t capacity = c->capacity * 2 < ARRAY_MAX
+                    ? c->capacity * 2 : ARRAY_MAX;
+                values = realloc(values,
+                        (capacity + ARRAY_SLACK) * sizeof(uint16_t));
+                if (NULL == values)
+                    return -1;
+                c->data = values;
+                c->capacity = capacity;
+            }
+            memmove(values + at + 1, values + at,
+                    (c->count - at) * sizeof(uint16_t));
+            values[at] = low;
+            ++c->count;
+            ++c->cardinality;
+            ++r->cardinality;
+
+            return 1;
+        }
+    }
+
+    uint64_t *words = c->data;
+    uint64_t bit = 1ULL << (low % 64);
+    if (0 != (words[low / 64] & bit))
+        return 0;
+    words[low / 64] |= bit;
+    ++c->cardinality;
+    ++r->cardinality;
+
+    return 1;
+}
+
+int roaring_remove(roaring_bitmap_t *r, uint32_t value) {
+    uint16_t low = (uint16_t)value;
+    int32_t pos = key_find(r, (uint16_t)(value >> 16));
+    if (pos < 0)
+        return 0;
+
+    roaring_container_t *c = &r->containers[pos];
+    if (!container_contains(c, low))
+        return 0;
+    if (ROARING_RUN == c->type && 0 != container_unrun(c))
+        return -1;
+
+    if (ROARING_ARRAY == c->type) {
+        uint16_t *values = c->data;
+        int32_t at = lower_bound(values, c->count, low);
+        memmove(values + at, values + at + 1,
+                (c->count - at - 1) * sizeof(uint16_t));
+        --c->count;
+    }
+    else {
+        ((uint64_t *)c->data)[low / 64] &= ~(1ULL << (low % 64));
+    }
+    --c->cardinality;
+    --r->cardinality;
+
+    if (0 == c->cardinality) {
+        erase_container(r, pos);
+    }
+    else if (ROARING_BITMAP == c->type && c->cardinality <= ARRAY_MAX) {
+        // Shrinking to an array is best-effort.
+        uint64_t words[BITMAP_WORDS];
+        memcpy(words, c->data, BITMAP_BYTES);
+        container_from_words(c, words, c->cardinality);
+    }
+
+    return 1;
+}
+
+int roaring_contains(const roaring_bitmap_t *r, uint32_t value) {
+    int32_t pos = key_find(r, (uint16_t)(value >> 16));
+    return pos >= 0 && container_contains(&r->containers[pos],
+            (uint16_t)value);
+}
+
+int roaring_and(roaring_bitmap_t *out, const roaring_bitmap_t *a,
+        const roaring_bitmap_t *b) {
+    roaring_free(out);
+
+    int32_t i = 0, j = 0;
+    while (i < a->size && j < b->size) {
+        if (a->keys[i] < b->keys[j]) {
+            ++i;
+        }
+        else if (a->keys[i] > b->keys[j]) {
+            ++j;
+        }
+        else {
+            roaring_container_t c;
+            if (0 != container_and(&c, &a->containers[i], &b->containers[j])
+                    || 0 != append_container(out, a->keys[i], &c))
+                return -1;
+            ++i;
+            ++j;
+        }
+    }
+
+    return 0;
+}
+
+int roaring_or(roaring_bitmap_t *out, const roaring_bitmap_t *a,
+        const roaring_bitmap_t *b) {
+    roaring_free(out);
+    if (0 != reserve(out, a->size + b->size))
+        return -1;
+
+    int32_t i = 0, j = 0;
+    while (i < a->size || j < b->size) {
+        roaring_container_t c;
+        uint16_t key;
+        int ret;
+        if (j >= b->size || (i < a->size && a->keys[i] < b->keys[j])) {
+            key = a->keys[i];
+            ret = container_clone(&c, &a->containers[i++]);
+        }
+        else if (i >= a->size || a->keys[i] > b->keys[j]) {
+            key = b->keys[j];
+            ret = container_clone(&c, &b->containers[j++]);
+        }
+        else {
+            key = a->keys[i];
+            ret = container_or(&c, &a->containers[i++], &b->containers[j++]);
+        }
+
+        if (0 != ret || 0 != append_container(out, key, &c))
+            return -1;
+    }
+
+    return 0;
+}
+
+uint64_t roaring_and_cardinality(const roaring_bitmap_t *a,
+        const roaring_bitmap_t *b) {
+    uint64_t cardinality = 0;
+    int32_t i = 0, j = 0;
+    while (i < a->size && j < b->size) {
+        if (a->keys[i] < b->keys[j]) {
+            ++i;
+        }
+        else if (a->keys[i] > b->keys[j]) {
+            ++j;
+        }
+        else {
+            cardinality += container_and_cardinality(&a->containers[i++],
+                    &b->containers[j++]);
+        }
+    }
+
+    return cardinality;
+}
+
+int roaring_run_optimize(roaring_bitmap_t *r) {
+    for (int32_t pos = 0; pos < r->size; ++pos) {
+        roaring_container_t *c = &r->containers[pos];
+        if (ROARING_RUN == c->type)
+            continue;
+
+        uint64_t scratch[BITMAP_WORDS];
+        const uint64_t *words = container_words(c, scratch);
+        int32_t runs = count_runs(words);
+        if ((size_t)runs * 2 * sizeof(uint16_t) >= container_size(c))
+            continue;
+
+        roaring_container_t result;
+        if (0 != container_alloc(&result, ROARING_RUN, runs))
+            return -1;
+
+        // Runs from the words: the next set bit starts one, the next clear
+        // bit ends it.
+        uint16_t *data = result.data;
+        uint32_t bit = 0;
+        while (bit < BITMAP_WORDS * 64) {
+            uint32_t word = bit / 64;
+            uint64_t bits = words[word] & (~0ULL << (bit % 64));
+            while (0 == bits && ++word < BITMAP_WORDS)
+                bits = words[word];
+            if (BITMAP_WORDS == word)
+                break;
+            uint32_t first = word * 64 + __builtin_ctzll(bits);
+
+            bits = ~words[word] & (~0ULL << (first % 64));
+            while (0 == bits && ++word < BITMAP_WORDS)
+                bits = ~words[word];
+            uint32_t end = BITMAP_WORDS == word
+                ? BITMAP_WORDS * 64 : word * 64 + __builtin_ctzll(bits);
+
+            data[2 * result.count] = (uint16_t)first;
+            data[2 * result.count + 1] = (uint16_t)(end - first - 1);
+            ++result.count;
+            bit = end;
+        }
+        result.cardinality = c->cardinality;
+
+        container_release(c);
+        *c = result;
+    }
+
+    return 0;
+}
+
+size_t roaring_size(const roaring_bitmap_t *r) {
+    size_t size = r->capacity
+        * (sizeof(uint16_t) + sizeof(roaring_container_t));
+    for (int32_t idx = 0; idx < r->size; ++idx)
+        size += container_size(&r->containers[idx]);
+
+    return size;
+}
@@ -0,0 +1,108 @@
+#ifndef ROARING_H
+#define ROARING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Container types, chosen per 2^16 chunk by what is smallest.
+enum {
+    ROARING_ARRAY,      ///< Sorted `uint16_t` values, at most 4096.
+    ROARING_BITMAP,     ///< 1024 words, more than 4096 values.
+    ROARING_RUN         ///< Sorted `(start, length - 1)` pairs.
+};
+
+/**
+ * @brief The values of one 2^16 chunk, i.e. sharing their high 16 bits.
+ */
+typedef struct {
+    void            *data;          ///< Values, words or run pairs.
+    int32_t         cardinality;    ///< Number of values, always up to date.
+    int32_t         count;          ///< Array values or runs in `data`.
+    int32_t         capacity;       ///< Allocated values or runs.
+    uint8_t         type;
+} roaring_container_t;
+
+/**
+ * @brief A compressed bitmap of 32-bit values (roaring layout).
+ *
+ * @details The containers are sorted by their key, the high 16 bits of the
+ * values. The cardinality is kept up to date by every operation, so it is
+ * O(1) to read.
+ */
+typedef struct {
+    uint16_t                *keys;
+    roaring_container_t     *containers;
+    int32_t                 size;
+    int32_t                 capacity;
+    uint64_t                cardinality;
+} roaring_bitmap_t;
+
+/**
+ * @brief Initialize an empty bitmap, no memory is allocated.
+ */
+void roaring_init(roaring_bitmap_t *r);
+
+/**
+ * @brief Release all memory of the bitmap, it is empty afterwards.
+ */
+void roaring_free(roaring_bitmap_t *r);
+
+/**
+ * @brief Add or remove a value.
+ *
+ * @return 1 if the bitmap changed, 0 if not, -1 if memory could not be
+ * allocated.
+ */
+int roaring_add(roaring_bitmap_t *r, uint32_t value);
+int roaring_remove(roaring_bitmap_t *r, uint32_t value);
+
+/**
+ * @brief 1 if the value is in the bitmap, otherwise 0.
+ */
+int roaring_contains(const roaring_bitmap_t *r, uint32_t value);
+
+/**
+ * @brief The number of values, O(1).
+ */
+static inline uint64_t roaring_cardinality(const roaring_bitmap_t *r) {
+    return r->cardinality;
+}
+
+/**
+ * @brief `out = a & b` and `out = a | b`. `out` must be initialized and must
+ * not be `a` or `b`, its previous values are released.
+ *
+ * @return 0 on success, -1 if memory could not be allocated.
+ */
+int roaring_and(roaring_bitmap_t *out, const roaring_bitmap_t *a,
+        const roaring_bitmap_t *b);
+int roaring_or(roaring_bitmap_t *out, const roaring_bitmap_t *a,
+        const roaring_bitmap_t *b);
+
+/**
+ * @brief `|a & b|` without building the intersection.
+ */
+uint64_t roaring_and_cardinality(const roaring_bitmap_t *a,
+        const roaring_bitmap_t *b);
+
+/**
+ * @brief Convert every container to a run container if that is smaller.
+ *
+ * @return 0 on success, -1 if memory could not be allocated.
+ */
+int roaring_run_optimize(roaring_bitmap_t *r);
+
+/**
+ * @brief The heap memory used by the bitmap in bytes.
+ */
+size_t roaring_size(const roaring_bitmap_t *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ROARING_H
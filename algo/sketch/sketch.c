@@ -0,0 +1,494 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SKETCH_X86
+#define SKETCH_TARGET(isa)  __attribute__((target(isa)))
+#else
+#define SKETCH_TARGET(isa)
+#endif
+
+#include "../count_bits/count_bits.h"
+#include "sketch.h"
+
+#define BLOCK_WORDS     8
+#define BLOCK_BITS      (BLOCK_WORDS * 32)
+
+// Keys between a prefetch and the test of their block.
+#define PREFETCH_AHEAD  8
+
+// Sizes are rounded up to this many bytes.
+#define CACHE_LINE      64
+
+#ifndef SKETCH_NO_MAIN
+#define BENCH_REPEAT    5
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+typedef struct {
+    sketch_bloom_t      *bloom;
+    sketch_hll_t        *hll;
+    sketch_linear_t     *linear;
+    uint64_t            first;
+    uint64_t            last;
+} insert_task_t;
+
+// Keys `first..last - 1`, hashed by `sketch_mix64`.
+static void *insert_worker(void *arg) {
+    insert_task_t *task = arg;
+    for (uint64_t key = task->first; key < task->last; ++key) {
+        uint64_t hash = sketch_mix64(key);
+        sketch_bloom_add_concurrent(task->bloom, hash);
+        sketch_hll_add_concurrent(task->hll, hash);
+        sketch_linear_add_concurrent(task->linear, hash);
+    }
+
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    // Usage: sketch [keys] [threads]
+    uint64_t keyCount = argc > 1 ? strtoull(argv[1], NULL, 10) : 1 << 22;
+    unsigned threadCount = argc > 2 ? strtoul(argv[2], NULL, 10) : 0;
+    if (0 == threadCount)
+        threadCount = (unsigned)sysconf(_SC_NPROCESSORS_ONLN);
+
+    sketch_bloom_t bloom, shared;
+    sketch_hll_t hll, sharedHll;
+    sketch_linear_t linear, sharedLinear;
+    uint64_t *hashes = malloc(keyCount * sizeof(uint64_t));
+    uint8_t *results = malloc(keyCount);
+    insert_task_t *tasks = calloc(threadCount, sizeof(insert_task_t));
+    pthread_t *threads = calloc(threadCount, sizeof(pthread_t));
+    if (NULL == hashes || NULL == results || NULL == tasks || NULL == threads
+            || 0 != sketch_bloom_init(&bloom, keyCount, 10)
+            || 0 != sketch_bloom_init(&shared, keyCount, 10)
+            || 0 != sketch_hll_init(&hll, 14)
+            || 0 != sketch_hll_init(&sharedHll, 14)
+            || 0 != sketch_linear_init(&linear, keyCount)
+            || 0 != sketch_linear_init(&sharedLinear, keyCount)) {
+        fprintf(stderr, "Cannot allocate sketches of %llu keys\n",
+                (unsigned long long)keyCount);
+        return 1;
+    }
+
+    double start = now_seconds();
+    for (uint64_t key = 0; key < keyCount; ++key) {
+        uint64_t hash = sketch_mix64(key);
+        sketch_bloom_add(&bloom, hash);
+        sketch_hll_add(&hll, hash);
+        sketch_linear_add(&linear, hash);
+    }
+    double serial = now_seconds() - start;
+
+    // The same keys from all threads at once must give the same sketches.
+    start = now_seconds();
+    for (unsigned idx = 0; idx < threadCount; ++idx) {
+        tasks[idx].bloom = &shared;
+        tasks[idx].hll = &sharedHll;
+        tasks[idx].linear = &sharedLinear;
+        tasks[idx].first = keyCount * idx / threadCount;
+        tasks[idx].last = keyCount * (idx + 1) / threadCount;
+    }
+    unsigned started = 1;
+    for (; started < threadCount; ++started)
+        if (0 != pthread_create(&threads[started], NULL, insert_worker,
+                    &tasks[started]))
+            break;
+    insert_worker(&tasks[0]);
+    for (unsigned idx = 1; idx < started; ++idx)
+        pthread_join(threads[idx], NULL);
+    for (unsigned idx = started; idx < threadCount; ++idx)
+        insert_worker(&tasks[idx]);
+    double concurrent = now_seconds() - start;
+
+    if (0 != memcmp(bloom.words, shared.words,
+                bloom.blockCount * BLOCK_BITS / 8)
+            || 0 != memcmp(hll.registers, sharedHll.registers,
+                (size_t)1 << hll.precision)
+            || 0 != memcmp(linear.bits, sharedLinear.bits,
+                linear.bitCount / 8)) {
+        fprintf(stderr, "Concurrent inserts differ from serial ones\n");
+        return 1;
+    }
+
+    // Inserted keys must all be found, new keys measure false positives.
+    for (uint64_t key = 0; key < keyCount; ++key)
+        hashes[key] = sketch_mix64(key);
+    sketch_bloom_contains_batch(&bloom, hashes, keyCount, results);
+    for (uint64_t key = 0; key < keyCount; ++key)
+        if (!results[key]) {
+            fprintf(stderr, "Key %llu is missing\n", (unsigned long long)key);
+            return 1;
+        }
+
+    for (uint64_t key = 0; key < keyCount; ++key)
+        hashes[key] = sketch_mix64(key + keyCount);
+    double bestSingle = 1e30, bestBatch = 1e30;
+    uint64_t positives = 0;
+    for (int rep = 0; rep < BENCH_REPEAT; ++rep) {
+        positives = 0;
+        start = now_seconds();
+        for (uint64_t key = 0; key < keyCount; ++key)
+            positives += sketch_bloom_contains(&bloom, hashes[key]);
+        double mid = now_seconds();
+        sketch_bloom_contains_batch(&bloom, hashes, keyCount, results);
+        double end = now_seconds();
+
+        if (mid - start < bestSingle)
+            bestSingle = mid - start;
+        if (end - mid < bestBatch)
+            bestBatch = end - mid;
+    }
+
+    printf("%llu keys, inserts: %.1f ns/key serial, %.1f ns/key with %u "
+            "threads (kernel: %s)\n", (unsigned long long)keyCount,
+            serial / keyCount * 1e9, concurrent / keyCount * 1e9,
+            threadCount, count_bits_kernel());
+    printf("Bloom: %.2f%% false positives, %.1f ns/probe, %.1f ns/probe "
+            "batched, estimate %.0f\n", 100.0 * positives / keyCount,
+            bestSingle / keyCount * 1e9, bestBatch / keyCount * 1e9,
+            sketch_bloom_estimate(&bloom));
+    printf("HyperLogLog (p = %u): estimate %.0f (%+.2f%%)\n", hll.precision,
+            sketch_hll_estimate(&hll),
+            100.0 * (sketch_hll_estimate(&hll) / keyCount - 1));
+    printf("Linear counting: estimate %.0f (%+.2f%%)\n",
+            sketch_linear_estimate(&linear),
+            100.0 * (sketch_linear_estimate(&linear) / keyCount - 1));
+
+    sketch_linear_free(&sharedLinear);
+    sketch_linear_free(&linear);
+    sketch_hll_free(&sharedHll);
+    sketch_hll_free(&hll);
+    sketch_bloom_free(&shared);
+    sketch_bloom_free(&bloom);
+    free(threads);
+    free(tasks);
+    free(results);
+    free(hashes);
+
+    return 0;
+}
+#endif
+
+uint64_t sketch_hash(const void *key, size_t length, uint64_t seed) {
+    const uint8_t *bytes = key;
+    uint64_t hash = seed ^ (length * 0x9E3779B97F4A7C15ULL);
+    for (; length >= 8; bytes += 8, length -= 8) {
+        uint64_t word;
+        memcpy(&word, bytes, 8);
+        hash = sketch_mix64(hash ^ word);
+    }
+
+    uint64_t tail = 0;
+    memcpy(&tail, bytes, length);
+    return sketch_mix64(hash ^ tail ^ ((uint64_t)length << 56));
+}
+
+// Allocate `bytes` rounded up to whole cache lines, zeroed.
+static void *alloc_lines(size_t bytes) {
+    bytes = (bytes + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    void *data = aligned_alloc(CACHE_LINE, bytes);
+    if (NULL != data)
+        memset(data, 0, bytes);
+
+    return data;
+}
+
+/*
+ * Bloom filter.
+ */
+
+// Odd multipliers of the split block Bloom filter (as in Parquet).
+static const uint32_t bloomSalts[BLOCK_WORDS] = {
+    0x47B6137BU, 0x44974D91U, 0x8824AD5BU, 0xA2B7289DU,
+    0x705495C7U, 0x2DF1424BU, 0x9EFC4947U, 0x5C6BFB31U
+};
+
+static inline uint32_t *bloom_block(const sketch_bloom_t *b, uint64_t hash) {
+    // `(high32 * blockCount) >> 32` maps the hash to a block without `%`.
+    return b->words + ((hash >> 32) * b->blockCount >> 32) * BLOCK_WORDS;
+}
+
+// The block as four 64-bit words, for the atomic inserts.
+typedef uint64_t bloom_word_t __attribute__((may_alias));
+
+static inline void bloom_masks(uint32_t key, uint32_t masks[BLOCK_WORDS]) {
+    for (int idx = 0; idx < BLOCK_WORDS; ++idx)
+        masks[idx] = 1U << ((key * bloomSalts[idx]) >> 27);
+}
+
+static void scalar_bloom_add(uint32_t *block, uint32_t key) {
+    uint32_t masks[BLOCK_WORDS];
+    bloom_masks(key, masks);
+    for (int idx = 0; idx < BLOCK_WORDS; ++idx)
+        block[idx] |= masks[idx];
+}
+
+static int scalar_bloom_contains(const uint32_t *block, uint32_t key) {
+    uint32_t masks[BLOCK_WORDS], missing = 0;
+    bloom_masks(key, masks);
+    for (int idx = 0; idx < BLOCK_WORDS; ++idx)
+        missing |= masks[idx] & ~block[idx];
+
+    return 0 == missing;
+}
+
+#ifdef SKETCH_X86
+SKETCH_TARGET("avx2")
+static inline __m256i avx2_bloom_masks(uint32_t key) {
+    const __m256i salts = _mm256_loadu_si256((const __m256i *)bloomSalts);
+    __m256i shifts = _mm256_srli_epi32(
+            _mm256_mullo_epi32(_mm256_set1_epi32((int)key), salts), 27);
+    return _mm256_sllv_epi32(_mm256_set1_epi32(1), shifts);
+}
+
+SKETCH_TARGET("avx2")
+static void avx2_bloom_add(uint32_t *block, uint32_t key) {
+    __m256i *v = (__m256i *)block;
+    _mm256_store_si256(v, _mm256_or_si256(_mm256_load_si256(v),
+                avx2_bloom_masks(key)));
+}
+
+SKETCH_TARGET("avx2")
+static int avx2_bloom_contains(const uint32_t *block, uint32_t key) {
+    // `vptest`: carry is set if every bit of the masks is in the block.
+    return _mm256_testc_si256(_mm256_load_si256((const __m256i *)block),
+            avx2_bloom_masks(key));
+}
+#endif
+
+// The probes, AVX2 if the selected count_bits kernel is AVX2 or better.
+static void (*bloomAdd)(uint32_t *block, uint32_t key) = scalar_bloom_add;
+static int (*bloomContains)(const uint32_t *block, uint32_t key) =
+    scalar_bloom_contains;
+
+/**
+ * @brief Pick the probes from the count_bits dispatch, so that
+ * `COUNT_BITS_KERNEL` also forces the portable probes.
+ */
+__attribute__((constructor))
+static void select_probes(void) {
+#ifdef SKETCH_X86
+    const char *kernel = count_bits_kernel();
+    if (0 == strcmp("avx2", kernel) || 0 == strcmp("avx512", kernel)) {
+        bloomAdd = avx2_bloom_add;
+        bloomContains = avx2_bloom_contains;
+    }
+#endif
+}
+
+int sketch_bloom_init(sketch_bloom_t *b, size_t keyCount, double bitsPerKey) {
+    double bits = keyCount * bitsPerKey;
+    // Whole cache lines, i.e. an even number of blocks.
+    b->blockCount = ((size_t)(bits / BLOCK_BITS) + 2) & ~(size_t)1;
+    b->words = alloc_lines(b->blockCount * BLOCK_BITS / 8);
+
+    return NULL == b->words ? -1 : 0;
+}
+
+void sketch_bloom_free(sketch_bloom_t *b) {
+    free(b->words);
+    b->words = NULL;
+    b->blockCount = 0;
+}
+
+void sketch_bloom_add(sketch_bloom_t *b, uint64_t hash) {
+    bloomAdd(bloom_block(b, hash), (uint32_t)hash);
+}
+
+void sketch_bloom_add_concurrent(sketch_bloom_t *b, uint64_t hash) {
+    uint32_t masks[BLOCK_WORDS];
+    uint64_t wide[BLOCK_WORDS / 2], missing[BLOCK_WORDS / 2], any = 0;
+    bloom_masks((uint32_t)hash, masks);
+    memcpy(wide, masks, sizeof(wide));
+
+    // The whole block is read first, a key already present writes nothing
+    // and the cache line stays shared.
+    bloom_word_t *block = (bloom_word_t *)bloom_block(b, hash);
+    for (int idx = 0; idx < BLOCK_WORDS / 2; ++idx) {
+        missing[idx] = wide[idx]
+            & ~__atomic_load_n(&block[idx], __ATOMIC_RELAXED);
+        any |= missing[idx];
+    }
+    if (0 == any)
+        return;
+
+    for (int idx = 0; idx < BLOCK_WORDS / 2; ++idx)
+        if (0 != missing[idx])
+            __atomic_fetch_or(&block[idx], wide[idx], __ATOMIC_RELAXED);
+}
+
+int sketch_bloom_contains(const sketch_bloom_t *b, uint64_t hash) {
+    return bloomContains(bloom_block(b, hash), (uint32_t)hash);
+}
+
+void sketch_bloom_contains_batch(const sketch_bloom_t *b,
+        const uint64_t *hashes, size_t count, uint8_t *results) {
+    for (size_t idx = 0; idx < count; ++idx) {
+        if (idx + PREFETCH_AHEAD < count)
+            __builtin_prefetch(bloom_block(b, hashes[idx + PREFETCH_AHEAD]));
+        results[idx] = (uint8_t)bloomContains(bloom_block(b, hashes[idx]),
+                (uint32_t)hashes[idx]);
+    }
+}
+
+int sketch_bloom_merge(sketch_bloom_t *b, const sketch_bloom_t *other) {
+    if (b->blockCount != other->blockCount)
+        return -1;
+
+    for (size_t idx = 0; idx < b->blockCount * BLOCK_WORDS; ++idx)
+        b->words[idx] |= other->words[idx];
+
+    return 0;
+}
+
+double sketch_bloom_estimate(const sketch_bloom_t *b) {
+    double bits = (double)b->blockCount * BLOCK_BITS;
+    double ones = (double)count_bits_buffer(b->words, b->blockCount
+            * BLOCK_BITS / 8);
+
+    return -(bits / BLOCK_WORDS) * log1p(-ones / bits);
+}
+
+/*
+ * HyperLogLog.
+ */
+
+int sketch_hll_init(sketch_hll_t *h, unsigned precision) {
+    h->registers = NULL;
+    h->precision = precision;
+    if (precision < 4 || precision > 18)
+        return -1;
+
+    h->registers = alloc_lines((size_t)1 << precision);
+
+    return NULL == h->registers ? -1 : 0;
+}
+
+void sketch_hll_free(sketch_hll_t *h) {
+    free(h->registers);
+    h->registers = NULL;
+}
+
+// The register of the hash is its top `precision` bits, the rank counts the
+// leading zeros of the rest, plus one.
+static inline uint8_t hll_rank(uint64_t hash, unsigned precision) {
+    uint64_t rest = hash << precision;
+    return 0 == rest ? (uint8_t)(64 - precision + 1)
+        : (uint8_t)(__builtin_clzll(rest) + 1);
+}
+
+void sketch_hll_add(sketch_hll_t *h, uint64_t hash) {
+    uint8_t *reg = &h->registers[hash >> (64 - h->precision)];
+    uint8_t rank = hll_rank(hash, h->precision);
+    if (rank > *reg)
+        *reg = rank;
+}
+
+void sketch_hll_add_concurrent(sketch_hll_t *h, uint64_t hash) {
+    uint8_t *reg = &h->registers[hash >> (64 - h->precision)];
+    uint8_t rank = hll_rank(hash, h->precision);
+
+    // Registers only grow, a failed exchange retries with the new value.
+    uint8_t old = __atomic_load_n(reg, __ATOMIC_RELAXED);
+    while (rank > old && !__atomic_compare_exchange_n(reg, &old, rank, 1,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+int sketch_hll_merge(sketch_hll_t *h, const sketch_hll_t *other) {
+    if (h->precision != other->precision)
+        return -1;
+
+    for (size_t idx = 0; idx < (size_t)1 << h->precision; ++idx)
+        if (other->registers[idx] > h->registers[idx])
+            h->registers[idx] = other->registers[idx];
+
+    return 0;
+}
+
+double sketch_hll_estimate(const sketch_hll_t *h) {
+    size_t m = (size_t)1 << h->precision;
+    double sum = 0;
+    size_t zeros = 0;
+    for (size_t idx = 0; idx < m; ++idx) {
+        sum += ldexp(1.0, -h->registers[idx]);
+        zeros += 0 == h->registers[idx];
+    }
+
+    double alpha = 16 == m ? 0.673 : 32 == m ? 0.697 : 64 == m ? 0.709
+        : 0.7213 / (1 + 1.079 / m);
+    double estimate = alpha * m * m / sum;
+
+    // Small cardinalities: linear counting of the empty registers.
+    if (estimate <= 2.5 * m && 0 != zeros)
+        estimate = m * log((double)m / zeros);
+
+    return estimate;
+}
+
+/*
+ * Linear counting.
+ */
+
+int sketch_linear_init(sketch_linear_t *l, uint64_t bitCount) {
+    l->bitCount = (bitCount + CACHE_LINE * 8 - 1) / (CACHE_LINE * 8)
+        * (CACHE_LINE * 8);
+    if (0 == l->bitCount)
+        l->bitCount = CACHE_LINE * 8;
+    l->bits = alloc_lines(l->bitCount / 8);
+
+    return NULL == l->bits ? -1 : 0;
+}
+
+void sketch_linear_free(sketch_linear_t *l) {
+    free(l->bits);
+    l->bits = NULL;
+    l->bitCount = 0;
+}
+
+static inline uint64_t linear_bit(const sketch_linear_t *l, uint64_t hash) {
+    // The full 64x64-bit product maps the hash to `[0, bitCount)`.
+    __extension__ typedef unsigned __int128 wide_t;
+    return (uint64_t)(((wide_t)hash * l->bitCount) >> 64);
+}
+
+void sketch_linear_add(sketch_linear_t *l, uint64_t hash) {
+    uint64_t bit = linear_bit(l, hash);
+    l->bits[bit / 64] |= 1ULL << (bit % 64);
+}
+
+void sketch_linear_add_concurrent(sketch_linear_t *l, uint64_t hash) {
+    uint64_t bit = linear_bit(l, hash), mask = 1ULL << (bit % 64);
+    if (0 == (mask & __atomic_load_n(&l->bits[bit / 64], __ATOMIC_RELAXED)))
+        __atomic_fetch_or(&l->bits[bit / 64], mask, __ATOMIC_RELAXED);
+}
+
+int sketch_linear_merge(sketch_linear_t *l, const sketch_linear_t *other) {
+    if (l->bitCount != other->bitCount)
+        return -1;
+
+    for (uint64_t idx = 0; idx < l->bitCount / 64; ++idx)
+        l->bits[idx] |= other->bits[idx];
+
+    return 0;
+}
+
+double sketch_linear_estimate(const sketch_linear_t *l) {
+    double m = (double)l->bitCount;
+    double zeros = m - (double)count_bits_buffer(l->bits, l->bitCount / 8);
+
+    return m * log(m / zeros);
+}
@@ -0,0 +1,156 @@
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Finalizer of splitmix64, a bijective mix of an integer key.
+ */
+static inline uint64_t sketch_mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+/**
+ * @brief A 64-bit hash of `length` bytes, every word goes through
+ * `sketch_mix64`. Not meant to resist adversarial keys.
+ */
+uint64_t sketch_hash(const void *key, size_t length, uint64_t seed);
+
+/*
+ * All sketches take the 64-bit hash of a key. `*_add` is for one writer,
+ * `*_add_concurrent` can be called by many threads at once (relaxed atomic
+ * read-modify-writes, no locks) and gives the same sketch as serial inserts.
+ * Queries may run during concurrent inserts and see every completed insert.
+ */
+
+/**
+ * @brief Split block Bloom filter: every key sets one bit in each of the
+ * eight 32-bit words of one 256-bit block.
+ *
+ * @details The block is chosen by the high 32 bits of the hash, the bit of
+ * word `i` by the top 5 bits of `low32 * salt[i]`. A probe reads one aligned
+ * 256-bit block (half a cache line), with AVX2 the eight bit masks come
+ * from one `vpmulld` and one `vpsllvd` and the test is one `vptest`.
+ */
+typedef struct {
+    uint32_t        *words;         ///< `blockCount * 8` words, aligned.
+    size_t          blockCount;
+} sketch_bloom_t;
+
+/**
+ * @brief Initialize an empty filter of `keyCount * bitsPerKey` bits, rounded
+ * up to whole cache lines. 10 bits per key give about 1.3% false
+ * positives.
+ *
+ * @return 0 on success, -1 if memory could not be allocated.
+ */
+int sketch_bloom_init(sketch_bloom_t *b, size_t keyCount, double bitsPerKey);
+void sketch_bloom_free(sketch_bloom_t *b);
+
+void sketch_bloom_add(sketch_bloom_t *b, uint64_t hash);
+void sketch_bloom_add_concurrent(sketch_bloom_t *b, uint64_t hash);
+
+/**
+ * @brief 1 if the key may be in the set, 0 if it is certainly not.
+ */
+int sketch_bloom_contains(const sketch_bloom_t *b, uint64_t hash);
+
+/**
+ * @brief `results[i] = sketch_bloom_contains(b, hashes[i])`, the blocks of
+ * later keys are prefetched while earlier ones are tested.
+ */
+void sketch_bloom_contains_batch(const sketch_bloom_t *b,
+        const uint64_t *hashes, size_t count, uint8_t *results);
+
+/**
+ * @brief `b |= other`, i.e. the union of the sets.
+ *
+ * @return 0 on success, -1 if the filters differ in size.
+ */
+int sketch_bloom_merge(sketch_bloom_t *b, const sketch_bloom_t *other);
+
+/**
+ * @brief The number of distinct keys estimated from the set bits (counted
+ * with `count_bits_buffer`), `-(m / k) * ln(1 - ones / m)`.
+ */
+double sketch_bloom_estimate(const sketch_bloom_t *b);
+
+/**
+ * @brief HyperLogLog: `2^precision` registers of one byte, each holding the
+ * longest run of leading zeros (plus one) seen in its share of the hashes.
+ */
+typedef struct {
+    uint8_t         *registers;
+    unsigned        precision;      ///< 4 to 18, the error is 1.04 / 2^(p/2).
+} sketch_hll_t;
+
+/**
+ * @return 0 on success, -1 if `precision` is out of range or memory could
+ * not be allocated.
+ */
+int sketch_hll_init(sketch_hll_t *h, unsigned precision);
+void sketch_hll_free(sketch_hll_t *h);
+
+void sketch_hll_add(sketch_hll_t *h, uint64_t hash);
+void sketch_hll_add_concurrent(sketch_hll_t *h, uint64_t hash);
+
+/**
+ * @brief `h = max(h, other)` register by register, i.e. the union.
+ *
+ * @return 0 on success, -1 if the precisions differ.
+ */
+int sketch_hll_merge(sketch_hll_t *h, const sketch_hll_t *other);
+
+/**
+ * @brief The number of distinct keys: the harmonic mean estimate, linear
+ * counting of the empty registers while that is more accurate.
+ */
+double sketch_hll_estimate(const sketch_hll_t *h);
+
+/**
+ * @brief Linear counting: a bitmap with one bit set per key.
+ */
+typedef struct {
+    uint64_t        *bits;          ///< 64-byte aligned.
+    uint64_t        bitCount;
+} sketch_linear_t;
+
+/**
+ * @brief Initialize an empty bitmap of `bitCount` bits, rounded up to whole
+ * cache lines. It counts well up to a few times `bitCount` keys.
+ *
+ * @return 0 on success, -1 if memory could not be allocated.
+ */
+int sketch_linear_init(sketch_linear_t *l, uint64_t bitCount);
+void sketch_linear_free(sketch_linear_t *l);
+
+void sketch_linear_add(sketch_linear_t *l, uint64_t hash);
+void sketch_linear_add_concurrent(sketch_linear_t *l, uint64_t hash);
+
+/**
+ * @brief `l |= other`, i.e. the union.
+ *
+ * @return 0 on success, -1 if the bitmaps differ in size.
+ */
+int sketch_linear_merge(sketch_linear_t *l, const sketch_linear_t *other);
+
+/**
+ * @brief `-m * ln(zeros / m)`, the zeros are counted with
+ * `count_bits_buffer`. Infinite once every bit is set.
+ */
+double sketch_linear_estimate(const sketch_linear_t *l);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SKETCH_H
@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "histogram_cpu.hpp"
+
+#define HIST_WIDTH      128
+#define HIST_NUM        8
+#define BLOCK_NUM       512
+#define DATA_LENGTH     (2 * HIST_WIDTH * HIST_NUM * BLOCK_NUM + HIST_WIDTH * 3)
+#define BENCH_REPEAT    5
+
+/**
+ * @brief Compare both histograms of `length` keys over `binCount` bins with
+ * a loop over the keys.
+ */
+static bool check_bins(size_t length, size_t binCount,
+        cpu::work_stealing_pool &pool) {
+    std::vector<int> keys(length);
+    std::vector<double> values(length);
+    std::vector<uint64_t> expectedKeys(binCount), expectedValues(binCount);
+    for (size_t idx = 0; idx < length; ++idx) {
+        const uint64_t hash = idx * 0x9E3779B97F4A7C15ull >> 20;
+        // A few keys out of range on either side.
+        keys[idx] = static_cast<int>(hash % (binCount + 10)) - 5;
+        values[idx] = 0 == idx % 1001 ? NAN
+            : static_cast<double>(hash % 100000) * 1e-3 - 5.0;
+        if (keys[idx] >= 0 && keys[idx] < static_cast<int>(binCount))
+            ++expectedKeys[keys[idx]];
+        if (values[idx] >= -2.0 && values[idx] < 90.0)
+            ++expectedValues[std::min(static_cast<size_t>(
+                            (values[idx] + 2.0) * (binCount / 92.0)),
+                        binCount - 1)];
+    }
+
+    std::vector<uint64_t> bins(binCount, 7);
+    cpu::histogram(keys.data(), length, binCount, bins.data(), pool);
+    if (bins != expectedKeys) {
+        std::cerr << "histogram, " << length << " keys, " << binCount
+            << " bins: wrong counts" << std::endl;
+        return false;
+    }
+    cpu::histogram_binned(values.data(), length, -2.0, 90.0, binCount,
+            bins.data(), pool);
+    if (bins != expectedValues) {
+        std::cerr << "histogram_binned, " << length << " values, " << binCount
+            << " bins: wrong counts" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    // Usage: histogram_cpu [MiB] [threads]
+    size_t mebibytes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 256;
+    unsigned threadCount = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 0;
+    cpu::work_stealing_pool pool(threadCount);
+
+    // The data of `reduce.cu`: every key of `HIST_WIDTH` equally often.
+    std::vector<int> h_inputArr(DATA_LENGTH);
+    for (int idx = 0; idx < DATA_LENGTH; ++idx)
+        h_inputArr[idx] = idx % HIST_WIDTH;
+    std::vector<uint32_t> counts(HIST_WIDTH);
+    cpu::histogram(h_inputArr.data(), DATA_LENGTH, HIST_WIDTH, counts.data(),
+            pool);
+    for (int idx = 0; idx < HIST_WIDTH; ++idx)
+        if (counts[idx] != 2 * HIST_NUM * BLOCK_NUM + 3) {
+            std::cerr << "Bin " << idx << ": " << counts[idx] << std::endl;
+            return 1;
+        }
+
+    // Every path: small tables, private histograms, shared histograms.
+    const size_t shapes[][2] = {
+        {0, 4}, {3, 1}, {1000, 7}, {100000, 1024}, {100000, 1025},
+        {300000, 100000}, {300000, 1 << 18}, {100000, 1 << 23},
+    };
+    for (const auto &shape : shapes)
+        if (!check_bins(shape[0], shape[1], pool))
+            return 1;
+
+    // Room for one private histogram of 4 Mi bins: two workers count into
+    // it and the output, of three the first and the last share the output
+    // by atomic adds and the second has the histogram to itself.
+    for (unsigned workers : {2, 3}) {
+        cpu::work_stealing_pool few(workers);
+        if (!check_bins(300000, 1 << 22, few))
+            return 1;
+    }
+
+    // Throughput by bin count, against one thread incrementing one
+    // histogram.
+    const size_t length = mebibytes << 18;
+    std::vector<uint32_t> keys(length);
+    for (size_t idx = 0; idx < length; ++idx)
+        keys[idx] = static_cast<uint32_t>(idx * 0x9E3779B97F4A7C15ull >> 32);
+
+    std::cout << mebibytes << " MiB of keys, " << pool.size() << " threads\n";
+    for (size_t binCount : {16, 256, 4096, 1 << 16, 1 << 20, 1 << 24}) {
+        std::vector<uint32_t> binKeys(length);
+        for (size_t idx = 0; idx < length; ++idx)
+            binKeys[idx] = keys[idx] % binCount;
+        std::vector<uint64_t> serial(binCount), bins(binCount);
+
+        double bestSerial = 1e30, bestHistogram = 1e30;
+        for (int rep = 0; rep < BENCH_REPEAT; ++rep) {
+            auto start = std::chrono::steady_clock::now();
+            std::fill(serial.begin(), serial.end(), 0);
+            for (size_t idx = 0; idx < length; ++idx)
+                ++serial[binKeys[idx]];
+            auto mid = std::chrono::steady_clock::now();
+            cpu::histogram(binKeys.data(), length, binCount, bins.data(),
+                    pool);
+            auto end = std::chrono::steady_clock::now();
+
+            bestSerial = std::min(bestSerial,
+                    std::chrono::duration<double>(mid - start).count());
+            bestHistogram = std::min(bestHistogram,
+                    std::chrono::duration<double>(end - mid).count());
+        }
+        if (bins != serial) {
+            std::cerr << binCount << " bins: wrong counts" << std::endl;
+            return 1;
+        }
+
+        std::cout << binCount << " bins: 1 thread "
+            << length / bestSerial * 1e-9 << " G keys/s, cpu::histogram "
+            << length / bestHistogram * 1e-9 << " G keys/s\n";
+    }
+    std::cout << std::flush;
+
+    return 0;
+}
@@ -0,0 +1,270 @@
+#ifndef HISTOGRAM_CPU_HPP
+#define HISTOGRAM_CPU_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "reduce_cpu.hpp"
+
+/**
+ * @file histogram_cpu.hpp
+ *
+ * @brief Histograms of integer keys and of binned floating point values on
+ * CPU threads, the `HIST_WIDTH` by `HIST_NUM` workload of `reduce.cu` as an
+ * API (C++17).
+ */
+
+namespace cpu {
+
+namespace detail {
+
+// Up to this many bins a chunk is counted into four small 32-bit tables,
+// which stay in L1 together.
+constexpr size_t histogram_small_bins = 1024;
+
+// Bytes of the private histograms of all workers at most. Beyond, workers
+// share the histograms that fit.
+constexpr size_t histogram_private_bytes = 64 << 20;
+
+// Bins merged per chunk of the merge.
+constexpr size_t histogram_merge_bins = 4096;
+
+/**
+ * @brief Count the bins `binOf(i)` of the elements `i` in `[0, length)`
+ * into `bins`; `binOf` returns `binCount` for an element to skip.
+ *
+ * @details Three ways, by the size of the histogram:
+ *
+ * - Up to `histogram_small_bins` bins, as the counting pass of a radix
+ *   sort: a chunk is counted four elements at a time into four interleaved
+ *   32-bit tables on the stack, so that runs of equal keys do not wait on
+ *   each other's increments, and the tables are added to the private
+ *   histogram of the worker. Four tables of more bins no longer fit in L1
+ *   and are slower than one.
+ * - Up to `histogram_private_bytes` for the private histograms of all
+ *   workers, straight into the private histogram of the worker.
+ * - Beyond, the workers share the histograms that fit in
+ *   `histogram_private_bytes` and `bins`, round robin, by relaxed atomic
+ *   adds; a worker with a histogram to itself counts without atomics, on a
+ *   single thread straight into `bins`.
+ *
+ * Every way looks up four bins before it counts them, so the loads of the
+ * next elements do not wait on the increments. The private histograms start
+ * on a cache line each and have one more bin for the skipped elements, so
+ * counting does not branch. They are summed into `bins` by the pool, a
+ * range of bins per chunk.
+ */
+template < class CountType, class BinOf >
+void histogram(
+        const size_t            length,
+        const size_t            binCount,
+        CountType *const        bins,
+        const BinOf             &binOf,
+        work_stealing_pool      &pool
+        ) {
+    static_assert(std::is_integral<CountType>::value,
+            "The counts must be integers");
+    if (0 == binCount)
+        return;
+    std::fill(bins, bins + binCount, CountType(0));
+
+    const size_t chunkLength = reduce_chunk_elements;
+    const size_t chunkCount = (length + chunkLength - 1) / chunkLength;
+
+    // Rows a whole number of cache lines from a line start: one per worker
+    // if they fit, else as many as fit.
+    const size_t lineCounts = 64 / sizeof(CountType);
+    const size_t pitch = (binCount + 1 + lineCounts - 1) / lineCounts
+        * lineCounts;
+    const size_t rowCount = std::min<size_t>(pool.size(),
+            histogram_private_bytes / sizeof(CountType) / pitch);
+    std::vector<CountType> storage(rowCount * pitch + lineCounts);
+    CountType *const rows = storage.data()
+        + (64 - reinterpret_cast<uintptr_t>(storage.data()) % 64) % 64
+        / sizeof(CountType);
+
+    if (rowCount < pool.size()) {
+        // Group 0 counts into `bins`, group `g` into row `g - 1`; workers
+        // `g`, `g + groups`, ... share it.
+        const size_t groups = rowCount + 1;
+        pool.parallel_for(chunkCount, [&](size_t chunk, unsigned worker) {
+            const size_t group = worker % groups;
+            const bool shared = group + groups < pool.size();
+            CountType *const row = 0 == group ? bins
+                : rows + (group - 1) * pitch;
+            auto count = [&](size_t bin) -> void {
+                if (bin >= binCount)
+                    return;
+                if (shared)
+                    __atomic_fetch_add(row + bin, CountType(1),
+                            __ATOMIC_RELAXED);
+                else
+                    ++row[bin];
+            };
+            const size_t first = chunk * chunkLength;
+            const size_t last = std::min(length, first + chunkLength);
+            size_t idx = first;
+            for (; idx + 4 <= last; idx += 4) {
+                const size_t bin0 = binOf(idx), bin1 = binOf(idx + 1);
+                const size_t bin2 = binOf(idx + 2), bin3 = binOf(idx + 3);
+                count(bin0);
+                count(bin1);
+                count(bin2);
+                count(bin3);
+            }
+            for (; idx < last; ++idx)
+                count(binOf(idx));
+        });
+    }
+    else if (binCount <= histogram_small_bins) {
+        pool.parallel_for(chunkCount, [&](size_t chunk, unsigned worker) {
+            uint32_t table[4][histogram_small_bins + 1] = {};
+            const size_t first = chunk * chunkLength;
+            const size_t last = std::min(length, first + chunkLength);
+            size_t idx = first;
+            for (; idx + 4 <= last; idx += 4) {
+                const size_t bin0 = binOf(idx), bin1 = binOf(idx + 1);
+                const size_t bin2 = binOf(idx + 2), bin3 = binOf(idx + 3);
+                ++table[0][bin0];
+                ++table[1][bin1];
+                ++table[2][bin2];
+                ++table[3][bin3];
+            }
+            for (; idx < last; ++idx)
+                ++table[0][binOf(idx)];
+
+            CountType *const row = rows + worker * pitch;
+            REDUCE_CPU_SIMD
+            for (size_t bin = 0; bin < binCount; ++bin)
+                row[bin] += table[0][bin] + table[1][bin] + table[2][bin]
+                    + table[3][bin];
+        });
+    }
+    else {
+        pool.parallel_for(chunkCount, [&](size_t chunk, unsigned worker) {
+            CountType *const row = rows + worker * pitch;
+            const size_t first = chunk * chunkLength;
+            const size_t last = std::min(length, first + chunkLength);
+            size_t idx = first;
+            for (; idx + 4 <= last; idx += 4) {
+                const size_t bin0 = binOf(idx), bin1 = binOf(idx + 1);
+                const size_t bin2 = binOf(idx + 2), bin3 = binOf(idx + 3);
+                ++row[bin0];
+                ++row[bin1];
+                ++row[bin2];
+                ++row[bin3];
+            }
+            for (; idx < last; ++idx)
+                ++row[binOf(idx)];
+        });
+    }
+
+    if (0 == rowCount)
+        return;
+    const size_t mergeCount = (binCount + histogram_merge_bins - 1)
+        / histogram_merge_bins;
+    pool.parallel_for(mergeCount, [&](size_t chunk, unsigned) {
+        const size_t first = chunk * histogram_merge_bins;
+        const size_t last = std::min(binCount, first + histogram_merge_bins);
+        for (size_t r = 0; r < rowCount; ++r) {
+            const CountType *const row = rows + r * pitch;
+            REDUCE_CPU_SIMD
+            for (size_t bin = first; bin < last; ++bin)
+                bins[bin] += row[bin];
+        }
+    });
+}
+
+} // namespace detail
+
+/**
+ * @brief Count how many keys fall into each of `binCount` bins, on CPU
+ * threads.
+ *
+ * @details Key `k` counts in bin `k`; negative keys and keys from
+ * `binCount` on are skipped. See `detail::histogram` for the privatized
+ * per-worker histograms and the memory bound.
+ *
+ * @tparam      KeyType         An integer type.
+ * @tparam      CountType       An integer type, wide enough for the counts.
+ *
+ * @param[in]   keys            The keys.
+ * @param[in]   length          The number of keys.
+ * @param[in]   binCount        The number of bins.
+ * @param[out]  bins            The `binCount` counts, overwritten.
+ * @param[in]   pool            The threads to run on.
+ *
+ * Throws `std::bad_alloc` if the private histograms cannot be allocated.
+ */
+template < class KeyType, class CountType >
+void
+histogram(
+        const KeyType *const    keys,
+        const size_t            length,
+        const size_t            binCount,
+        CountType *const        bins,
+        work_stealing_pool      &pool = work_stealing_pool::shared()
+        ) {
+    static_assert(std::is_integral<KeyType>::value,
+            "The keys must be integers, see histogram_binned");
+    typedef typename std::make_unsigned<KeyType>::type unsigned_t;
+    detail::histogram(length, binCount, bins, [&](size_t idx) -> size_t {
+        const size_t key = static_cast<unsigned_t>(keys[idx]);
+        return std::is_signed<KeyType>::value && keys[idx] < 0 ? binCount
+            : std::min(key, binCount);
+    }, pool);
+}
+
+/**
+ * @brief Count how many values fall into each of `binCount` bins of equal
+ * width over `[lower, upper)`, on CPU threads.
+ *
+ * @details Value `v` counts in bin `(v - lower) * binCount / (upper -
+ * lower)`, rounded down, values outside `[lower, upper)` and NaN are
+ * skipped. Otherwise as `histogram`.
+ *
+ * @tparam      ValueType       A floating point type.
+ * @tparam      CountType       An integer type, wide enough for the counts.
+ *
+ * @param[in]   values          The values.
+ * @param[in]   length          The number of values.
+ * @param[in]   lower           The lower bound of bin 0.
+ * @param[in]   upper           The upper bound of the last bin, greater than
+ * `lower`.
+ * @param[in]   binCount        The number of bins.
+ * @param[out]  bins            The `binCount` counts, overwritten.
+ * @param[in]   pool            The threads to run on.
+ *
+ * Throws `std::bad_alloc` if the private histograms cannot be allocated.
+ */
+template < class ValueType, class CountType >
+void
+histogram_binned(
+        const ValueType *const  values,
+        const size_t            length,
+        const ValueType         lower,
+        const ValueType         upper,
+        const size_t            binCount,
+        CountType *const        bins,
+        work_stealing_pool      &pool = work_stealing_pool::shared()
+        ) {
+    static_assert(std::is_floating_point<ValueType>::value,
+            "The values must be floating point, see histogram");
+    const ValueType scale = static_cast<ValueType>(binCount)
+        / (upper - lower);
+    detail::histogram(length, binCount, bins, [&](size_t idx) -> size_t {
+        const ValueType value = values[idx];
+        if (!(value >= lower && value < upper))
+            return binCount;
+        // Rounding may give `binCount` just below `upper`.
+        return std::min(static_cast<size_t>((value - lower) * scale),
+                binCount - 1);
+    }, pool);
+}
+
+} // namespace cpu
+
+#endif // HISTOGRAM_CPU_HPP
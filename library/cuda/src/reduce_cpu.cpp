@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#include "reduce_cpu.hpp"
+
+#define HIST_WIDTH      128
+#define HIST_NUM        8
+#define BLOCK_NUM       512
+#define DATA_LENGTH     (2 * HIST_WIDTH * HIST_NUM * BLOCK_NUM + HIST_WIDTH * 3)
+#define RESULT_LENGTH   HIST_WIDTH * (BLOCK_NUM + 1)
+#define BENCH_REPEAT    5
+
+/**
+ * @brief Reduce `length` elements to one by launches of 1-D blocks, the
+ * output of a launch is the input of the next one, as on the GPU.
+ */
+template < class DataType, class Operation >
+static DataType reduce_all(
+        const DataType *const   inputArr,
+        size_t                  length,
+        std::vector<DataType>   &buffer,
+        const Operation         &oper,
+        const DataType          identity,
+        cpu::work_stealing_pool &pool
+        ) {
+    const cpu::dim3 blockSize(512);
+    const DataType *input = inputArr;
+    size_t offset = 0;
+    do {
+        const size_t blocks = (length + 2 * blockSize.x - 1)
+            / (2 * blockSize.x);
+        DataType *const output = buffer.data() + offset;
+        cpu::g1b2_reduce_x(cpu::dim3(blocks), blockSize, input, length,
+                output, oper, identity, pool);
+        input = output;
+        offset += blocks;
+        length = blocks;
+    } while (length > 1);
+
+    return input[0];
+}
+
+int main(int argc, char *argv[]) {
+    // Usage: reduce_cpu [MiB] [threads]
+    size_t mebibytes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 256;
+    unsigned threadCount = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 0;
+    cpu::work_stealing_pool pool(threadCount);
+
+    // The launch of `reduce.cu`.
+    std::vector<int> h_inputArr(DATA_LENGTH), h_outputArr(RESULT_LENGTH);
+    for (int idx = 0; idx < DATA_LENGTH; ++idx)
+        h_inputArr[idx] = idx % HIST_WIDTH;
+
+    const cpu::dim3 gridSize(BLOCK_NUM + 1);
+    const cpu::dim3 blockSize(HIST_NUM, HIST_WIDTH);
+    auto oper = [](int &l, int &r) -> void { l += r; r = 0; };
+    cpu::g1b2_reduce_x(gridSize, blockSize, h_inputArr.data(), DATA_LENGTH,
+            h_outputArr.data(), oper, 0, pool);
+
+    // Column `y` of a full block is `2 * HIST_NUM` times `y`, of the last
+    // one 3 times.
+    for (int idx = 0; idx < RESULT_LENGTH; ++idx) {
+        const int rows = idx < HIST_WIDTH * BLOCK_NUM ? 2 * HIST_NUM : 3;
+        if (h_outputArr[idx] != rows * (idx % HIST_WIDTH)) {
+            std::cerr << "Output " << idx << ": " << h_outputArr[idx]
+                << std::endl;
+            return 1;
+        }
+    }
+    for (int idx = RESULT_LENGTH - 512; idx < RESULT_LENGTH; ++idx)
+        std::cout << h_outputArr[idx] << " ";
+    std::cout << std::endl;
+
+    // Reductions from inside the chunks of a pool, on the same pool and on a
+    // smaller one, whose workers index their own shared memory.
+    // The first chunks wait for each other, so every worker takes part.
+    cpu::work_stealing_pool outer(4), inner(2);
+    std::vector<int> ones(100000, 1), nestedSums(16);
+    std::atomic<unsigned> started{0};
+    outer.parallel_for(nestedSums.size(), [&](size_t chunk, unsigned) {
+        started.fetch_add(1);
+        while (started.load() < outer.size())
+            std::this_thread::yield();
+        std::vector<int> buffer(ones.size() / 512 + 64);
+        nestedSums[chunk] = reduce_all(ones.data(), ones.size() - chunk,
+                buffer, oper, 0, chunk % 2 ? inner : outer);
+    });
+    for (size_t chunk = 0; chunk < nestedSums.size(); ++chunk)
+        if (nestedSums[chunk] != static_cast<int>(ones.size() - chunk)) {
+            std::cerr << "Nested sum " << chunk << ": " << nestedSums[chunk]
+                << std::endl;
+            return 1;
+        }
+
+    // Sums of a large array against one thread summing it in order.
+    const size_t length = mebibytes << 18;
+    std::vector<int> ints(length);
+    std::vector<float> floats(length);
+    for (size_t idx = 0; idx < length; ++idx) {
+        ints[idx] = static_cast<int>(idx * 2654435761u % 1000);
+        floats[idx] = ints[idx] * 1e-3f;
+    }
+    std::vector<int> intBuffer(length / 512 + 64);
+    std::vector<float> floatBuffer(length / 512 + 64);
+    auto addFloat = [](float &l, float &r) -> void { l += r; r = 0; };
+
+    double bestSerial = 1e30, bestInt = 1e30, bestFloat = 1e30;
+    long long serial = 0;
+    int intSum = 0;
+    float floatSum = 0;
+    for (int rep = 0; rep < BENCH_REPEAT; ++rep) {
+        auto start = std::chrono::steady_clock::now();
+        serial = std::accumulate(ints.begin(), ints.end(), 0LL);
+        auto mid = std::chrono::steady_clock::now();
+        intSum = reduce_all(ints.data(), length, intBuffer, oper, 0, pool);
+        auto next = std::chrono::steady_clock::now();
+        floatSum = reduce_all(floats.data(), length, floatBuffer, addFloat,
+                0.0f, pool);
+        auto end = std::chrono::steady_clock::now();
+
+        bestSerial = std::min(bestSerial,
+                std::chrono::duration<double>(mid - start).count());
+        bestInt = std::min(bestInt,
+                std::chrono::duration<double>(next - mid).count());
+        bestFloat = std::min(bestFloat,
+                std::chrono::duration<double>(end - next).count());
+    }
+    if (static_cast<int>(serial) != intSum) {
+        std::cerr << "Sum " << intSum << ", expected "
+            << static_cast<int>(serial) << std::endl;
+        return 1;
+    }
+
+    // The tree does not depend on the threads, neither does a float sum.
+    cpu::work_stealing_pool single(1);
+    if (floatSum != reduce_all(floats.data(), length, floatBuffer, addFloat,
+                0.0f, single)) {
+        std::cerr << "The float sum depends on the thread count" << std::endl;
+        return 1;
+    }
+
+    const double bytes = length * sizeof(int);
+    std::cout << mebibytes << " MiB, " << pool.size() << " threads\n"
+        << "std::accumulate, 1 thread: " << bytes / bestSerial * 1e-9
+        << " GB/s\n"
+        << "g1b2_reduce_x, int:        " << bytes / bestInt * 1e-9
+        << " GB/s\n"
+        << "g1b2_reduce_x, float:      " << bytes / bestFloat * 1e-9
+        << " GB/s (sum " << floatSum << ")" << std::endl;
+
+    return 0;
+}
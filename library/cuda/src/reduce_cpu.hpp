@@ -0,0 +1,173 @@
+#ifndef REDUCE_CPU_HPP
+#define REDUCE_CPU_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "work_stealing_pool.hpp"
+
+/**
+ * @file reduce_cpu.hpp
+ *
+ * @brief The reductions of `reduce.cu` on CPU threads, for hosts without a
+ * GPU (C++17).
+ *
+ * @details The functions take the operands of the device functions, plus the
+ * launch configuration that the device functions read from `gridDim` and
+ * `blockDim`, and a pool of threads. The innermost loops are marked for
+ * vectorization (`omp simd` with `-fopenmp`, `GCC ivdep` otherwise); build
+ * with `-O3` so that the compiler does vectorize them once `oper` is
+ * inlined.
+ */
+
+#if defined(_OPENMP)
+#define REDUCE_CPU_SIMD     _Pragma("omp simd")
+#else
+#define REDUCE_CPU_SIMD     _Pragma("GCC ivdep")
+#endif
+
+namespace cpu {
+
+/**
+ * @brief The sizes of a grid or a block, as `dim3` of CUDA.
+ */
+struct dim3 {
+    unsigned    x = 1;
+    unsigned    y = 1;
+    unsigned    z = 1;
+
+    constexpr dim3(unsigned vx = 1, unsigned vy = 1, unsigned vz = 1)
+        : x(vx), y(vy), z(vz) {}
+};
+
+namespace detail {
+
+// Elements per chunk of blocks handed to a worker, about 128 KiB of `int`.
+constexpr size_t reduce_chunk_elements = 1 << 15;
+
+/**
+ * @brief The tree of `g1b2_reduce_x` on the rows of one block.
+ *
+ * @details `sdata` holds `rows` rows of `width` elements. Every step
+ * combines row `x` with row `x + stride` for the rows in the lower half, the
+ * rows of a step are contiguous, so one loop runs over all of their
+ * elements. For `rows` a power of 2 this is the order of the GPU.
+ */
+template < class DataType, class Operation >
+void reduce_rows(
+        DataType *const         sdata,
+        size_t                  rows,
+        const size_t            width,
+        const Operation         &oper
+        ) {
+    for (; rows > 1; rows = (rows + 1) / 2) {
+        const size_t stride = (rows + 1) / 2;
+        const size_t length = (rows - stride) * width;
+        DataType *const right = sdata + stride * width;
+        REDUCE_CPU_SIMD
+        for (size_t idx = 0; idx < length; ++idx)
+            oper(sdata[idx], right[idx]);
+    }
+}
+
+} // namespace detail
+
+/**
+ * @brief Perform general 1-D grid, 2-D block reduce, along X-direction, on
+ * CPU threads.
+ *
+ * @details The CPU counterpart of `g1b2_reduce_x` in `reduce.cu` with the
+ * same result layout: block `b` reduces the `2 * blockDim.x * blockDim.y`
+ * elements from `b * 2 * blockDim.x * blockDim.y`, read as rows of
+ * `blockDim.y`, along X, and writes one result per Y row to
+ * `outputArr[b * blockDim.y + y]`. Missing elements are `identity`.
+ *
+ * A block is reduced in a per-worker array of `blockDim.x * blockDim.y`
+ * elements, the shared memory of the GPU, that stays in L1: the first step
+ * reads both halves of the block from the input, the following ones halve
+ * the rows in place. The blocks are handed to the pool in chunks of about
+ * 32 Ki elements.
+ *
+ * @tparam      DataType        The type of data, which is processed.
+ * @tparam      Operation       The operation type, it is related to the lambda
+ * function parameter.
+ *
+ * @param[in]   gridDim         The number of blocks, `gridDim.x`.
+ * @param[in]   blockDim        The block shape, `blockDim.x` and `blockDim.y`.
+ * @param[in]   inputArr        The input array.
+ * @param[in]   inputArrLength  The length of the input array.
+ * @param[out]  outputArr       The output array, its length must be
+ * `gridDim.x * blockDim.y`.
+ * @param[in]   oper            The operation performed on two elements, the
+ * same function or lambda expression as on the GPU: it takes two references,
+ * stores the result in the first one and may set the second one to
+ * `identity`. It must not throw.
+ * @param[in]   identity        The identity of the operation.
+ * @param[in]   pool            The threads to run on.
+ */
+template < class DataType, class Operation >
+void
+g1b2_reduce_x(
+        const dim3              gridDim,
+        const dim3              blockDim,
+        const DataType *const   inputArr,
+        const size_t            inputArrLength,
+        DataType *const         outputArr,
+        const Operation         &oper,
+        const DataType          identity,
+        work_stealing_pool      &pool = work_stealing_pool::shared()
+        ) {
+    const size_t width = blockDim.y;
+    const size_t initStride = static_cast<size_t>(blockDim.x) * width;
+    const size_t blockCount = gridDim.x;
+    if (0 == initStride || 0 == blockCount)
+        return;
+
+    // Shared memory of every worker, a cache line apart.
+    const size_t pitch = initStride + (64 + sizeof(DataType) - 1)
+        / sizeof(DataType);
+    std::vector<DataType> shared(pool.size() * pitch);
+
+    const size_t chunkBlocks = std::max<size_t>(1,
+            detail::reduce_chunk_elements / (2 * initStride));
+    const size_t chunkCount = (blockCount + chunkBlocks - 1) / chunkBlocks;
+
+    pool.parallel_for(chunkCount, [&](size_t chunk, unsigned worker) {
+        DataType *const sdata = shared.data() + worker * pitch;
+        const size_t last = std::min(blockCount, (chunk + 1) * chunkBlocks);
+        for (size_t blockIdx = chunk * chunkBlocks; blockIdx < last;
+                ++blockIdx) {
+            // The first step, both halves from the input.
+            const size_t first = 2 * blockIdx * initStride;
+            if (first + 2 * initStride <= inputArrLength) {
+                const DataType *const left = inputArr + first;
+                const DataType *const right = left + initStride;
+                REDUCE_CPU_SIMD
+                for (size_t idx = 0; idx < initStride; ++idx) {
+                    DataType value = right[idx];
+                    sdata[idx] = left[idx];
+                    oper(sdata[idx], value);
+                }
+            }
+            else {
+                const size_t length = inputArrLength > first
+                    ? inputArrLength - first : 0;
+                for (size_t idx = 0; idx < initStride; ++idx) {
+                    DataType value = idx + initStride < length
+                        ? inputArr[first + initStride + idx] : identity;
+                    sdata[idx] = idx < length ? inputArr[first + idx]
+                        : identity;
+                    oper(sdata[idx], value);
+                }
+            }
+
+            detail::reduce_rows(sdata, blockDim.x, width, oper);
+            std::copy(sdata, sdata + width, outputArr + blockIdx * width);
+        }
+    });
+}
+
+} // namespace cpu
+
+#endif // REDUCE_CPU_HPP
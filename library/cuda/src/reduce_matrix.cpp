@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "reduce_matrix.hpp"
+
+#define BENCH_REPEAT    5
+
+/**
+ * @brief Element `(r, c)` of a matrix, in order.
+ */
+template < class DataType >
+static DataType at(
+        const std::vector<DataType> &matrix,
+        size_t                  r,
+        size_t                  c,
+        size_t                  ld,
+        cpu::matrix_order       order
+        ) {
+    return cpu::matrix_order::row_major == order ? matrix[r * ld + c]
+        : matrix[c * ld + r];
+}
+
+/**
+ * @brief Compare `reduce_matrix` with a loop over the elements on every
+ * order and axis of a `rows` by `cols` matrix.
+ */
+static bool check_shape(size_t rows, size_t cols,
+        cpu::work_stealing_pool &pool) {
+    auto oper = [](long long &l, long long &r) -> void { l += r; r = 0; };
+    for (auto order : {cpu::matrix_order::row_major,
+            cpu::matrix_order::col_major}) {
+        const bool rowMajor = cpu::matrix_order::row_major == order;
+        const size_t ld = (rowMajor ? cols : rows) + 3;
+        std::vector<long long> matrix((rowMajor ? rows : cols) * ld, -1000);
+        for (size_t r = 0; r < rows; ++r)
+            for (size_t c = 0; c < cols; ++c)
+                (rowMajor ? matrix[r * ld + c] : matrix[c * ld + r])
+                    = static_cast<long long>((r * 7919 + c * 104729) % 1001);
+
+        for (auto axis : {cpu::matrix_axis::row, cpu::matrix_axis::column}) {
+            const bool byRow = cpu::matrix_axis::row == axis;
+            std::vector<long long> output(byRow ? rows : cols, -1);
+            cpu::reduce_matrix(matrix.data(), rows, cols, ld, order, axis,
+                    output.data(), oper, 0LL, pool);
+            for (size_t idx = 0; idx < output.size(); ++idx) {
+                long long expected = 0;
+                for (size_t k = 0; k < (byRow ? cols : rows); ++k)
+                    expected += byRow ? at(matrix, idx, k, ld, order)
+                        : at(matrix, k, idx, ld, order);
+                if (output[idx] != expected) {
+                    std::cerr << rows << "x" << cols << (rowMajor ? " row"
+                            : " column") << "-major, by " << (byRow ? "row"
+                            : "column") << ", result " << idx << ": "
+                        << output[idx] << ", expected " << expected
+                        << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    // Usage: reduce_matrix [MiB] [threads]
+    size_t mebibytes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 256;
+    unsigned threadCount = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 0;
+    cpu::work_stealing_pool pool(threadCount);
+
+    // Shapes around the lane count, the tile and the piece length.
+    const size_t shapes[][2] = {
+        {0, 5}, {5, 0}, {1, 1}, {3, 31}, {33, 3}, {8, 128}, {128, 8},
+        {2, 70000}, {70000, 2}, {300, 2100}, {2100, 300}, {5000, 257},
+    };
+    for (const auto &shape : shapes)
+        if (!check_shape(shape[0], shape[1], pool))
+            return 1;
+
+    // Column sums of a tall and row sums of a wide float matrix, both
+    // row-major, against one thread.
+    const size_t length = mebibytes << 18;
+    std::vector<float> matrix(length);
+    for (size_t idx = 0; idx < length; ++idx)
+        matrix[idx] = static_cast<float>(idx * 2654435761u % 1000) * 1e-3f;
+    auto addFloat = [](float &l, float &r) -> void { l += r; r = 0; };
+
+    // At least one row, on less than 4 MiB too.
+    const size_t narrowRows = std::max<size_t>(1, length / 64);
+    const size_t wideRows = std::max<size_t>(1, length >> 20);
+    struct bench_t {
+        const char          *name;
+        size_t              rows;
+        cpu::matrix_axis    axis;
+        double              best;
+    } benches[] = {
+        {"by row,    64 columns  ", narrowRows, cpu::matrix_axis::row, 1e30},
+        {"by row,    1 Mi columns", wideRows, cpu::matrix_axis::row, 1e30},
+        {"by column, 64 columns  ", narrowRows, cpu::matrix_axis::column,
+            1e30},
+        {"by column, 1 Mi columns", wideRows, cpu::matrix_axis::column, 1e30},
+    };
+
+    cpu::work_stealing_pool single(1);
+    for (auto &bench : benches) {
+        const size_t cols = length / bench.rows;
+        const size_t outputs = cpu::matrix_axis::row == bench.axis
+            ? bench.rows : cols;
+        std::vector<float> output(outputs), reference(outputs);
+        for (int rep = 0; rep < BENCH_REPEAT; ++rep) {
+            auto start = std::chrono::steady_clock::now();
+            cpu::reduce_matrix(matrix.data(), bench.rows, cols, cols,
+                    cpu::matrix_order::row_major, bench.axis, output.data(),
+                    addFloat, 0.0f, pool);
+            auto end = std::chrono::steady_clock::now();
+            bench.best = std::min(bench.best,
+                    std::chrono::duration<double>(end - start).count());
+        }
+
+        cpu::reduce_matrix(matrix.data(), bench.rows, cols, cols,
+                cpu::matrix_order::row_major, bench.axis, reference.data(),
+                addFloat, 0.0f, single);
+        if (output != reference) {
+            std::cerr << bench.name << ": the sums depend on the thread count"
+                << std::endl;
+            return 1;
+        }
+    }
+
+    const double bytes = length * sizeof(float);
+    std::cout << mebibytes << " MiB of float, row-major, " << pool.size()
+        << " threads\n";
+    for (const auto &bench : benches)
+        std::cout << "reduce_matrix, " << bench.name << ": "
+            << bytes / bench.best * 1e-9 << " GB/s\n";
+    std::cout << std::flush;
+
+    return 0;
+}
@@ -0,0 +1,264 @@
+#ifndef REDUCE_MATRIX_HPP
+#define REDUCE_MATRIX_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "reduce_cpu.hpp"
+
+/**
+ * @file reduce_matrix.hpp
+ *
+ * @brief Batched reduction of the rows or the columns of a matrix on CPU
+ * threads, the `HIST_NUM` rows of a `g1b2_reduce_x` block as an API (C++17).
+ */
+
+namespace cpu {
+
+/**
+ * @brief The storage order of a matrix.
+ */
+enum class matrix_order {
+    row_major,      ///< Element `(r, c)` at `r * ld + c`.
+    col_major       ///< Element `(r, c)` at `c * ld + r`.
+};
+
+/**
+ * @brief The axis a matrix is reduced along.
+ */
+enum class matrix_axis {
+    row,            ///< Every row to one element, `rows` results.
+    column          ///< Every column to one element, `cols` results.
+};
+
+namespace detail {
+
+// Independent accumulators of a contiguous line, enough for two vectors of
+// `int` with AVX-512.
+constexpr size_t reduce_lanes = 32;
+
+// Bytes of the accumulator tile when lines are reduced element-wise.
+constexpr size_t reduce_tile_bytes = 8 << 10;
+
+// Line chunks a tile is split into at most, bounds the partials.
+constexpr size_t reduce_max_line_chunks = 64;
+
+/**
+ * @brief Reduce `length` contiguous elements to one.
+ *
+ * @details Element `i` goes to accumulator `i % reduce_lanes`, the loop over
+ * the accumulators vectorizes, and the accumulators are reduced by the tree
+ * of `reduce_rows`. The grouping depends on `length` only.
+ */
+template < class DataType, class Operation >
+DataType reduce_line(
+        const DataType *const   line,
+        const size_t            length,
+        const Operation         &oper,
+        const DataType          identity
+        ) {
+    DataType acc[reduce_lanes];
+    std::fill(acc, acc + reduce_lanes, identity);
+
+    size_t idx = 0;
+    for (; idx + reduce_lanes <= length; idx += reduce_lanes) {
+        const DataType *const block = line + idx;
+        REDUCE_CPU_SIMD
+        for (size_t lane = 0; lane < reduce_lanes; ++lane) {
+            DataType value = block[lane];
+            oper(acc[lane], value);
+        }
+    }
+    for (size_t lane = 0; idx < length; ++idx, ++lane) {
+        DataType value = line[idx];
+        oper(acc[lane], value);
+    }
+
+    reduce_rows(acc, reduce_lanes, 1, oper);
+    return acc[0];
+}
+
+/**
+ * @brief Combine `lines` lines of `width` elements, `pitch` apart,
+ * element-wise into `acc`, which holds the first line on entry.
+ */
+template < class DataType, class Operation >
+void reduce_lines(
+        DataType *const         acc,
+        const DataType          *line,
+        size_t                  lines,
+        const size_t            width,
+        const size_t            pitch,
+        const Operation         &oper
+        ) {
+    for (; lines > 0; --lines, line += pitch) {
+        REDUCE_CPU_SIMD
+        for (size_t idx = 0; idx < width; ++idx) {
+            DataType value = line[idx];
+            oper(acc[idx], value);
+        }
+    }
+}
+
+} // namespace detail
+
+/**
+ * @brief Reduce every row or every column of a matrix to one element, on CPU
+ * threads.
+ *
+ * @details The matrix is stored as `lines` of contiguous elements, `ld`
+ * apart: the rows of a row-major matrix, the columns of a column-major one.
+ * Depending on `order` and `axis` it is reduced in one of two ways.
+ *
+ * Along the lines (rows of a row-major matrix): every line is cut into
+ * pieces of about 32 Ki elements and a piece is reduced by
+ * `detail::reduce_line`. Short lines are handed to the pool several at a
+ * time, long ones piece by piece, the partials of the pieces of a line are
+ * then combined in order.
+ *
+ * Across the lines (columns of a row-major matrix): the elements of a line
+ * are cut into tiles of 8 KiB and the lines into chunks, at most 64 per
+ * tile. A chunk of lines is combined element-wise into a tile of
+ * accumulators that stays in L1, one loop over the tile per line, so the
+ * results of neighbouring rows or columns are computed in the same vector.
+ * The partials of the chunks are then combined in order, tile by tile.
+ *
+ * The grouping of the elements depends on the shape only, so the results do
+ * not depend on the number of threads, floating point sums included.
+ *
+ * @tparam      DataType        The type of data, which is processed.
+ * @tparam      Operation       The operation type, it is related to the lambda
+ * function parameter.
+ *
+ * @param[in]   inputMat        The matrix.
+ * @param[in]   rows            The number of rows.
+ * @param[in]   cols            The number of columns.
+ * @param[in]   ld              The distance between the first elements of two
+ * lines, at least `cols` for row-major and `rows` for column-major.
+ * @param[in]   order           The storage order of `inputMat`.
+ * @param[in]   axis            Reduce every `row` or every `column`.
+ * @param[out]  outputArr       The results, `rows` for `matrix_axis::row`,
+ * `cols` for `matrix_axis::column`. An empty row or column gives `identity`.
+ * @param[in]   oper            The operation performed on two elements, as
+ * for `g1b2_reduce_x`: associative and commutative, it stores the result in
+ * the first reference and may set the second one to `identity`. It must not
+ * throw.
+ * @param[in]   identity        The identity of the operation.
+ * @param[in]   pool            The threads to run on.
+ *
+ * Throws `std::bad_alloc` if the partials cannot be allocated.
+ */
+template < class DataType, class Operation >
+void
+reduce_matrix(
+        const DataType *const   inputMat,
+        const size_t            rows,
+        const size_t            cols,
+        const size_t            ld,
+        const matrix_order      order,
+        const matrix_axis       axis,
+        DataType *const         outputArr,
+        const Operation         &oper,
+        const DataType          identity,
+        work_stealing_pool      &pool = work_stealing_pool::shared()
+        ) {
+    const bool rowMajor = matrix_order::row_major == order;
+    const size_t lines = rowMajor ? rows : cols;
+    const size_t width = rowMajor ? cols : rows;
+    const bool alongLines = rowMajor == (matrix_axis::row == axis);
+
+    if (alongLines) {
+        if (0 == lines)
+            return;
+        const size_t pieceLength = detail::reduce_chunk_elements;
+        const size_t pieces = std::max<size_t>(1,
+                (width + pieceLength - 1) / pieceLength);
+
+        if (1 == pieces) {
+            // Whole lines, several per chunk.
+            const size_t chunkLines = std::max<size_t>(1,
+                    pieceLength / std::max<size_t>(1, width));
+            pool.parallel_for((lines + chunkLines - 1) / chunkLines,
+                    [&](size_t chunk, unsigned) {
+                const size_t last = std::min(lines, (chunk + 1) * chunkLines);
+                for (size_t line = chunk * chunkLines; line < last; ++line)
+                    outputArr[line] = detail::reduce_line(inputMat + line * ld,
+                            width, oper, identity);
+            });
+            return;
+        }
+
+        std::vector<DataType> partials(lines * pieces);
+        pool.parallel_for(lines * pieces, [&](size_t task, unsigned) {
+            const size_t line = task / pieces, piece = task % pieces;
+            const size_t first = piece * pieceLength;
+            partials[task] = detail::reduce_line(inputMat + line * ld + first,
+                    std::min(pieceLength, width - first), oper, identity);
+        });
+        pool.parallel_for(lines, [&](size_t line, unsigned) {
+            DataType *const part = partials.data() + line * pieces;
+            for (size_t piece = 1; piece < pieces; ++piece)
+                oper(part[0], part[piece]);
+            outputArr[line] = part[0];
+        });
+        return;
+    }
+
+    if (0 == width)
+        return;
+    if (0 == lines) {
+        std::fill(outputArr, outputArr + width, identity);
+        return;
+    }
+
+    const size_t tileWidth = std::min(width, std::max<size_t>(1,
+                detail::reduce_tile_bytes / sizeof(DataType)));
+    const size_t tiles = (width + tileWidth - 1) / tileWidth;
+    const size_t chunkLines = std::max({
+            detail::reduce_chunk_elements / tileWidth,
+            (lines + detail::reduce_max_line_chunks - 1)
+                / detail::reduce_max_line_chunks,
+            size_t(1)});
+    const size_t lineChunks = (lines + chunkLines - 1) / chunkLines;
+
+    // The partial of chunk `k` goes to row `k` of `partials`, the first
+    // chunk straight to the output.
+    std::vector<DataType> partials((lineChunks - 1) * width);
+    auto partialRow = [&](size_t chunk) -> DataType * {
+        return 0 == chunk ? outputArr
+            : partials.data() + (chunk - 1) * width;
+    };
+
+    pool.parallel_for(tiles * lineChunks, [&](size_t task, unsigned) {
+        const size_t tile = task % tiles, chunk = task / tiles;
+        const size_t column = tile * tileWidth;
+        const size_t tileLength = std::min(tileWidth, width - column);
+        const size_t firstLine = chunk * chunkLines;
+        const size_t lineCount = std::min(chunkLines, lines - firstLine);
+
+        const DataType *const first = inputMat + firstLine * ld + column;
+        DataType *const acc = partialRow(chunk) + column;
+        std::copy(first, first + tileLength, acc);
+        detail::reduce_lines(acc, first + ld, lineCount - 1, tileLength, ld,
+                oper);
+    });
+
+    if (1 == lineChunks)
+        return;
+    pool.parallel_for(tiles, [&](size_t tile, unsigned) {
+        const size_t column = tile * tileWidth;
+        const size_t tileLength = std::min(tileWidth, width - column);
+        for (size_t chunk = 1; chunk < lineChunks; ++chunk) {
+            DataType *const right = partialRow(chunk) + column;
+            DataType *const acc = outputArr + column;
+            REDUCE_CPU_SIMD
+            for (size_t idx = 0; idx < tileLength; ++idx)
+                oper(acc[idx], right[idx]);
+        }
+    });
+}
+
+} // namespace cpu
+
+#endif // REDUCE_MATRIX_HPP
@@ -0,0 +1,345 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "reduce_popcount.hpp"
+
+// Words per chunk of blocks handed to a thread (2 MiB).
+#define CHUNK_WORDS     (1 << 18)
+
+#ifndef REDUCE_POPCOUNT_NO_MAIN
+#define HIST_WIDTH      128
+#define HIST_NUM        8
+#define BLOCK_NUM       512
+#define DATA_LENGTH     (2 * HIST_WIDTH * HIST_NUM * BLOCK_NUM + HIST_WIDTH * 3)
+#define BENCH_REPEAT    5
+
+/**
+ * @brief One block of `g1b2_reduce_x` as the GPU runs it, every step of the
+ * threads of the block in turn, with `popcount` as the first operation.
+ */
+static void emulate_block(
+        const uint64_t *const   inputArr,
+        const size_t            inputArrLength,
+        const block_dim_t       blockDim,
+        const size_t            blockIdx,
+        uint64_t *const         outputArr
+        ) {
+    const size_t initStride = blockDim.x * blockDim.y;
+    std::vector<uint64_t> sdata(2 * initStride);
+
+    for (size_t sdataAbsIdx = 0; sdataAbsIdx < initStride; ++sdataAbsIdx) {
+        size_t inputArrAbsIdx = 2 * blockIdx * initStride + sdataAbsIdx;
+        sdata[sdataAbsIdx] = inputArrAbsIdx < inputArrLength
+            ? __builtin_popcountll(inputArr[inputArrAbsIdx]) : 0;
+        sdata[sdataAbsIdx + initStride]
+            = inputArrAbsIdx + initStride < inputArrLength
+            ? __builtin_popcountll(inputArr[inputArrAbsIdx + initStride]) : 0;
+    }
+
+    // The rows still to reduce, halved every step: the strides of
+    // `reduce.cu` for a power of 2 `blockDim.x`. For an odd stride the
+    // kernel steps by `stride >> 1 + 1`, a shift by two, and drops rows;
+    // `popcount_reduce_x` sums all of them, as here. Thread `x` reads row
+    // `x + stride`, which no thread of the same step writes.
+    for (size_t rows = 2 * blockDim.x; rows > 1; rows = (rows + 1) / 2) {
+        size_t stride = (rows + 1) / 2;
+        for (size_t x = 0; x + stride < rows; ++x)
+            for (size_t y = 0; y < blockDim.y; ++y)
+                sdata[x * blockDim.y + y]
+                    += sdata[(x + stride) * blockDim.y + y];
+    }
+
+    for (size_t y = 0; y < blockDim.y; ++y)
+        outputArr[blockIdx * blockDim.y + y] = sdata[y];
+}
+
+int main(int argc, char *argv[]) {
+    // Usage: reduce_popcount [MiB] [threads]
+    size_t mebibytes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 256;
+    unsigned threadCount = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 0;
+
+    // The launch of `reduce.cu`, one block more than `BLOCK_NUM` for the
+    // last three rows.
+    const block_dim_t blockDim = { HIST_NUM, HIST_WIDTH };
+    const size_t gridSize = popcount_grid_x(DATA_LENGTH, blockDim);
+    std::vector<uint64_t> inputArr(DATA_LENGTH);
+    for (size_t idx = 0; idx < inputArr.size(); ++idx)
+        inputArr[idx] = idx % HIST_WIDTH * 0x9E3779B97F4A7C15ULL;
+
+    std::vector<uint64_t> expected(gridSize * HIST_WIDTH);
+    std::vector<uint64_t> blockArr(expected.size()), outputArr(HIST_WIDTH);
+    for (size_t block = 0; block < gridSize; ++block)
+        emulate_block(inputArr.data(), DATA_LENGTH, blockDim, block,
+                expected.data());
+    popcount_reduce_x(inputArr.data(), DATA_LENGTH, blockDim,
+            blockArr.data(), outputArr.data(), threadCount);
+
+    for (size_t y = 0; y < HIST_WIDTH; ++y) {
+        uint64_t total = 0;
+        for (size_t block = 0; block < gridSize; ++block)
+            total += expected[block * HIST_WIDTH + y];
+        if (total != outputArr[y]) {
+            std::cerr << "Column " << y << ": " << outputArr[y]
+                << ", expected " << total << std::endl;
+            return 1;
+        }
+    }
+    if (blockArr != expected) {
+        std::cerr << "Block partials differ from the emulated GPU"
+            << std::endl;
+        return 1;
+    }
+
+    // Block shapes that are not powers of 2, on a length that ends inside
+    // a block.
+    const block_dim_t oddDims[] = { {3, 5}, {5, 1}, {7, 3}, {1, 9} };
+    for (const block_dim_t &dim : oddDims) {
+        const size_t length = 1000;
+        const size_t grid = popcount_grid_x(length, dim);
+        std::vector<uint64_t> oddExpected(grid * dim.y);
+        std::vector<uint64_t> oddBlocks(oddExpected.size()), oddOutput(dim.y);
+        for (size_t block = 0; block < grid; ++block)
+            emulate_block(inputArr.data(), length, dim, block,
+                    oddExpected.data());
+        popcount_reduce_x(inputArr.data(), length, dim, oddBlocks.data(),
+                oddOutput.data(), threadCount);
+        if (oddBlocks != oddExpected) {
+            std::cerr << "Block partials of " << dim.x << " x " << dim.y
+                << " differ from the emulated GPU" << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << gridSize << " blocks of " << HIST_NUM << " x " << HIST_WIDTH
+        << " match the emulated GPU (kernel: " << popcount_reduce_kernel()
+        << ")" << std::endl;
+
+    // Throughput on random words, by thread count.
+    size_t wordCount = mebibytes << 17;
+    std::vector<uint64_t> words(wordCount);
+    uint64_t state = 0x9E3779B97F4A7C15ULL, reference = 0;
+    for (auto &word : words) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        word = state;
+        reference += __builtin_popcountll(word);
+    }
+
+    if (0 == threadCount)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned threads = 1; threads <= threadCount;
+            threads = threads < threadCount
+            ? std::min(2 * threads, threadCount) : threads + 1) {
+        double best = 1e30;
+        for (int rep = 0; rep < BENCH_REPEAT; ++rep) {
+            const auto start = std::chrono::steady_clock::now();
+            popcount_reduce_x(words.data(), wordCount, blockDim, nullptr,
+                    outputArr.data(), threads);
+            const std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - start;
+            best = std::min(best, elapsed.count());
+        }
+
+        uint64_t total = 0;
+        for (size_t y = 0; y < HIST_WIDTH; ++y)
+            total += outputArr[y];
+        if (total != reference) {
+            std::cerr << "Total " << total << ", expected " << reference
+                << std::endl;
+            return 1;
+        }
+        std::cout << mebibytes << " MiB, " << threads << " threads: "
+            << wordCount * sizeof(uint64_t) / best * 1e-9 << " GB/s"
+            << std::endl;
+    }
+
+    return 0;
+}
+#endif
+
+namespace {
+
+/**
+ * @brief Add the popcounts of `length` words, read as rows of `width`, to
+ * the `width` counts of their columns.
+ *
+ * @details Every row is one step of the reduction along X, the additions of
+ * the tree in another order, which does not change integer sums.
+ */
+__attribute__((always_inline))
+inline void count_rows(const uint64_t *words, size_t length, size_t width,
+        uint64_t *counts) {
+    for (size_t row = 0; row < length; row += width) {
+        const size_t columns = std::min(width, length - row);
+        for (size_t y = 0; y < columns; ++y)
+            counts[y] += __builtin_popcountll(words[row + y]);
+    }
+}
+
+void scalar_count_rows(const uint64_t *words, size_t length, size_t width,
+        uint64_t *counts) {
+    count_rows(words, length, width, counts);
+}
+
+#if defined(__x86_64__)
+__attribute__((target("popcnt")))
+void popcnt_count_rows(const uint64_t *words, size_t length, size_t width,
+        uint64_t *counts) {
+    count_rows(words, length, width, counts);
+}
+
+// Eight columns per vector, the last ones masked.
+__attribute__((target("avx512f,avx512vpopcntdq")))
+void avx512_count_rows(const uint64_t *words, size_t length, size_t width,
+        uint64_t *counts) {
+    for (size_t row = 0; row < length; row += width) {
+        const size_t columns = std::min(width, length - row);
+        size_t y = 0;
+        for (; y + 8 <= columns; y += 8) {
+            __m512i v = _mm512_loadu_si512(words + row + y);
+            __m512i c = _mm512_loadu_si512(counts + y);
+            _mm512_storeu_si512(counts + y,
+                    _mm512_add_epi64(c, _mm512_popcnt_epi64(v)));
+        }
+        if (y < columns) {
+            __mmask8 mask = (__mmask8)((1u << (columns - y)) - 1);
+            __m512i v = _mm512_maskz_loadu_epi64(mask, words + row + y);
+            __m512i c = _mm512_maskz_loadu_epi64(mask, counts + y);
+            _mm512_mask_storeu_epi64(counts + y, mask,
+                    _mm512_add_epi64(c, _mm512_popcnt_epi64(v)));
+        }
+    }
+}
+#endif
+
+typedef void (*count_rows_t)(const uint64_t *, size_t, size_t, uint64_t *);
+
+struct kernel_t {
+    const char      *name;
+    count_rows_t    count_rows;
+};
+
+const kernel_t &select_kernel() {
+    static const kernel_t kernel = [] {
+#if defined(__x86_64__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512vpopcntdq"))
+            return kernel_t{ "avx512", avx512_count_rows };
+        if (__builtin_cpu_supports("popcnt"))
+            return kernel_t{ "popcnt", popcnt_count_rows };
+#endif
+        return kernel_t{ "scalar", scalar_count_rows };
+    }();
+    return kernel;
+}
+
+struct aligned_delete {
+    void operator()(uint64_t *words) const {
+        ::operator delete(words, std::align_val_t{64});
+    }
+};
+
+} // namespace
+
+void popcount_reduce_x(
+        const uint64_t *const   inputArr,
+        const size_t            inputArrLength,
+        const block_dim_t       blockDim,
+        uint64_t *const         blockArr,
+        uint64_t *const         outputArr,
+        unsigned                threadCount
+        ) {
+    const count_rows_t countRows = select_kernel().count_rows;
+    const size_t width = blockDim.y;
+    const size_t blockWords = 2 * blockDim.x * width;
+    const size_t gridSize = popcount_grid_x(inputArrLength, blockDim);
+    const size_t chunkBlocks = std::max<size_t>(1, CHUNK_WORDS / blockWords);
+    const size_t chunkCount = (gridSize + chunkBlocks - 1) / chunkBlocks;
+
+    if (0 == threadCount)
+        threadCount = std::thread::hardware_concurrency();
+    threadCount = static_cast<unsigned>(std::min<size_t>(threadCount,
+                chunkCount));
+    if (0 == threadCount)
+        threadCount = 1;
+
+    // One row of counts per thread, starting on its own cache line.
+    const size_t pitch = (width + 7) / 8 * 8;
+    std::unique_ptr<uint64_t[], aligned_delete> partials(
+            static_cast<uint64_t *>(::operator new(
+                    threadCount * pitch * sizeof(uint64_t),
+                    std::align_val_t{64})));
+    std::memset(partials.get(), 0, threadCount * pitch * sizeof(uint64_t));
+
+    std::atomic<size_t> nextChunk(0);
+    auto worker = [&](unsigned thread) {
+        uint64_t *counts = partials.get() + thread * pitch;
+        for (;;) {
+            size_t chunk = nextChunk.fetch_add(1, std::memory_order_relaxed);
+            if (chunk >= chunkCount)
+                break;
+
+            const size_t last = std::min(gridSize, (chunk + 1) * chunkBlocks);
+            for (size_t block = chunk * chunkBlocks; block < last; ++block) {
+                const size_t first = block * blockWords;
+                const size_t length = std::min(blockWords,
+                        inputArrLength - first);
+                if (nullptr == blockArr) {
+                    countRows(inputArr + first, length, width, counts);
+                    continue;
+                }
+
+                uint64_t *blockCounts = blockArr + block * width;
+                std::fill(blockCounts, blockCounts + width, 0);
+                countRows(inputArr + first, length, width, blockCounts);
+                for (size_t y = 0; y < width; ++y)
+                    counts[y] += blockCounts[y];
+            }
+        }
+    };
+
+    // The calling thread is worker 0.
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount - 1);
+    for (unsigned thread = 1; thread < threadCount; ++thread) {
+        try {
+            threads.emplace_back(worker, thread);
+        }
+        catch (const std::system_error &) {
+            break;
+        }
+    }
+    worker(0);
+    for (auto &thread : threads)
+        thread.join();
+
+    // Tree reduction of the rows, the total ends up in row 0.
+    for (size_t stride = 1; stride < threadCount; stride *= 2)
+        for (size_t thread = 0; thread + stride < threadCount;
+                thread += 2 * stride) {
+            uint64_t *left = partials.get() + thread * pitch;
+            const uint64_t *right = left + stride * pitch;
+            for (size_t y = 0; y < width; ++y)
+                left[y] += right[y];
+        }
+
+    std::copy(partials.get(), partials.get() + width, outputArr);
+}
+
+const char *popcount_reduce_kernel() {
+    return select_kernel().name;
+}
@@ -0,0 +1,72 @@
+#ifndef REDUCE_POPCOUNT_HPP
+#define REDUCE_POPCOUNT_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief The block shape of `g1b2_reduce_x`: `x` threads along X, each one
+ * reduces two rows, and `y` columns side by side.
+ */
+struct block_dim_t {
+    size_t      x;
+    size_t      y;
+};
+
+/**
+ * @brief The number of blocks `popcount_reduce_x` splits `inputArrLength`
+ * words into, `gridDim.x` of the CUDA launch.
+ */
+inline size_t popcount_grid_x(
+        const size_t            inputArrLength,
+        const block_dim_t       blockDim
+        ) {
+    const size_t blockWords = 2 * blockDim.x * blockDim.y;
+    return (inputArrLength + blockWords - 1) / blockWords;
+}
+
+/**
+ * @brief Count the set bits of every column of a word array with the layout
+ * of `g1b2_reduce_x`, on CPU threads.
+ *
+ * @details The CPU counterpart of launching `g1b2_reduce_x` on the
+ * popcounts of the words: block `b` owns the `2 * blockDim.x * blockDim.y`
+ * words from `b * 2 * blockDim.x * blockDim.y`, read as rows of
+ * `blockDim.y` words, and reduces them along X to one count per column.
+ * The words past `inputArrLength` count as 0, the identity.
+ *
+ * The blocks are handed out to the threads in chunks. Every thread adds its
+ * block partials into its own row of counts, padded to whole cache lines so
+ * that no two threads write the same line. The rows of the threads are then
+ * reduced by a tree, pairs at stride 1, 2, 4, ...
+ *
+ * The words are counted by `VPOPCNTQ` with AVX-512 VPOPCNTDQ, by `POPCNT`,
+ * or by SWAR otherwise, selected at runtime.
+ *
+ * @param[in]   inputArr        The words.
+ * @param[in]   inputArrLength  The number of words.
+ * @param[in]   blockDim        The block shape, both sizes at least 1.
+ * @param[out]  blockArr        The count of every block and column, in the
+ * layout of `d_outputArr`: `popcount_grid_x(...) * blockDim.y` counts,
+ * count `y` of block `b` at `b * blockDim.y + y`. May be `nullptr`.
+ * @param[out]  outputArr       The `blockDim.y` counts of all blocks.
+ * @param[in]   threadCount     The number of threads, 0 for one per CPU.
+ * A thread that cannot be started leaves its blocks to the others.
+ *
+ * Throws `std::bad_alloc` if the partials cannot be allocated.
+ */
+void popcount_reduce_x(
+        const uint64_t *const   inputArr,
+        const size_t            inputArrLength,
+        const block_dim_t       blockDim,
+        uint64_t *const         blockArr,
+        uint64_t *const         outputArr,
+        unsigned                threadCount
+        );
+
+/**
+ * @brief The kernel counting the words: `avx512`, `popcnt` or `scalar`.
+ */
+const char *popcount_reduce_kernel();
+
+#endif // REDUCE_POPCOUNT_HPP
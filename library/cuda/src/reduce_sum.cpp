@@ -0,0 +1,173 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include "reduce_sum.hpp"
+
+#define BENCH_REPEAT    5
+
+static const char *const modeNames[] = {
+    "plain        ", "pairwise     ", "kahan_babuska", "exact        ",
+};
+static const cpu::sum_mode modes[] = {
+    cpu::sum_mode::plain, cpu::sum_mode::pairwise,
+    cpu::sum_mode::kahan_babuska, cpu::sum_mode::exact,
+};
+
+/**
+ * @brief Check `exact` on sums known in closed form.
+ */
+static bool check_exact(cpu::work_stealing_pool &pool) {
+    const double tiny = std::numeric_limits<double>::denorm_min();
+    const double huge = std::numeric_limits<double>::max();
+    struct case_t {
+        std::vector<double> values;
+        double              expected;
+    } cases[] = {
+        {{}, 0.0},
+        {{1.0, 1e100, 1.0, -1e100}, 2.0},
+        {{tiny, tiny, -tiny * 3}, -tiny},
+        {{huge, huge, -huge}, huge},
+        {{huge, huge}, INFINITY},
+        {{1.0, INFINITY, 2.0}, INFINITY},
+        // 1 + 2^-53 + 2^-106 rounds up, without the last term to even.
+        {{1.0, std::ldexp(1.0, -53), std::ldexp(1.0, -106)},
+            1.0 + std::ldexp(1.0, -52)},
+        {{1.0, std::ldexp(1.0, -53)}, 1.0},
+        {{-1.0, -std::ldexp(1.0, -53), -std::ldexp(1.0, -106)},
+            -1.0 - std::ldexp(1.0, -52)},
+    };
+    for (const auto &test : cases) {
+        const double sum = cpu::reduce_sum(test.values.data(),
+                test.values.size(), cpu::sum_mode::exact, pool);
+        if (sum != test.expected) {
+            std::cerr << "exact: " << sum << ", expected " << test.expected
+                << std::endl;
+            return false;
+        }
+    }
+
+    std::vector<double> infinities = {INFINITY, 1.0, -INFINITY};
+    const double nan = cpu::reduce_sum(infinities.data(), infinities.size(),
+            cpu::sum_mode::exact, pool);
+    if (!std::isnan(nan)) {
+        std::cerr << "exact: inf - inf is " << nan << std::endl;
+        return false;
+    }
+
+    // An infinity or NaN among enough values for the double lanes.
+    std::vector<double> ones(100, 1.0);
+    ones[37] = INFINITY;
+    const double inf = cpu::reduce_sum(ones.data(), ones.size(),
+            cpu::sum_mode::exact, pool);
+    ones[37] = NAN;
+    if (INFINITY != inf || !std::isnan(cpu::reduce_sum(ones.data(),
+                    ones.size(), cpu::sum_mode::exact, pool))) {
+        std::cerr << "exact: wrong sum of an infinity or NaN" << std::endl;
+        return false;
+    }
+
+    // Values of 53 significant bits over a few binades, which the double
+    // lanes sum, or over hundreds, which they leave to the
+    // superaccumulator, then their negations in reverse order and a 1.
+    for (int spread : {8, 300}) {
+        const size_t count = 50000;
+        std::vector<double> pairs(2 * count + 1, 1.0);
+        for (size_t idx = 0; idx < count; ++idx) {
+            const uint64_t hash = (idx + 1) * 0x9E3779B97F4A7C15ull;
+            const double value = std::ldexp(1.0 + std::ldexp(
+                        static_cast<double>(hash >> 12), -52),
+                    static_cast<int>(hash % (2 * spread + 1)) - spread);
+            pairs[idx] = hash >> 63 ? -value : value;
+            pairs[2 * count - idx] = -pairs[idx];
+        }
+        const double sum = cpu::reduce_sum(pairs.data(), pairs.size(),
+                cpu::sum_mode::exact, pool);
+        if (1.0 != sum) {
+            std::cerr << "exact: values over " << 2 * spread + 1
+                << " binades and their negations sum to " << sum
+                << std::endl;
+            return false;
+        }
+    }
+
+    // Multiples of 2^-30 of every sign cancel to a known integer sum, spread
+    // over many chunks, in float and double.
+    const size_t length = 1 << 20;
+    std::vector<double> doubles(length);
+    std::vector<float> floats(length);
+    int64_t units = 0;
+    for (size_t idx = 0; idx < length; ++idx) {
+        const int64_t unit = static_cast<int64_t>(
+                idx * 0x9E3779B97F4A7C15ull >> 40) - (1 << 23);
+        units += unit;
+        doubles[idx] = std::ldexp(static_cast<double>(unit), -30);
+        floats[idx] = static_cast<float>(doubles[idx]);
+    }
+    const double expected = std::ldexp(static_cast<double>(units), -30);
+    if (cpu::reduce_sum(doubles.data(), length, cpu::sum_mode::exact, pool)
+            != expected
+            || cpu::reduce_sum(floats.data(), length, cpu::sum_mode::exact,
+                pool) != static_cast<float>(expected)) {
+        std::cerr << "exact: wrong sum of multiples of 2^-30" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    // Usage: reduce_sum [MiB] [threads]
+    size_t mebibytes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 256;
+    unsigned threadCount = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 0;
+    cpu::work_stealing_pool pool(threadCount);
+
+    if (!check_exact(pool))
+        return 1;
+
+    // Prices around 100 with a few large swings, in float: the plain sum
+    // drifts once it is much larger than the terms.
+    const size_t length = mebibytes << 18;
+    std::vector<float> values(length);
+    for (size_t idx = 0; idx < length; ++idx) {
+        const uint64_t hash = idx * 0x9E3779B97F4A7C15ull;
+        values[idx] = 100.0f + static_cast<float>(hash >> 44) * 1e-5f;
+        if (0 == hash % 4099)
+            values[idx] = (hash >> 63 ? -1e7f : 1e7f);
+    }
+    const float exact = cpu::reduce_sum(values.data(), length,
+            cpu::sum_mode::exact, pool);
+
+    cpu::work_stealing_pool single(1);
+    std::cout << mebibytes << " MiB of float, " << pool.size()
+        << " threads, exact sum " << exact << "\n";
+    for (size_t idx = 0; idx < 4; ++idx) {
+        float sum = 0;
+        double best = 1e30;
+        for (int rep = 0; rep < BENCH_REPEAT; ++rep) {
+            auto start = std::chrono::steady_clock::now();
+            sum = cpu::reduce_sum(values.data(), length, modes[idx], pool);
+            auto end = std::chrono::steady_clock::now();
+            best = std::min(best,
+                    std::chrono::duration<double>(end - start).count());
+        }
+        if (sum != cpu::reduce_sum(values.data(), length, modes[idx],
+                    single)) {
+            std::cerr << modeNames[idx] << ": the sum depends on the thread "
+                << "count" << std::endl;
+            return 1;
+        }
+
+        std::cout << modeNames[idx] << ": "
+            << length * sizeof(float) / best * 1e-9 << " GB/s, relative error "
+            << std::abs((static_cast<double>(sum) - exact) / exact) << "\n";
+    }
+    std::cout << std::flush;
+
+    return 0;
+}
@@ -0,0 +1,532 @@
+#ifndef REDUCE_SUM_HPP
+#define REDUCE_SUM_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include "reduce_cpu.hpp"
+
+/**
+ * @file reduce_sum.hpp
+ *
+ * @brief Floating point sums with a choice of accuracy, on CPU threads
+ * (C++17).
+ *
+ * @details The compensated modes rely on IEEE rounding of every operation,
+ * they must not be built with `-ffast-math`.
+ */
+
+#if defined(__FAST_MATH__)
+#error "reduce_sum.hpp needs IEEE arithmetic, build without -ffast-math"
+#endif
+
+namespace cpu {
+
+/**
+ * @brief How `reduce_sum` adds.
+ */
+enum class sum_mode {
+    plain,          ///< `l += r` in 16 lanes, as `add_oper`.
+    pairwise,       ///< Pairwise halving, error grows with `log(n)`.
+    kahan_babuska,  ///< Compensated, error independent of `n`.
+    exact           ///< Exact sum, rounded once.
+};
+
+namespace detail {
+
+// Accumulators side by side, one vector of `float` with AVX-512.
+constexpr size_t sum_lanes = 16;
+
+// Elements summed in lanes at the leaves of the pairwise sum.
+constexpr size_t sum_pairwise_block = 256;
+
+// 32-bit digits of the superaccumulator: the 2046 bit positions of
+// `double`, an 84-bit shifted mantissa above the top one and 64 bits of
+// carry.
+constexpr size_t sum_limbs = 72;
+
+// Values added to the superaccumulator between two carry propagations: a
+// digit takes parts below 2^53 and must stay below 2^63.
+constexpr size_t sum_exact_flush = 1024;
+
+// Lanes of `double` of the exact sum: three per lane, and SSE2 has 16
+// registers of two.
+constexpr size_t sum_exact_width = 8;
+
+// Values added through the lanes of `double` at a time, 256 per lane.
+constexpr size_t sum_exact_block = 2048;
+// After a block that does not fit in the lanes, the blocks tried again in
+// them are one in this many.
+constexpr size_t sum_exact_retry = 8;
+
+template < class ValueType >
+ValueType sum_plain(const ValueType *const values, const size_t length) {
+    ValueType acc[sum_lanes] = {};
+    size_t idx = 0;
+    for (; idx + sum_lanes <= length; idx += sum_lanes) {
+        REDUCE_CPU_SIMD
+        for (size_t lane = 0; lane < sum_lanes; ++lane)
+            acc[lane] += values[idx + lane];
+    }
+    for (size_t lane = 0; idx < length; ++idx, ++lane)
+        acc[lane] += values[idx];
+
+    auto add = [](ValueType &l, ValueType &r) -> void { l += r; r = 0; };
+    reduce_rows(acc, sum_lanes, 1, add);
+    return acc[0];
+}
+
+/**
+ * @brief Halve until a block of `sum_pairwise_block`, which is summed in
+ * lanes. The halves are a whole number of blocks.
+ */
+template < class ValueType >
+ValueType sum_pairwise(const ValueType *const values, const size_t length) {
+    if (length <= sum_pairwise_block)
+        return sum_plain(values, length);
+
+    const size_t blocks = (length + sum_pairwise_block - 1)
+        / sum_pairwise_block;
+    const size_t half = blocks / 2 * sum_pairwise_block;
+    return sum_pairwise(values, half)
+        + sum_pairwise(values + half, length - half);
+}
+
+/**
+ * @brief A sum and its compensation, `sum + carry` is the value.
+ */
+template < class ValueType >
+struct compensated_t {
+    ValueType   sum = 0;
+    ValueType   carry = 0;
+
+    // Kahan-Babuska step with Knuth's TwoSum: the rounding error of
+    // `sum + value` is exact for either operand larger, without a branch.
+    void add(const ValueType value) {
+        const ValueType total = sum + value;
+        const ValueType part = total - sum;
+        carry += (sum - (total - part)) + (value - part);
+        sum = total;
+    }
+
+    void add(const compensated_t &other) {
+        add(other.sum);
+        carry += other.carry;
+    }
+};
+
+/**
+ * @brief Kahan-Babuska in lanes: every lane keeps a sum and a
+ * compensation, the step is adds only, so the loop over the lanes
+ * vectorizes. The lanes are then combined in order.
+ */
+template < class ValueType >
+compensated_t<ValueType> sum_kahan_babuska(
+        const ValueType *const  values,
+        const size_t            length
+        ) {
+    ValueType sum[sum_lanes] = {}, carry[sum_lanes] = {};
+    size_t idx = 0;
+    for (; idx + sum_lanes <= length; idx += sum_lanes) {
+        REDUCE_CPU_SIMD
+        for (size_t lane = 0; lane < sum_lanes; ++lane) {
+            const ValueType value = values[idx + lane];
+            const ValueType total = sum[lane] + value;
+            const ValueType part = total - sum[lane];
+            carry[lane] += (sum[lane] - (total - part)) + (value - part);
+            sum[lane] = total;
+        }
+    }
+
+    compensated_t<ValueType> result;
+    for (size_t lane = 0; lane < sum_lanes; ++lane) {
+        result.add(sum[lane]);
+        result.carry += carry[lane];
+    }
+    for (; idx < length; ++idx)
+        result.add(values[idx]);
+    return result;
+}
+
+/**
+ * @brief A fixed-point number covering every `double`: `sum_limbs` signed
+ * 64-bit digits, digit `k` weighs `2^(32 k - 1074)`.
+ *
+ * @details A finite value is split into its integer mantissa and the bit
+ * position of its lowest bit; the mantissa, shifted by the position modulo
+ * 32, is added to two neighbouring digits as a low 32-bit and a high part.
+ * The digits are carry-save and are brought back to `[0, 2^32)` every
+ * `sum_exact_flush` values, the top digit keeps the sign. Infinities and
+ * NaN are summed apart, as IEEE sums them.
+ */
+struct alignas(64) superaccumulator_t {
+    int64_t     digits[sum_limbs] = {};
+    double      special = 0;        ///< Sum of the infinities and NaN.
+    bool        hasSpecial = false;
+
+    void add(const double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        const unsigned biased = static_cast<unsigned>(bits >> 52) & 0x7ff;
+        if (0x7ff == biased) {
+            special += value;
+            hasSpecial = true;
+            return;
+        }
+
+        uint64_t mantissa = bits & ((uint64_t(1) << 52) - 1);
+        if (0 != biased)
+            mantissa |= uint64_t(1) << 52;
+        const unsigned position = std::max(biased, 1u) - 1;
+        const unsigned shift = position % 32;
+        const int64_t low = static_cast<int64_t>((mantissa << shift)
+                & 0xffffffff);
+        const int64_t high = static_cast<int64_t>(mantissa >> (32 - shift));
+        int64_t *const digit = digits + position / 32;
+        if (bits >> 63) {
+            digit[0] -= low;
+            digit[1] -= high;
+        }
+        else {
+            digit[0] += low;
+            digit[1] += high;
+        }
+    }
+
+    void add(const superaccumulator_t &other) {
+        for (size_t idx = 0; idx < sum_limbs; ++idx)
+            digits[idx] += other.digits[idx];
+        special += other.special;
+        hasSpecial |= other.hasSpecial;
+        normalize();
+    }
+
+    // Digits to `[0, 2^32)` except the top one.
+    void normalize() {
+        for (size_t idx = 0; idx + 1 < sum_limbs; ++idx) {
+            const int64_t carry = digits[idx] >> 32;    // Floor division.
+            digits[idx] -= carry * (int64_t(1) << 32);
+            digits[idx + 1] += carry;
+        }
+    }
+
+    /**
+     * @brief The value rounded once to nearest, ties to even.
+     *
+     * @details The top 64 bits of the magnitude, with the bits below them
+     * ORed into the lowest one, round as the whole number does when they
+     * are converted. A result below the normal range is a multiple of
+     * 2^-1074 below 2^-1022 (2^-126 for `float`, of 2^-149) and converts
+     * exactly.
+     */
+    template < class ValueType >
+    ValueType round() const {
+        if (hasSpecial)
+            return static_cast<ValueType>(special);
+
+        superaccumulator_t value = *this;
+        value.normalize();
+        const bool negative = value.digits[sum_limbs - 1] < 0;
+        if (negative) {
+            // Two's complement of the digits, then normalized again.
+            for (size_t idx = 0; idx < sum_limbs; ++idx)
+                value.digits[idx] = -value.digits[idx];
+            value.normalize();
+        }
+
+        size_t top = sum_limbs;
+        while (top > 0 && 0 == value.digits[top - 1])
+            --top;
+        if (0 == top)
+            return 0;
+
+        // The 96 bits of the three top digits, then the rest as sticky.
+        __extension__ typedef unsigned __int128 wide_t;
+        uint64_t window = 0;
+        int exponent = 32 * static_cast<int>(top) - 1074 - 96;
+        wide_t head = 0;
+        for (size_t idx = top; idx > 0 && idx + 3 > top; --idx)
+            head = head << 32 | static_cast<uint64_t>(value.digits[idx - 1]);
+        if (top < 3)
+            head <<= 32 * (3 - top);
+        bool sticky = false;
+        for (size_t idx = 0; idx + 3 < top; ++idx)
+            sticky |= 0 != value.digits[idx];
+
+        // Shift the highest set bit to bit 63 of the window.
+        int lead = 127;
+        while (0 == (head >> lead & 1))
+            --lead;
+        const int drop = lead - 63;
+        if (drop > 0) {
+            sticky |= 0 != (head & ((static_cast<wide_t>(1) << drop) - 1));
+            window = static_cast<uint64_t>(head >> drop);
+            exponent += drop;
+        }
+        else {
+            window = static_cast<uint64_t>(head << -drop);
+            exponent += drop;
+        }
+        window |= sticky ? 1 : 0;
+
+        const ValueType magnitude = std::ldexp(
+                static_cast<ValueType>(window), exponent);
+        return negative ? -magnitude : magnitude;
+    }
+};
+
+/**
+ * @brief Add up to `sum_exact_block` values to `acc` through
+ * `sum_exact_width` lanes of `double`, exactly; false if they do not fit,
+ * then `acc` is unchanged.
+ *
+ * @details With `2^e` above the largest magnitude, 256 multiples of
+ * `2^(e - 45)` sum exactly in a `double`. A block of `float` whose smallest
+ * nonzero magnitude is at least `2^(e - 22)` is made of such multiples and
+ * is summed as it is. Otherwise every value is split by the error-free
+ * extraction of Rump, Ogita and Oishi: with `s = 1.5 * 2^(e + 8)`,
+ * `(s + x) - s` is `x` rounded to a multiple of `2^(e - 44)`, exactly, and
+ * the rest is exact too. The rests, below `2^(e - 45)`, are split the same
+ * way, and what is left of them must be zero, which holds if the values of
+ * the block span no more than 37 binades below `2^e`. The lane sums are
+ * then added to `acc` in place of the values. Blocks with values from
+ * `2^1013` on, infinities or NaN do not fit either. Every element is split
+ * on its own, so the loop over the lanes is adds only, as `sum_plain`, and
+ * vectorizes.
+ */
+template < class ValueType >
+bool sum_exact_lanes(
+        superaccumulator_t      &acc,
+        const ValueType *const  values,
+        const size_t            length
+        ) {
+    static_assert(sum_exact_block / sum_exact_width <= 256,
+            "The lanes have room for 256 values");
+    static_assert(0 == sum_lanes % sum_exact_width,
+            "The blocks of both lanes end together");
+    const size_t full = length / sum_lanes * sum_lanes;
+    ValueType largest[sum_lanes] = {}, smallest[sum_lanes];
+    std::fill(smallest, smallest + sum_lanes,
+            std::numeric_limits<ValueType>::max());
+    for (size_t idx = 0; idx < full; idx += sum_lanes) {
+        REDUCE_CPU_SIMD
+        for (size_t lane = 0; lane < sum_lanes; ++lane) {
+            // One select per lane and compare, the shape of `maxps` and
+            // `minps`.
+            const ValueType value = std::fabs(values[idx + lane]);
+            const ValueType nonzero = 0 != value ? value
+                : std::numeric_limits<ValueType>::max();
+            largest[lane] = largest[lane] < value ? value : largest[lane];
+            smallest[lane] = nonzero < smallest[lane] ? nonzero
+                : smallest[lane];
+        }
+    }
+    for (size_t lane = 1; lane < sum_lanes; ++lane) {
+        largest[0] = std::max(largest[0], largest[lane]);
+        smallest[0] = std::min(smallest[0], smallest[lane]);
+    }
+
+    // Below 2^-985 the low parts are multiples of 2^-1074, the smallest
+    // subnormal, which every value is a multiple of.
+    int e;
+    std::frexp(static_cast<double>(largest[0]), &e);
+    if (!(largest[0] < std::ldexp(1.0, 1013)))
+        return false;
+    e = std::max(e, -985);
+
+    double high[sum_exact_width] = {}, low[sum_exact_width] = {};
+    double rest[sum_exact_width] = {};
+    if (smallest[0] >= std::ldexp(1.0,
+                e - 46 + std::numeric_limits<ValueType>::digits)) {
+        // NaN ends up in `acc` as it does value by value.
+        for (size_t idx = 0; idx < full; idx += sum_exact_width) {
+            REDUCE_CPU_SIMD
+            for (size_t lane = 0; lane < sum_exact_width; ++lane)
+                high[lane] += static_cast<double>(values[idx + lane]);
+        }
+    }
+    else {
+        // The low parts are multiples of `2^(e - 89)`, a nonzero value below
+        // cannot fit: fail before the pass over the block.
+        if (smallest[0] < std::ldexp(1.0, e - 89))
+            return false;
+
+        // `float` converted up front, the conversion in the loop keeps it
+        // from vectorizing.
+        const double *block;
+        double converted[sum_exact_block];
+        if constexpr (std::is_same<ValueType, double>::value)
+            block = values;
+        else {
+            std::copy(values, values + full, converted);
+            block = converted;
+        }
+
+        const double highSplit = std::ldexp(1.5, e + 8);
+        const double lowSplit = std::ldexp(1.5, e - 37);
+        for (size_t idx = 0; idx < full; idx += sum_exact_width) {
+            REDUCE_CPU_SIMD
+            for (size_t lane = 0; lane < sum_exact_width; ++lane) {
+                const double value = block[idx + lane];
+                const double highPart = (highSplit + value) - highSplit;
+                const double part = value - highPart;
+                const double lowPart = (lowSplit + part) - lowSplit;
+                high[lane] += highPart;
+                low[lane] += lowPart;
+                rest[lane] += std::fabs(part - lowPart);
+            }
+        }
+        // NaN is not 0 either.
+        for (size_t lane = 0; lane < sum_exact_width; ++lane)
+            if (0 != rest[lane])
+                return false;
+    }
+
+    for (size_t lane = 0; lane < sum_exact_width; ++lane) {
+        acc.add(high[lane]);
+        acc.add(low[lane]);
+    }
+    for (size_t idx = full; idx < length; ++idx)
+        acc.add(static_cast<double>(values[idx]));
+    return true;
+}
+
+/**
+ * @brief Add `values` to `acc`, by `sum_exact_lanes` where a block fits and
+ * value by value otherwise.
+ */
+template < class ValueType >
+void sum_exact(
+        superaccumulator_t      &acc,
+        const ValueType *const  values,
+        const size_t            length
+        ) {
+    // The blocks after one that does not fit likely do not either: skip the
+    // pass that finds out for the next ones.
+    size_t skip = 0;
+    for (size_t block = 0; block < length; block += sum_exact_block) {
+        const size_t end = std::min(length, block + sum_exact_block);
+        if (0 != skip)
+            --skip;
+        else if (sum_exact_lanes(acc, values + block, end - block)) {
+            acc.normalize();
+            continue;
+        }
+        else
+            skip = sum_exact_retry - 1;
+        for (size_t first = block; first < end; first += sum_exact_flush) {
+            const size_t last = std::min(end, first + sum_exact_flush);
+            for (size_t idx = first; idx < last; ++idx)
+                acc.add(static_cast<double>(values[idx]));
+            acc.normalize();
+        }
+    }
+}
+
+} // namespace detail
+
+/**
+ * @brief Sum an array of `float` or `double` on CPU threads, as accurately
+ * as `mode` asks.
+ *
+ * @details The array is cut into chunks of about 32 Ki elements, the pool
+ * sums every chunk and the calling thread combines the chunk sums:
+ *
+ * - `plain`: 16 lanes of `l += r` per chunk, the chunk sums by the tree of
+ *   `g1b2_reduce_x`. What `add_oper` computes, in another order.
+ * - `pairwise`: blocks of 256 summed in lanes, halved down to the blocks
+ *   inside a chunk and the chunk sums by the tree. The error grows with
+ *   `log(n)` instead of `n`, for the cost of a plain sum.
+ * - `kahan_babuska`: a sum and a compensation per lane, updated by TwoSum,
+ *   the lanes and then the chunk pairs combined in order. The error does
+ *   not grow with `n`; six additions per element instead of one,
+ *   vectorized, so still close to memory bandwidth on several threads.
+ * - `exact`: every value is added to a superaccumulator, a fixed-point
+ *   number wide enough for any sum of `double`, and the total is rounded
+ *   once. The result is the correctly rounded sum, independent of the
+ *   order. Blocks of `detail::sum_exact_block` values within 37 binades
+ *   are summed exactly in lanes of `double`, vectorized, and only the lane
+ *   sums go to the digits: about 2.5 times the cost of a plain sum on one
+ *   thread. Wider blocks, infinities and NaN are added to the digits value
+ *   by value, which costs 8 to 12 plain sums and does not vectorize.
+ *
+ * The chunks depend on the length only, so the result does not depend on
+ * the number of threads in any mode.
+ *
+ * @tparam      ValueType       `float` or `double`.
+ *
+ * @param[in]   inputArr        The values.
+ * @param[in]   inputArrLength  The number of values.
+ * @param[in]   mode            How to add.
+ * @param[in]   pool            The threads to run on.
+ *
+ * Throws `std::bad_alloc` if the chunk sums cannot be allocated.
+ */
+template < class ValueType >
+ValueType
+reduce_sum(
+        const ValueType *const  inputArr,
+        const size_t            inputArrLength,
+        const sum_mode          mode = sum_mode::pairwise,
+        work_stealing_pool      &pool = work_stealing_pool::shared()
+        ) {
+    static_assert(std::is_same<ValueType, float>::value
+            || std::is_same<ValueType, double>::value,
+            "reduce_sum sums float or double");
+    const size_t chunkLength = detail::reduce_chunk_elements;
+    const size_t chunkCount = std::max<size_t>(1,
+            (inputArrLength + chunkLength - 1) / chunkLength);
+    auto chunkOf = [&](size_t chunk, size_t &length) {
+        const size_t first = chunk * chunkLength;
+        length = std::min(chunkLength, inputArrLength - first);
+        return inputArr + first;
+    };
+
+    if (sum_mode::plain == mode || sum_mode::pairwise == mode) {
+        std::vector<ValueType> sums(chunkCount);
+        pool.parallel_for(chunkCount, [&](size_t chunk, unsigned) {
+            size_t length;
+            const ValueType *const values = chunkOf(chunk, length);
+            sums[chunk] = sum_mode::plain == mode
+                ? detail::sum_plain(values, length)
+                : detail::sum_pairwise(values, length);
+        });
+        auto add = [](ValueType &l, ValueType &r) -> void { l += r; r = 0; };
+        detail::reduce_rows(sums.data(), chunkCount, 1, add);
+        return sums[0];
+    }
+
+    if (sum_mode::kahan_babuska == mode) {
+        std::vector<detail::compensated_t<ValueType>> sums(chunkCount);
+        pool.parallel_for(chunkCount, [&](size_t chunk, unsigned) {
+            size_t length;
+            const ValueType *const values = chunkOf(chunk, length);
+            sums[chunk] = detail::sum_kahan_babuska(values, length);
+        });
+        detail::compensated_t<ValueType> total;
+        for (const auto &sum : sums)
+            total.add(sum);
+        return total.sum + total.carry;
+    }
+
+    // Integer digits, so the per-worker sums may be added in any order.
+    std::vector<detail::superaccumulator_t> accs(pool.size());
+    pool.parallel_for(chunkCount, [&](size_t chunk, unsigned worker) {
+        size_t length;
+        const ValueType *const values = chunkOf(chunk, length);
+        detail::sum_exact(accs[worker], values, length);
+    });
+    for (size_t worker = 1; worker < accs.size(); ++worker)
+        accs[0].add(accs[worker]);
+    return accs[0].round<ValueType>();
+}
+
+} // namespace cpu
+
+#endif // REDUCE_SUM_HPP
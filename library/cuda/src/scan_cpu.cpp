@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <numeric>
+#include <vector>
+
+#include "scan_cpu.hpp"
+
+#define BENCH_REPEAT    5
+
+/**
+ * @brief `x -> a * x + b` modulo 2^32, composed in order: not commutative.
+ */
+struct affine_t {
+    uint32_t    a;
+    uint32_t    b;
+
+    bool operator!=(const affine_t &other) const {
+        return a != other.a || b != other.b;
+    }
+};
+
+/**
+ * @brief The scans of one thread in order, to check against.
+ */
+template < class DataType, class Operation >
+static std::vector<DataType> serial_scan(
+        const std::vector<DataType> &input,
+        const std::vector<uint8_t>  *heads,
+        const Operation         &oper,
+        const DataType          identity,
+        const cpu::scan_mode    mode
+        ) {
+    std::vector<DataType> output(input.size());
+    DataType carry = identity;
+    for (size_t idx = 0; idx < input.size(); ++idx) {
+        if (heads && (*heads)[idx])
+            carry = identity;
+        if (cpu::scan_mode::exclusive == mode)
+            output[idx] = carry;
+        DataType value = input[idx];
+        oper(carry, value);
+        if (cpu::scan_mode::inclusive == mode)
+            output[idx] = carry;
+    }
+
+    return output;
+}
+
+/**
+ * @brief Compare every scan of `input` with `serial_scan`, out of place and
+ * in place.
+ */
+template < class DataType, class Operation >
+static bool check_scans(
+        const char              *name,
+        const std::vector<DataType> &input,
+        const std::vector<uint8_t>  &heads,
+        const Operation         &oper,
+        const DataType          identity,
+        cpu::work_stealing_pool &pool
+        ) {
+    for (auto mode : {cpu::scan_mode::inclusive, cpu::scan_mode::exclusive})
+        for (bool segmented : {false, true})
+            for (bool inPlace : {false, true}) {
+                std::vector<DataType> output(input);
+                const DataType *const source = inPlace ? output.data()
+                    : input.data();
+                if (segmented)
+                    cpu::segmented_scan(source, heads.data(), input.size(),
+                            output.data(), oper, identity, mode, pool);
+                else
+                    cpu::scan(source, input.size(), output.data(), oper,
+                            identity, mode, pool);
+
+                const auto expected = serial_scan(input,
+                        segmented ? &heads : nullptr, oper, identity, mode);
+                for (size_t idx = 0; idx < input.size(); ++idx)
+                    if (output[idx] != expected[idx]) {
+                        std::cerr << name << ", length " << input.size()
+                            << (cpu::scan_mode::inclusive == mode
+                                    ? ", inclusive" : ", exclusive")
+                            << (segmented ? ", segmented" : "")
+                            << (inPlace ? ", in place" : "")
+                            << ": wrong element " << idx << std::endl;
+                        return false;
+                    }
+            }
+
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    // Usage: scan_cpu [MiB] [threads]
+    size_t mebibytes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 256;
+    unsigned threadCount = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 0;
+    cpu::work_stealing_pool pool(threadCount);
+
+    auto addInt = [](int &l, int &r) -> void { l += r; r = 0; };
+    auto compose = [](affine_t &l, affine_t &r) -> void {
+        l = {r.a * l.a, r.a * l.b + r.b};
+        r = {1, 0};
+    };
+
+    // Lengths around the register block and the chunk.
+    for (size_t length : {0, 1, 15, 16, 17, 1000, 32768, 32769, 100000,
+            300001}) {
+        std::vector<int> ints(length);
+        std::vector<affine_t> maps(length);
+        std::vector<uint8_t> heads(length);
+        for (size_t idx = 0; idx < length; ++idx) {
+            const uint32_t hash = static_cast<uint32_t>(idx * 2654435761u);
+            ints[idx] = static_cast<int>(hash % 1000) - 500;
+            maps[idx] = {hash | 1, hash >> 7};
+            // Segments of a few elements up to whole chunks.
+            heads[idx] = 0 == hash % (idx < 50000 ? 13 : 70001);
+        }
+        if (!check_scans("int", ints, heads, addInt, 0, pool)
+                || !check_scans("affine", maps, heads, compose,
+                    affine_t{1, 0}, pool))
+            return 1;
+    }
+
+    // An inclusive float sum of a large array, against std::inclusive_scan
+    // on one thread.
+    const size_t length = mebibytes << 18;
+    std::vector<float> floats(length), output(length), reference(length);
+    for (size_t idx = 0; idx < length; ++idx)
+        floats[idx] = static_cast<float>(idx * 2654435761u % 1000) * 1e-3f;
+    auto addFloat = [](float &l, float &r) -> void { l += r; r = 0; };
+
+    double bestSerial = 1e30, bestScan = 1e30;
+    for (int rep = 0; rep < BENCH_REPEAT; ++rep) {
+        auto start = std::chrono::steady_clock::now();
+        std::inclusive_scan(floats.begin(), floats.end(), reference.begin());
+        auto mid = std::chrono::steady_clock::now();
+        cpu::scan(floats.data(), length, output.data(), addFloat, 0.0f,
+                cpu::scan_mode::inclusive, pool);
+        auto end = std::chrono::steady_clock::now();
+
+        bestSerial = std::min(bestSerial,
+                std::chrono::duration<double>(mid - start).count());
+        bestScan = std::min(bestScan,
+                std::chrono::duration<double>(end - mid).count());
+    }
+
+    cpu::work_stealing_pool single(1);
+    cpu::scan(floats.data(), length, reference.data(), addFloat, 0.0f,
+            cpu::scan_mode::inclusive, single);
+    if (output != reference) {
+        std::cerr << "The float scan depends on the thread count" << std::endl;
+        return 1;
+    }
+
+    const double bytes = length * sizeof(float);
+    std::cout << mebibytes << " MiB, " << pool.size() << " threads\n"
+        << "std::inclusive_scan, 1 thread: " << bytes / bestSerial * 1e-9
+        << " GB/s\n"
+        << "cpu::scan, float:              " << bytes / bestScan * 1e-9
+        << " GB/s (last " << (output.empty() ? 0.0f : output.back())
+        << ")" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,363 @@
+#ifndef SCAN_CPU_HPP
+#define SCAN_CPU_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "reduce_cpu.hpp"
+
+/**
+ * @file scan_cpu.hpp
+ *
+ * @brief Prefix scans with the operations of `g1b2_reduce_x`, on CPU
+ * threads (C++17).
+ */
+
+namespace cpu {
+
+/**
+ * @brief Whether element `i` of a scan includes input `i`.
+ */
+enum class scan_mode {
+    inclusive,      ///< `out[i] = in[0] op ... op in[i]`.
+    exclusive       ///< `out[i] = identity op in[0] op ... op in[i - 1]`.
+};
+
+namespace detail {
+
+// Contiguous parts of a chunk scanned side by side, one vector of `int`
+// with AVX-512.
+constexpr size_t scan_lanes = 16;
+
+/**
+ * @brief The length of a part, `length / scan_lanes` rounded down to an odd
+ * number of cache lines: parts a power of 2 apart would all map to the same
+ * L1 set.
+ */
+template < class DataType >
+size_t scan_part(const size_t length) {
+    const size_t line = std::max<size_t>(1, 64 / sizeof(DataType));
+    const size_t lines = length / scan_lanes / line;
+    return 0 == lines ? length / scan_lanes : ((lines - 1) | 1) * line;
+}
+
+/**
+ * @brief Reduce `length` elements in order, for a segmented scan only the
+ * elements from the last head; `head` tells whether there is one.
+ *
+ * @details The elements are split into `scan_lanes` contiguous parts of
+ * `scan_part` elements and a tail, the parts are folded side by side, so
+ * that the loop over the parts has independent chains, and then combined
+ * in order with the tail.
+ */
+template < bool Segmented, class DataType, class Operation >
+DataType reduce_chunk(
+        const DataType *const   inputArr,
+        const uint8_t *const    headFlags,
+        const size_t            length,
+        const Operation         &oper,
+        const DataType          identity,
+        bool                    &head
+        ) {
+    const size_t part = scan_part<DataType>(length);
+    DataType acc[scan_lanes];
+    uint8_t heads[scan_lanes] = {};
+    std::fill(acc, acc + scan_lanes, identity);
+    for (size_t idx = 0; idx < part; ++idx) {
+        REDUCE_CPU_SIMD
+        for (size_t lane = 0; lane < scan_lanes; ++lane) {
+            const size_t pos = lane * part + idx;
+            DataType left = acc[lane], right = inputArr[pos];
+            oper(left, right);
+            if (Segmented && headFlags[pos]) {
+                acc[lane] = inputArr[pos];
+                heads[lane] = 1;
+            }
+            else
+                acc[lane] = left;
+        }
+    }
+
+    DataType total = identity;
+    head = false;
+    for (size_t lane = 0; lane < scan_lanes; ++lane) {
+        if (Segmented && heads[lane]) {
+            total = acc[lane];
+            head = true;
+        }
+        else
+            oper(total, acc[lane]);
+    }
+    for (size_t pos = scan_lanes * part; pos < length; ++pos) {
+        DataType value = inputArr[pos];
+        if (Segmented && headFlags[pos]) {
+            total = value;
+            head = true;
+        }
+        else
+            oper(total, value);
+    }
+
+    return total;
+}
+
+/**
+ * @brief Scan `length` elements, `carry` is the value of the elements
+ * before them (of the open segment, if `Segmented`), and return their total
+ * as `reduce_chunk` does, with `head`.
+ *
+ * @details The parts of `reduce_chunk` are scanned side by side from
+ * `identity`, the accumulator of every part stays in its lane of a
+ * register. Then the totals of the parts are combined in order from
+ * `identity`, in the grouping of `reduce_chunk`, the carry into every part,
+ * `carry` and the total of the parts before it, is combined with its
+ * elements up to its first head, one vectorizable loop per part, and the
+ * tail is scanned from the carry after the last part. `outputArr` may be
+ * `inputArr`.
+ */
+template < bool Segmented, class DataType, class Operation >
+DataType scan_chunk(
+        const DataType *const   inputArr,
+        const uint8_t *const    headFlags,
+        const size_t            length,
+        DataType *const         outputArr,
+        const Operation         &oper,
+        const DataType          identity,
+        const DataType          carry,
+        const scan_mode         mode,
+        bool                    &head
+        ) {
+    const bool exclusive = scan_mode::exclusive == mode;
+    const size_t part = scan_part<DataType>(length);
+    DataType acc[scan_lanes];
+    size_t firstHead[scan_lanes];
+    std::fill(acc, acc + scan_lanes, identity);
+    std::fill(firstHead, firstHead + scan_lanes, part);
+    for (size_t idx = 0; idx < part; ++idx) {
+        REDUCE_CPU_SIMD
+        for (size_t lane = 0; lane < scan_lanes; ++lane) {
+            const size_t pos = lane * part + idx;
+            const bool starts = Segmented && headFlags[pos];
+            const DataType value = inputArr[pos];
+            DataType left = starts ? identity : acc[lane], right = value;
+            if (Segmented)
+                firstHead[lane] = std::min(firstHead[lane],
+                        starts ? idx : part);
+            if (exclusive)
+                outputArr[pos] = left;
+            oper(left, right);
+            acc[lane] = starts ? value : left;
+            if (!exclusive)
+                outputArr[pos] = left;
+        }
+    }
+
+    // The carry into the next part: `carry` and `total`, unless `total`
+    // starts at a head.
+    auto carryInto = [&](const DataType &total) -> DataType {
+        if (Segmented && head)
+            return total;
+        DataType left = carry, right = total;
+        oper(left, right);
+        return left;
+    };
+
+    DataType total = identity;
+    head = false;
+    for (size_t lane = 0; lane < scan_lanes; ++lane) {
+        DataType *const out = outputArr + lane * part;
+        const DataType before = carryInto(total);
+        const size_t open = firstHead[lane];
+        REDUCE_CPU_SIMD
+        for (size_t idx = 0; idx < open; ++idx) {
+            DataType left = before, right = out[idx];
+            oper(left, right);
+            out[idx] = left;
+        }
+        if (Segmented && open < part) {
+            total = acc[lane];
+            head = true;
+        }
+        else
+            oper(total, acc[lane]);
+    }
+
+    DataType running = carryInto(total);
+    for (size_t pos = scan_lanes * part; pos < length; ++pos) {
+        const DataType value = inputArr[pos];
+        DataType right = value;
+        if (Segmented && headFlags[pos]) {
+            running = identity;
+            total = value;
+            head = true;
+        }
+        else
+            oper(total, right);
+        if (exclusive)
+            outputArr[pos] = running;
+        right = value;
+        oper(running, right);
+        if (!exclusive)
+            outputArr[pos] = running;
+    }
+
+    return total;
+}
+
+/**
+ * @brief Reduce-then-scan: the total of every chunk, the carries into the
+ * chunks in order, then every chunk scanned from its carry.
+ *
+ * @details On one thread the chunks are scanned in order in one pass
+ * instead, the carry into the next chunk from the total `scan_chunk`
+ * returns, which is the total `reduce_chunk` would have given: the same
+ * results, and the input read once.
+ */
+template < bool Segmented, class DataType, class Operation >
+void scan(
+        const DataType *const   inputArr,
+        const uint8_t *const    headFlags,
+        const size_t            length,
+        DataType *const         outputArr,
+        const Operation         &oper,
+        const DataType          identity,
+        const scan_mode         mode,
+        work_stealing_pool      &pool
+        ) {
+    const size_t chunkLength = reduce_chunk_elements;
+    const size_t chunkCount = (length + chunkLength - 1) / chunkLength;
+    if (chunkCount <= 1 || 1 == pool.size()) {
+        DataType carry = identity;
+        for (size_t first = 0; first < length; first += chunkLength) {
+            bool head;
+            DataType total = scan_chunk<Segmented>(inputArr + first,
+                    Segmented ? headFlags + first : nullptr,
+                    std::min(chunkLength, length - first), outputArr + first,
+                    oper, identity, carry, mode, head);
+            if (Segmented && head)
+                carry = total;
+            else
+                oper(carry, total);
+        }
+        return;
+    }
+
+    // The total of a chunk, for a segmented scan the total of its last
+    // segment and whether it has a head.
+    std::vector<DataType> carries(chunkCount);
+    std::vector<uint8_t> chunkHeads(chunkCount);
+    pool.parallel_for(chunkCount, [&](size_t chunk, unsigned) {
+        const size_t first = chunk * chunkLength;
+        const size_t last = std::min(length, first + chunkLength);
+        bool head;
+        const DataType total = reduce_chunk<Segmented>(inputArr + first,
+                Segmented ? headFlags + first : nullptr, last - first, oper,
+                identity, head);
+        carries[chunk] = total;
+        chunkHeads[chunk] = head;
+    });
+
+    // Exclusive scan of the totals, in place.
+    DataType carry = identity;
+    for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+        DataType total = carries[chunk];
+        carries[chunk] = carry;
+        if (Segmented && chunkHeads[chunk])
+            carry = total;
+        else
+            oper(carry, total);
+    }
+
+    pool.parallel_for(chunkCount, [&](size_t chunk, unsigned) {
+        const size_t first = chunk * chunkLength;
+        bool head;
+        scan_chunk<Segmented>(inputArr + first,
+                Segmented ? headFlags + first : nullptr,
+                std::min(chunkLength, length - first), outputArr + first,
+                oper, identity, carries[chunk], mode, head);
+    });
+}
+
+} // namespace detail
+
+/**
+ * @brief Prefix scan with an operation of `g1b2_reduce_x`, on CPU threads.
+ *
+ * @details Reduce-then-scan over chunks of about 32 Ki elements: the pool
+ * reduces every chunk, the calling thread scans the chunk totals into the
+ * carry of every chunk, and the pool scans every chunk from its carry in
+ * `detail::scan_lanes` parts side by side, one lane of a register per part.
+ * The input is read twice and a chunk is written twice, the second time
+ * from L2. On a pool of one thread the chunks are scanned in order in one
+ * pass, the carries from the scans. The grouping depends on the length
+ * only, so the results do not depend on the number of threads.
+ *
+ * @tparam      DataType        The type of data, which is processed.
+ * @tparam      Operation       The operation type, it is related to the lambda
+ * function parameter.
+ *
+ * @param[in]   inputArr        The input array.
+ * @param[in]   inputArrLength  The length of the input array.
+ * @param[out]  outputArr       The output array of `inputArrLength`
+ * elements, may be `inputArr`.
+ * @param[in]   oper            The operation performed on two elements, as
+ * for `g1b2_reduce_x`: it stores the result in the first reference and may
+ * set the second one to `identity`. It must be associative, unlike the
+ * reduction it need not be commutative: the first reference is always the
+ * earlier element. It must not throw.
+ * @param[in]   identity        The identity of the operation.
+ * @param[in]   mode            An inclusive or an exclusive scan.
+ * @param[in]   pool            The threads to run on.
+ *
+ * Throws `std::bad_alloc` if the chunk totals cannot be allocated.
+ */
+template < class DataType, class Operation >
+void
+scan(
+        const DataType *const   inputArr,
+        const size_t            inputArrLength,
+        DataType *const         outputArr,
+        const Operation         &oper,
+        const DataType          identity,
+        const scan_mode         mode = scan_mode::inclusive,
+        work_stealing_pool      &pool = work_stealing_pool::shared()
+        ) {
+    detail::scan<false>(inputArr, nullptr, inputArrLength, outputArr, oper,
+            identity, mode, pool);
+}
+
+/**
+ * @brief Segmented prefix scan with an operation of `g1b2_reduce_x`, on CPU
+ * threads.
+ *
+ * @details As `scan`, but every element with a nonzero head flag starts a
+ * new segment and the scan restarts there: `out[i]` only combines the
+ * elements from the nearest head at or before `i`. An exclusive scan gives
+ * `identity` at every head. The first element always starts a segment.
+ *
+ * @param[in]   headFlags       One flag per element, nonzero at the first
+ * element of a segment.
+ *
+ * The other parameters and the exceptions are those of `scan`.
+ */
+template < class DataType, class Operation >
+void
+segmented_scan(
+        const DataType *const   inputArr,
+        const uint8_t *const    headFlags,
+        const size_t            inputArrLength,
+        DataType *const         outputArr,
+        const Operation         &oper,
+        const DataType          identity,
+        const scan_mode         mode = scan_mode::inclusive,
+        work_stealing_pool      &pool = work_stealing_pool::shared()
+        ) {
+    detail::scan<true>(inputArr, headFlags, inputArrLength, outputArr, oper,
+            identity, mode, pool);
+}
+
+} // namespace cpu
+
+#endif // SCAN_CPU_HPP
@@ -0,0 +1,267 @@
+#ifndef WORK_STEALING_POOL_HPP
+#define WORK_STEALING_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace cpu {
+
+/**
+ * @brief A fixed set of threads running the chunks of one `parallel_for` at
+ * a time, idle threads steal chunks from busy ones.
+ *
+ * @details The chunks of a call are split into one contiguous range per
+ * worker. A worker takes chunks from the front of its own range and, once it
+ * is empty, steals the back half of the range of another worker, so uneven
+ * chunks even out without a shared counter that every chunk contends on.
+ * Every range is one 64-bit atomic (begin and end, 32 bits each) on its own
+ * cache line, updated by compare-and-swap.
+ *
+ * The calling thread is worker 0 and takes part in the work. A thread that
+ * cannot be started leaves its share to the others.
+ */
+class work_stealing_pool {
+public:
+    /**
+     * @brief `threadCount` workers including the caller, 0 for one per CPU.
+     */
+    explicit work_stealing_pool(unsigned threadCount = 0) {
+        if (0 == threadCount)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        slots_.reset(new slot_t[threadCount]);
+
+        threads_.reserve(threadCount - 1);
+        for (unsigned worker = 1; worker < threadCount; ++worker) {
+            try {
+                threads_.emplace_back(&work_stealing_pool::worker_loop, this,
+                        worker);
+            }
+            catch (const std::system_error &) {
+                break;
+            }
+        }
+        workerCount_ = static_cast<unsigned>(threads_.size()) + 1;
+    }
+
+    work_stealing_pool(const work_stealing_pool &) = delete;
+    work_stealing_pool &operator=(const work_stealing_pool &) = delete;
+
+    ~work_stealing_pool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto &thread : threads_)
+            thread.join();
+    }
+
+    /**
+     * @brief The number of workers, the caller of `parallel_for` included.
+     */
+    unsigned size() const noexcept { return workerCount_; }
+
+    /**
+     * @brief Call `function(chunk, worker)` for every chunk in
+     * `[0, chunkCount)` and return when all calls have returned.
+     *
+     * @details `worker` is in `[0, size())` and unique among the calls that
+     * run at the same time, it indexes per-worker state. `function` must not
+     * throw. Calls from different threads run one after the other; a call
+     * from inside a chunk of this pool runs its chunks on the calling
+     * worker, a call from inside a chunk of another pool is a call like any
+     * other. Pools must not call each other in a cycle.
+     */
+    template < class Function >
+    void parallel_for(size_t chunkCount, Function &&function) {
+        if (this == current().pool) {
+            const unsigned worker = current().worker;
+            for (size_t chunk = 0; chunk < chunkCount; ++chunk)
+                function(chunk, worker);
+            return;
+        }
+
+        std::lock_guard<std::mutex> call(callMutex_);
+        if (1 == workerCount_ || chunkCount <= 1) {
+            const scope_t scope(this, 0);
+            for (size_t chunk = 0; chunk < chunkCount; ++chunk)
+                function(chunk, 0);
+            return;
+        }
+
+        auto invoke = [](void *context, size_t chunk, unsigned worker) {
+            (*static_cast<Function *>(context))(chunk, worker);
+        };
+
+        // The ranges hold 32-bit indices, larger loops run in rounds.
+        for (size_t base = 0; base < chunkCount; base += UINT32_MAX) {
+            const size_t count = std::min<size_t>(chunkCount - base,
+                    UINT32_MAX);
+            start(invoke, &function, base, count);
+            run(0);
+            while (0 != pending_.load(std::memory_order_acquire))
+                std::this_thread::yield();
+        }
+    }
+
+    /**
+     * @brief A pool with one worker per CPU, created on first use.
+     */
+    static work_stealing_pool &shared() {
+        static work_stealing_pool pool;
+        return pool;
+    }
+
+private:
+    typedef void (*invoke_t)(void *, size_t, unsigned);
+
+    struct alignas(64) slot_t {
+        std::atomic<uint64_t>   range{0};   ///< `begin << 32 | end`.
+    };
+
+    static uint64_t pack(uint64_t begin, uint64_t end) {
+        return begin << 32 | end;
+    }
+
+    // The pool whose chunk the thread runs, and its worker index there.
+    struct context_t {
+        const work_stealing_pool    *pool;
+        unsigned                    worker;
+    };
+
+    static context_t &current() {
+        static thread_local context_t context = {nullptr, 0};
+        return context;
+    }
+
+    // The thread is `worker` of `pool` until the end of the scope, then
+    // back in the chunk of the pool it was in before.
+    class scope_t {
+    public:
+        scope_t(const work_stealing_pool *pool, unsigned worker)
+            : saved_(current()) {
+            current() = {pool, worker};
+        }
+
+        ~scope_t() { current() = saved_; }
+
+    private:
+        const context_t saved_;
+    };
+
+    // Publish a job: one even share of the chunks per worker.
+    void start(invoke_t invoke, void *context, size_t base, size_t count) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        // Workers still scanning the ranges of the previous job leave first.
+        while (0 != active_.load(std::memory_order_acquire)) {
+            lock.unlock();
+            std::this_thread::yield();
+            lock.lock();
+        }
+
+        for (unsigned worker = 0; worker < workerCount_; ++worker)
+            slots_[worker].range.store(pack(count * worker / workerCount_,
+                        count * (worker + 1) / workerCount_),
+                    std::memory_order_relaxed);
+        invoke_ = invoke;
+        context_ = context;
+        base_ = base;
+        pending_.store(count, std::memory_order_release);
+        ++epoch_;
+        lock.unlock();
+        wake_.notify_all();
+    }
+
+    // The front chunk of the own range.
+    bool take(unsigned worker, size_t &chunk) {
+        auto &range = slots_[worker].range;
+        uint64_t value = range.load(std::memory_order_acquire);
+        while ((value >> 32) < (value & UINT32_MAX)) {
+            if (range.compare_exchange_weak(value,
+                        pack((value >> 32) + 1, value & UINT32_MAX),
+                        std::memory_order_acq_rel)) {
+                chunk = value >> 32;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // The back half of the range of another worker, its first chunk is run
+    // now and the rest becomes the own range.
+    bool steal(unsigned worker, size_t &chunk) {
+        for (unsigned offset = 1; offset < workerCount_; ++offset) {
+            auto &range = slots_[(worker + offset) % workerCount_].range;
+            uint64_t value = range.load(std::memory_order_acquire);
+            for (;;) {
+                const uint64_t begin = value >> 32, end = value & UINT32_MAX;
+                if (begin >= end)
+                    break;
+                const uint64_t middle = begin + (end - begin) / 2;
+                if (range.compare_exchange_weak(value, pack(begin, middle),
+                            std::memory_order_acq_rel)) {
+                    chunk = middle;
+                    slots_[worker].range.store(pack(middle + 1, end),
+                            std::memory_order_release);
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    void run(unsigned worker) {
+        const scope_t scope(this, worker);
+        size_t chunk;
+        while (take(worker, chunk) || steal(worker, chunk)) {
+            invoke_(context_, base_ + chunk, worker);
+            pending_.fetch_sub(1, std::memory_order_acq_rel);
+        }
+    }
+
+    void worker_loop(unsigned worker) {
+        uint64_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [&] { return stop_ || epoch_ != seen; });
+                if (stop_)
+                    return;
+                seen = epoch_;
+                active_.fetch_add(1, std::memory_order_relaxed);
+            }
+            run(worker);
+            active_.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    std::vector<std::thread>    threads_;
+    std::unique_ptr<slot_t[]>   slots_;
+    unsigned                    workerCount_ = 1;
+
+    std::mutex                  callMutex_;     ///< One job at a time.
+    std::mutex                  mutex_;         ///< Guards the job fields.
+    std::condition_variable     wake_;
+    uint64_t                    epoch_ = 0;     ///< Jobs started.
+    bool                        stop_ = false;
+
+    invoke_t                    invoke_ = nullptr;
+    void                        *context_ = nullptr;
+    size_t                      base_ = 0;
+    std::atomic<size_t>         pending_{0};    ///< Chunks not finished.
+    std::atomic<unsigned>       active_{0};     ///< Threads in `run`.
+};
+
+} // namespace cpu
+
+#endif // WORK_STEALING_POOL_HPP